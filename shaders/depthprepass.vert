@@ -1,10 +1,21 @@
 #version 410 core
-layout (location = 0) in vec3 vert_pos;
+layout (location = 0) in vec4 vert_pos;
 layout (location = 1) in vec3 vert_normal;
 layout (location = 2) in vec2 vert_uv;
+layout (location = 5) in mat4 instance_model;
 
 uniform mat4 MVP;
+uniform vec3 position_bias;
+uniform vec3 position_scale;
+uniform int instanced;
+
+// Same expression as shading.vert, which tests its depth for equal
+invariant gl_Position;
 
 void main() {
-  gl_Position = MVP * vec4(vert_pos, 1.0);
+  vec4 position = vec4(position_bias + vert_pos.xyz * position_scale, 1.0);
+  if (instanced == 1) {
+    position = instance_model * position;
+  }
+  gl_Position = MVP * position;
 }
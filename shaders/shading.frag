@@ -1,5 +1,8 @@
 #version 450 core
 #define MAX_LIGHTS_PER_TILE 1024
+#define MAX_BATCH_MATERIALS 64
+#define VIRTUAL_PAGE_SIZE 128
+#define VIRTUAL_FEEDBACK_SCALE 8
 layout (location = 0) out vec4 out_hdr;
 layout (location = 1) out vec3 out_normal;
 const float PI = 3.14159265359;
@@ -9,6 +12,7 @@ in VS_OUT {
     mat3 TBN;
     vec3 ts_frag_pos;
     vec3 ts_view_pos;
+    flat uint material;
 } vs_in; 
 
 struct Material {
@@ -33,6 +37,11 @@ struct Material {
     vec2 padding;
 };
 
+struct BatchMaterial {
+    Material material;
+    ivec4 textures; // albedo, normal, material, unused
+};
+
 struct Light {
     vec3 position;
     float radius;
@@ -67,20 +76,68 @@ layout (std140) uniform material_data {
 };
 #endif
 
+#if __VERSION__ >= 430
+// Page requests of a pixel in each square, one per texture
+layout (binding = 0, rgba32ui) uniform writeonly uimage2D feedback;
+#endif
+
+layout (std140) uniform batch_materials {
+    BatchMaterial batch[MAX_BATCH_MATERIALS];
+};
+
 uniform mat4 M;
 uniform int num_lights;
 uniform int workgroup_x;
 uniform int debug;
 
+// Albedo is sRGB and read linear, material packs metallic in red and
+// roughness in green
 uniform sampler2DArray albedo_array;
 uniform sampler2DArray normal_array;
-uniform sampler2DArray metallic_array;
-uniform sampler2DArray roughness_array;
+uniform sampler2DArray material_array;
 
 uniform int albedo_tex;
 uniform int normal_tex;
-uniform int metallic_tex;
-uniform int roughness_tex;
+uniform int material_tex;
+uniform int batched;
+
+// Virtual textures: albedo, normal and material. Sizes are the width, height
+// and virtual level count
+uniform int virtual_texturing;
+uniform sampler2D page_caches[3];
+uniform usampler2DArray page_tables[3];
+uniform ivec4 virtual_sizes[3];
+uniform ivec2 feedback_jitter;
+
+// The table entry of the page maps it, or its closest resident ancestor, to
+// a page of the cache. Layers without any resident page become -1
+vec4 sample_virtual(sampler2D cache, usampler2DArray table, ivec4 size,
+                    vec2 uv, inout int layer, out uint request) {
+    vec2 texel_uv = uv * vec2(size.xy);
+    vec2 dx = dFdx(texel_uv);
+    vec2 dy = dFdy(texel_uv);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    int level = int(clamp(lod, 0.0, float(size.z - 1)));
+    vec2 wrapped = fract(uv);
+    ivec2 level_size = max(size.xy >> level, ivec2(1));
+    ivec2 page = min(ivec2(wrapped * vec2(level_size)), level_size - 1) / VIRTUAL_PAGE_SIZE;
+    request = layer < 0 ? 0xffffffffu :
+        (uint(layer) << 20) | (uint(level) << 16) | (uint(page.y) << 8) | uint(page.x);
+
+    uvec4 entry = texelFetch(table, ivec3(page, max(layer, 0)), level);
+    int mapped = int(entry.b);
+    ivec2 mapped_size = max(size.xy >> mapped, ivec2(1));
+    ivec2 texel = min(ivec2(wrapped * vec2(mapped_size)), mapped_size - 1);
+    layer = entry.a == 0u ? -1 : layer;
+    return (texelFetch(cache, ivec2(entry.rg) * VIRTUAL_PAGE_SIZE + texel % VIRTUAL_PAGE_SIZE, 0));
+}
+
+// Array indices carry the first resident level of their layer above the
+// low 16 bits, levels the texture budget dropped are never sampled
+vec4 sample_array(sampler2DArray array, vec2 uv, int index) {
+    float lod = max(textureQueryLod(array, uv).x, float(index >> 16));
+    return (textureLod(array, vec3(uv, float(index & 0xffff)), lod));
+}
 
 float get_attenuation(float light_radius, float dist) {
 
@@ -135,15 +192,44 @@ void main() {
 
     vec3 ts_view_dir = normalize(vs_in.ts_view_pos - vs_in.ts_frag_pos);
 
-    vec4 albedo4 = texture(albedo_array, vec3(vs_in.frag_uv, float(albedo_tex)));
-    vec3 albedo = pow(albedo4.rgb, vec3(2.2));
+    // Statically batched meshes carry their material index per vertex
+    ivec4 textures = ivec4(albedo_tex, normal_tex, material_tex, -1);
+    if (batched == 1) {
+        textures = batch[vs_in.material].textures;
+    }
+
+    // Layers still streaming in have a negative index, sampling stays out of
+    // the branches to keep implicit derivatives valid. virtual_texturing is
+    // uniform, derivatives stay valid on both of its sides
+    vec4 albedo4;
+    vec2 normal_xy;
+    vec2 material;
+    if (virtual_texturing == 1) {
+        uvec4 requests = uvec4(0xffffffffu);
+        albedo4 = sample_virtual(page_caches[0], page_tables[0], virtual_sizes[0], vs_in.frag_uv, textures.x, requests.x);
+        normal_xy = sample_virtual(page_caches[1], page_tables[1], virtual_sizes[1], vs_in.frag_uv, textures.y, requests.y).rg;
+        material = sample_virtual(page_caches[2], page_tables[2], virtual_sizes[2], vs_in.frag_uv, textures.z, requests.z).rg;
+#if __VERSION__ >= 430
+        if (all(equal(loc % VIRTUAL_FEEDBACK_SCALE, feedback_jitter))) {
+            imageStore(feedback, loc / VIRTUAL_FEEDBACK_SCALE, requests);
+        }
+#endif
+    } else {
+        albedo4 = sample_array(albedo_array, vs_in.frag_uv, textures.x);
+        normal_xy = sample_array(normal_array, vs_in.frag_uv, textures.y).rg;
+        material = sample_array(material_array, vs_in.frag_uv, textures.z).rg;
+    }
+    albedo4 = textures.x < 0 ? vec4(0.5, 0.5, 0.5, 1.0) : albedo4;
+    vec3 albedo = albedo4.rgb;
     float alpha = albedo4.a;
 
-    float metallic = texture(metallic_array, vec3(vs_in.frag_uv, float(metallic_tex))).r;
-    float roughness = texture(roughness_array, vec3(vs_in.frag_uv, float(roughness_tex))).r;
+    material = textures.z < 0 ? vec2(0.0, 0.5) : material;
+    float metallic = material.r;
+    float roughness = material.g;
 
-    vec3 normal = texture(normal_array, vec3(vs_in.frag_uv, float(normal_tex))).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
+    // Only x and y are stored, BC5 arrays have no third channel
+    normal_xy = textures.y < 0 ? vec2(0.0) : normal_xy * 2.0 - 1.0;
+    vec3 normal = normalize(vec3(normal_xy, sqrt(max(1.0 - dot(normal_xy, normal_xy), 0.0))));
 
     vec3 f0 = vec3(0.04); 
     f0 = mix(f0, albedo, metallic);
@@ -1,34 +1,67 @@
 #version 450 core
-layout (location = 0) in vec3 vert_pos;
+layout (location = 0) in vec4 vert_pos;
 layout (location = 1) in vec3 vert_normal;
 layout (location = 2) in vec2 vert_uv;
-layout (location = 3) in vec3 vert_tangent;
+layout (location = 3) in vec4 vert_tangent;
+layout (location = 4) in uint vert_material;
+layout (location = 5) in mat4 instance_model;
 
 uniform mat4 MVP;
 uniform mat4 MV;
 uniform mat4 M;
 uniform vec3 view_pos;
+uniform int instanced;
+
+// PackedVertex decoding
+uniform int packed_vertex;
+uniform vec3 position_bias;
+uniform vec3 position_scale;
 
 out VS_OUT {
   vec2 frag_uv;
   mat3 TBN;
   vec3 ts_frag_pos;
   vec3 ts_view_pos;
+  flat uint material;
 } vs_out; 
 
+// Same expression as depthprepass.vert, depth is tested for equal against it
+invariant gl_Position;
+
+vec3 oct_decode(vec2 e) {
+  vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-v.z, 0.0);
+  v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+  return (normalize(v));
+}
 
 void main() {
-  gl_Position = MVP * vec4(vert_pos, 1.0);
-  vec3 frag_pos = vec3(M * vec4(vert_pos, 1.0));
+  vec4 position = vec4(position_bias + vert_pos.xyz * position_scale, 1.0);
+  vec3 normal = vert_normal;
+  vec3 tangent = vert_tangent.xyz;
+  float bitangent_sign = vert_tangent.w;
+  if (packed_vertex == 1) {
+    normal = oct_decode(vert_normal.xy);
+    tangent = oct_decode(vert_tangent.xy);
+    bitangent_sign = vert_pos.w * 2.0 - 1.0;
+  }
+  mat4 model = M;
+  if (instanced == 1) {
+    position = instance_model * position;
+    model = M * instance_model;
+  }
+  gl_Position = MVP * position;
+  vec3 frag_pos = vec3(M * position);
 
-  mat3 normal_matrix = transpose(inverse(mat3(M)));
-  vec3 N = normalize(vec3(normal_matrix * vert_normal));
-  vec3 T = normalize(vec3(normal_matrix * vert_tangent));
+  mat3 normal_matrix = transpose(inverse(mat3(model)));
+  vec3 N = normalize(vec3(normal_matrix * normal));
+  vec3 T = normalize(vec3(normal_matrix * tangent));
   T = normalize(T - dot(T, N) * N);
-  vec3 B = cross(N, T);
+  vec3 B = cross(N, T) * bitangent_sign;
 
   vs_out.frag_uv = vert_uv;
   vs_out.TBN = transpose(mat3(T, B, N));    
   vs_out.ts_view_pos  = vs_out.TBN * view_pos;
   vs_out.ts_frag_pos = vs_out.TBN * frag_pos;
+  vs_out.material = vert_material;
 }
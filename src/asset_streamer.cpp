@@ -0,0 +1,62 @@
+#include "asset_streamer.hpp"
+
+AssetStreamer::AssetStreamer(Loader loader)
+    : _start(std::chrono::steady_clock::now()),
+      _thread([this, loader]() {
+        loader(*this);
+        _loading = false;
+      }) {}
+
+AssetStreamer::~AssetStreamer() {
+  _cancelled = true;
+  _thread.join();
+}
+
+void AssetStreamer::push(Upload upload) {
+  _total++;
+  _uploads.push(std::move(upload));
+}
+
+void AssetStreamer::waitForBacklog(size_t max_pending) const {
+  while (_total - _completed > max_pending && _cancelled == false) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+bool AssetStreamer::cancelled() const { return (_cancelled); }
+
+size_t AssetStreamer::drain(float budget_ms) {
+  auto start = std::chrono::steady_clock::now();
+  size_t count = 0;
+  _drain_ms = 0.0f;
+  Upload upload;
+  while (_uploads.pop(upload)) {
+    upload();
+    upload = nullptr;
+    _completed++;
+    count++;
+    _drain_ms = std::chrono::duration<float, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    if (_drain_ms >= budget_ms) break;
+  }
+  if (_done_ms == 0.0f && done()) _done_ms = elapsedMs();
+  return (count);
+}
+
+float AssetStreamer::drainMs() const { return (_drain_ms); }
+
+bool AssetStreamer::done() const {
+  return (_loading == false && _completed == _total);
+}
+
+size_t AssetStreamer::completed() const { return (_completed); }
+
+size_t AssetStreamer::total() const { return (_total); }
+
+float AssetStreamer::elapsedMs() const {
+  if (_done_ms > 0.0f) return (_done_ms);
+  return (std::chrono::duration<float, std::milli>(
+              std::chrono::steady_clock::now() - _start)
+              .count());
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+// Default render thread time given to uploads each frame, the first upload
+// of a frame always runs
+#define STREAMING_UPLOAD_BUDGET_MS 2.0f
+// Decoded data waiting for the render thread before decoders block
+#define STREAMING_MAX_PENDING_UPLOADS 16
+
+// Multiple producers, single consumer queue (Vyukov): producers only swap
+// the head, the consumer owns the tail which is always a consumed node
+template <typename T>
+class MPSCQueue {
+ public:
+  MPSCQueue() : _head(new Node()), _tail(_head.load()) {}
+  MPSCQueue(MPSCQueue const& src) = delete;
+  MPSCQueue& operator=(MPSCQueue const& rhs) = delete;
+  ~MPSCQueue() {
+    T value;
+    while (pop(value)) {
+    }
+    delete _tail;
+  }
+
+  void push(T value) {
+    Node* node = new Node();
+    node->value = std::move(value);
+    Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // Consumer thread only, false when empty or a push is not linked yet
+  bool pop(T& value) {
+    Node* next = _tail->next.load(std::memory_order_acquire);
+    if (next == nullptr) return (false);
+    value = std::move(next->value);
+    delete _tail;
+    _tail = next;
+    return (true);
+  }
+
+ private:
+  struct Node {
+    T value;
+    std::atomic<Node*> next{nullptr};
+  };
+  std::atomic<Node*> _head;
+  Node* _tail;
+};
+
+// Runs a loader on a background thread, the loader and any worker it uses
+// push uploads that the render thread runs, with the GL context, in drain
+class AssetStreamer {
+ public:
+  typedef std::function<void()> Upload;
+  typedef std::function<void(AssetStreamer& streamer)> Loader;
+
+  AssetStreamer(Loader loader);
+  AssetStreamer(AssetStreamer const& src) = delete;
+  AssetStreamer& operator=(AssetStreamer const& rhs) = delete;
+  // Cancels the loader and waits for it, pending uploads are dropped
+  ~AssetStreamer();
+
+  // Any thread
+  void push(Upload upload);
+  // Blocks while more than max_pending uploads wait for the render thread
+  void waitForBacklog(size_t max_pending) const;
+  bool cancelled() const;
+
+  // Render thread, returns the number of uploads run
+  size_t drain(float budget_ms);
+  float drainMs() const;  // spent in the last drain
+  // Loader returned and all of its uploads ran
+  bool done() const;
+  size_t completed() const;
+  size_t total() const;
+  float elapsedMs() const;  // since the start, frozen once done
+
+ private:
+  MPSCQueue<Upload> _uploads;
+  std::atomic<size_t> _total{0};
+  std::atomic<size_t> _completed{0};
+  std::atomic<bool> _loading{true};
+  std::atomic<bool> _cancelled{false};
+  std::chrono::steady_clock::time_point _start;
+  float _done_ms = 0.0f;
+  float _drain_ms = 0.0f;
+  std::thread _thread;  // last, it starts once everything else is set
+};
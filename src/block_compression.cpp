@@ -0,0 +1,367 @@
+#include "block_compression.hpp"
+
+const char* blockFormatName(BlockFormat format) {
+  switch (format) {
+    case BlockFormat::BC1:
+      return ("BC1");
+    case BlockFormat::BC3:
+      return ("BC3");
+    case BlockFormat::BC4:
+      return ("BC4");
+    case BlockFormat::BC5:
+      return ("BC5");
+    default:
+      return ("uncompressed");
+  }
+}
+
+static size_t blockSize(BlockFormat format) {
+  return (format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16);
+}
+
+size_t imageLevelSize(BlockFormat format, int channels, int width,
+                      int height) {
+  if (format == BlockFormat::None) {
+    return (size_t(width) * height * channels);
+  }
+  return (size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize(format));
+}
+
+// Texels of a 4x4 block as rgba, the edges of levels smaller than a block
+// are repeated
+static void fetchBlock(const ImageLevel& level, int channels, int block_x,
+                       int block_y, uint8_t texels[16][4]) {
+  for (int y = 0; y < 4; y++) {
+    int sy = std::min(block_y * 4 + y, level.height - 1);
+    for (int x = 0; x < 4; x++) {
+      int sx = std::min(block_x * 4 + x, level.width - 1);
+      const unsigned char* texel =
+          &level.pixels[(size_t(sy) * level.width + sx) * channels];
+      for (int c = 0; c < 4; c++) {
+        texels[y * 4 + x][c] = texel[std::min(c, channels - 1)];
+      }
+    }
+  }
+}
+
+static uint16_t packRGB565(const int color[3]) {
+  int r = (color[0] * 31 + 127) / 255;
+  int g = (color[1] * 63 + 127) / 255;
+  int b = (color[2] * 31 + 127) / 255;
+  return (static_cast<uint16_t>((r << 11) | (g << 5) | b));
+}
+
+static void unpackRGB565(uint16_t packed, int color[3]) {
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+static void writeLE(uint8_t* out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+// Endpoints are the corners of the bounding box along the diagonal that
+// follows the correlation of red and blue with green, inset by a sixteenth
+// so the palette covers the texels rather than the outliers. Always the four
+// color mode, the only one BC3 supports
+static void encodeColorBlock(const uint8_t texels[16][4], uint8_t* out) {
+  int min[3] = {255, 255, 255};
+  int max[3] = {0, 0, 0};
+  int sum[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 3; c++) {
+      min[c] = std::min<int>(min[c], texels[i][c]);
+      max[c] = std::max<int>(max[c], texels[i][c]);
+      sum[c] += texels[i][c];
+    }
+  }
+  int covariance_rg = 0;
+  int covariance_bg = 0;
+  for (int i = 0; i < 16; i++) {
+    int g = texels[i][1] * 16 - sum[1];
+    covariance_rg += (texels[i][0] * 16 - sum[0]) * g;
+    covariance_bg += (texels[i][2] * 16 - sum[2]) * g;
+  }
+  if (covariance_rg < 0) std::swap(min[0], max[0]);
+  if (covariance_bg < 0) std::swap(min[2], max[2]);
+  for (int c = 0; c < 3; c++) {
+    int inset = (max[c] - min[c]) / 16;
+    min[c] += inset;
+    max[c] -= inset;
+  }
+  uint16_t color0 = packRGB565(max);
+  uint16_t color1 = packRGB565(min);
+  if (color0 < color1) std::swap(color0, color1);
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    int palette[4][3];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < 16; i++) {
+      int best = 0;
+      int best_distance = std::numeric_limits<int>::max();
+      for (int p = 0; p < 4; p++) {
+        int distance = 0;
+        for (int c = 0; c < 3; c++) {
+          int delta = texels[i][c] - palette[p][c];
+          distance += delta * delta;
+        }
+        if (distance < best_distance) {
+          best_distance = distance;
+          best = p;
+        }
+      }
+      indices |= static_cast<uint32_t>(best) << (2 * i);
+    }
+  }
+  writeLE(out, color0, 2);
+  writeLE(out + 2, color1, 2);
+  writeLE(out + 4, indices, 4);
+}
+
+// Eight value mode between the extremes of the channel, texels are mapped
+// straight to the closest step
+static void encodeChannelBlock(const uint8_t texels[16][4], int channel,
+                               uint8_t* out) {
+  int min = 255;
+  int max = 0;
+  for (int i = 0; i < 16; i++) {
+    min = std::min<int>(min, texels[i][channel]);
+    max = std::max<int>(max, texels[i][channel]);
+  }
+  uint64_t indices = 0;
+  if (max != min) {
+    int range = max - min;
+    for (int i = 0; i < 16; i++) {
+      int step = ((max - texels[i][channel]) * 7 + range / 2) / range;
+      // Steps from max to min are the indices 0, 2, 3, ..., 7, 1
+      int index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+      indices |= static_cast<uint64_t>(index) << (3 * i);
+    }
+  }
+  out[0] = static_cast<uint8_t>(max);
+  out[1] = static_cast<uint8_t>(min);
+  writeLE(out + 2, indices, 6);
+}
+
+static void encodeBlock(BlockFormat format, const uint8_t texels[16][4],
+                        uint8_t* out) {
+  switch (format) {
+    case BlockFormat::BC1:
+      encodeColorBlock(texels, out);
+      break;
+    case BlockFormat::BC3:
+      encodeChannelBlock(texels, 3, out);
+      encodeColorBlock(texels, out + 8);
+      break;
+    case BlockFormat::BC4:
+      encodeChannelBlock(texels, 0, out);
+      break;
+    case BlockFormat::BC5:
+      encodeChannelBlock(texels, 0, out);
+      encodeChannelBlock(texels, 1, out + 8);
+      break;
+    default:
+      break;
+  }
+}
+
+void compressImage(Image& image, BlockFormat format) {
+  if (image.format != BlockFormat::None || format == BlockFormat::None) {
+    return;
+  }
+  for (ImageLevel& level : image.levels) {
+    int blocks_x = (level.width + 3) / 4;
+    int blocks_y = (level.height + 3) / 4;
+    size_t row_size = blocks_x * blockSize(format);
+    std::vector<unsigned char> blocks(row_size * blocks_y);
+    // Rows of blocks are split in tasks of about a thousand blocks
+    ThreadPool::shared().parallelFor(
+        blocks_y, std::max(1024 / blocks_x, 1), [&](size_t begin, size_t end) {
+          uint8_t texels[16][4];
+          for (size_t y = begin; y < end; y++) {
+            uint8_t* out = &blocks[y * row_size];
+            for (int x = 0; x < blocks_x; x++) {
+              fetchBlock(level, image.channels, x, static_cast<int>(y),
+                         texels);
+              encodeBlock(format, texels, out + x * blockSize(format));
+            }
+          }
+        });
+    level.pixels.swap(blocks);
+  }
+  image.format = format;
+}
+
+// Every file of the texture, the missing parts of a material texture count
+// as well. False when none of them can be read
+static bool sourceHash(const std::string& filename, BlockFormat format,
+                       bool srgb, uint64_t& source_hash) {
+  const uint32_t settings[] = {BLOCK_CACHE_VERSION,
+                               static_cast<uint32_t>(format), srgb ? 1u : 0u};
+  source_hash = io::hash(settings, sizeof(settings));
+  bool found = false;
+  std::vector<std::string> sources = textureSources(filename);
+  for (uint32_t i = 0; i < sources.size(); i++) {
+    io::MappedFile source(sources[i]);
+    if (source.data == nullptr) {
+      source_hash = io::hash(&i, sizeof(i), source_hash);
+      continue;
+    }
+    source_hash = io::hash(source.data, source.size, source_hash);
+    found = true;
+  }
+  return (found);
+}
+
+// Material textures are cached next to the first of their files found,
+// under a name made from both
+static std::string cacheFilename(const std::string& filename,
+                                 BlockFormat format, bool srgb) {
+  std::string base = filename;
+  std::vector<std::string> sources = textureSources(filename);
+  if (sources.size() > 1) {
+    io::MappedFile first(sources[0]);
+    base = (first.data != nullptr ? sources[0] : sources[1]) + ".rg" +
+           std::to_string(io::hash(filename.data(), filename.size()));
+  }
+  return (base + "." +
+          (format == BlockFormat::None ? "mips" : blockFormatName(format)) +
+          (srgb ? ".srgb" : "") + ".cache");
+}
+
+static bool parseBlockCache(const io::MappedFile& cache, uint64_t source_hash,
+                            BlockFormat format, BlockCacheHeader& header,
+                            std::vector<CachedLevel>& levels) {
+  if (cache.data == nullptr || cache.size < sizeof(BlockCacheHeader)) {
+    return (false);
+  }
+  std::memcpy(&header, cache.data, sizeof(BlockCacheHeader));
+  if (std::memcmp(header.magic, BlockCacheHeader().magic, 4) != 0 ||
+      header.version != BLOCK_CACHE_VERSION ||
+      header.source_hash != source_hash ||
+      (header.format != static_cast<uint32_t>(format) &&
+       header.format != static_cast<uint32_t>(BlockFormat::None))) {
+    return (false);
+  }
+  // Uncompressed when the size was not made of whole blocks
+  format = static_cast<BlockFormat>(header.format);
+  levels.resize(header.level_count);
+  size_t offset = sizeof(BlockCacheHeader);
+  for (uint32_t i = 0; i < header.level_count; i++) {
+    CachedLevel& level = levels[i];
+    level.width = std::max(static_cast<int>(header.width >> i), 1);
+    level.height = std::max(static_cast<int>(header.height >> i), 1);
+    level.size = imageLevelSize(format, static_cast<int>(header.channels),
+                                level.width, level.height);
+    if (offset + level.size > cache.size) return (false);
+    level.data = cache.data + offset;
+    offset += level.size;
+  }
+  return (true);
+}
+
+static bool readBlockCache(const std::string& cache_filename,
+                           uint64_t source_hash, BlockFormat format,
+                           Image& image) {
+  io::MappedFile cache(cache_filename);
+  BlockCacheHeader header;
+  std::vector<CachedLevel> levels;
+  if (parseBlockCache(cache, source_hash, format, header, levels) == false) {
+    return (false);
+  }
+  image.channels = static_cast<int>(header.channels);
+  image.format = static_cast<BlockFormat>(header.format);
+  image.levels.resize(levels.size());
+  for (size_t i = 0; i < levels.size(); i++) {
+    image.levels[i].width = levels[i].width;
+    image.levels[i].height = levels[i].height;
+    image.levels[i].pixels.assign(levels[i].data,
+                                  levels[i].data + levels[i].size);
+  }
+  return (true);
+}
+
+static bool writeBlockCache(const std::string& cache_filename,
+                            uint64_t source_hash, const Image& image) {
+  BlockCacheHeader header;
+  header.source_hash = source_hash;
+  header.format = static_cast<uint32_t>(image.format);
+  header.channels = static_cast<uint32_t>(image.channels);
+  header.width = static_cast<uint32_t>(image.levels[0].width);
+  header.height = static_cast<uint32_t>(image.levels[0].height);
+  header.level_count = static_cast<uint32_t>(image.levels.size());
+  // Written next to the final file and renamed, as the mesh cache
+  std::string tmp_filename = cache_filename + ".tmp";
+  std::ofstream file(tmp_filename, std::ios::binary | std::ios::trunc);
+  if (!file) return (false);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const ImageLevel& level : image.levels) {
+    file.write(reinterpret_cast<const char*>(level.pixels.data()),
+               level.pixels.size());
+  }
+  file.close();
+  if (!file) {
+    std::remove(tmp_filename.c_str());
+    return (false);
+  }
+  std::remove(cache_filename.c_str());
+  return (std::rename(tmp_filename.c_str(), cache_filename.c_str()) == 0);
+}
+
+bool loadCachedImage(const std::string& filename, BlockFormat format,
+                     bool srgb, Image& image) {
+  uint64_t source_hash = 0;
+  if (sourceHash(filename, format, srgb, source_hash) == false) return (false);
+  std::string cache_filename = cacheFilename(filename, format, srgb);
+  if (readBlockCache(cache_filename, source_hash, format, image)) {
+    return (true);
+  }
+  if (loadImage(filename, image) == false) return (false);
+  generateMips(image, srgb);
+  // Levels of a compressed image start as whole blocks
+  if (image.levels[0].width % 4 != 0 || image.levels[0].height % 4 != 0) {
+    format = BlockFormat::None;
+  }
+  compressImage(image, format);
+  if (writeBlockCache(cache_filename, source_hash, image) == false) {
+    std::cerr << "Cannot write block cache: " << cache_filename << std::endl;
+  }
+  return (true);
+}
+
+bool mapCachedImage(const std::string& filename, BlockFormat format,
+                    bool srgb, MappedImage& image) {
+  uint64_t source_hash = 0;
+  if (sourceHash(filename, format, srgb, source_hash) == false) return (false);
+  std::string cache_filename = cacheFilename(filename, format, srgb);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    image.cache = std::make_unique<io::MappedFile>(cache_filename);
+    BlockCacheHeader header;
+    if (parseBlockCache(*image.cache, source_hash, format, header,
+                        image.levels)) {
+      image.channels = static_cast<int>(header.channels);
+      image.format = static_cast<BlockFormat>(header.format);
+      return (true);
+    }
+    // Unmapped before it is rewritten
+    image.cache.reset();
+    Image built;
+    if (attempt == 0 &&
+        loadCachedImage(filename, format, srgb, built) == false) {
+      return (false);
+    }
+  }
+  image.levels.clear();
+  return (false);
+}
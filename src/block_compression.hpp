@@ -0,0 +1,61 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "image.hpp"
+#include "io.hpp"
+#include "thread_pool.hpp"
+
+// Bump whenever an encoder or the cache layout below changes
+#define BLOCK_CACHE_VERSION 2
+
+struct BlockCacheHeader {
+  char magic[4] = {'B', 'L', 'K', 'C'};
+  uint32_t version = BLOCK_CACHE_VERSION;
+  uint64_t source_hash = 0;
+  uint32_t format = 0;
+  uint32_t channels = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t level_count = 0;
+  uint32_t pad = 0;
+};
+// The blocks of every level follow the header back to back
+
+const char* blockFormatName(BlockFormat format);
+// Bytes of a level in the format, texels when None
+size_t imageLevelSize(BlockFormat format, int channels, int width, int height);
+// Replaces the levels of an uncompressed image by their blocks, the mip chain
+// has to be built first. Block rows are encoded in parallel on the shared pool
+void compressImage(Image& image, BlockFormat format);
+// Decodes a texture, builds its mip chain and compresses it unless format is
+// None, or reads the result from the cache next to it. Images that are not
+// made of whole blocks are left uncompressed
+bool loadCachedImage(const std::string& filename, BlockFormat format,
+                     bool srgb, Image& image);
+
+// A level read in place from a mapped cache
+struct CachedLevel {
+  int width = 0;
+  int height = 0;
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+};
+
+// Levels point into the mapping, valid as long as it is
+struct MappedImage {
+  std::unique_ptr<io::MappedFile> cache;
+  int channels = 0;
+  BlockFormat format = BlockFormat::None;
+  std::vector<CachedLevel> levels;
+};
+
+// The cache loadCachedImage reads, mapped rather than copied and built first
+// when it is missing or stale
+bool mapCachedImage(const std::string& filename, BlockFormat format,
+                    bool srgb, MappedImage& image);
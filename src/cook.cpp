@@ -0,0 +1,178 @@
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include "image.hpp"
+#include "mesh_cache.hpp"
+#include "model.hpp"
+#include "package.hpp"
+#include "thread_pool.hpp"
+
+// Offline cooker: packs the mesh cache of an obj scene and its textures with
+// their mip chains in a single package the renderer maps at startup
+
+static float elapsedMs(std::chrono::steady_clock::time_point since) {
+  return (std::chrono::duration<float, std::milli>(
+              std::chrono::steady_clock::now() - since)
+              .count());
+}
+
+// Textures of the three arrays built by Game, metallic and roughness are
+// packed together as long as one of them exists
+static std::vector<std::string> sceneTextures(const Model& model) {
+  std::set<std::string> names;
+  for (const auto& mesh : model.meshes) {
+    for (const std::string& name :
+         {mesh.diffuse_texname, mesh.bump_texname,
+          materialTextureName(mesh.metallic_texname,
+                              mesh.roughness_texname)}) {
+      for (const auto& source : textureSources(name)) {
+        // Materials without a texture name their base directory
+        if (source.empty() || source.back() == '/') continue;
+        if (io::exists(source)) {
+          names.insert(name);
+          break;
+        }
+      }
+    }
+  }
+  return (std::vector<std::string>(names.begin(), names.end()));
+}
+
+// Startup work of loose files: the obj or its mesh cache, then one decode
+// per texture as TextureArray does
+static float timeLoose(const std::string& filename,
+                       const std::vector<std::string>& textures) {
+  auto start = std::chrono::steady_clock::now();
+  Model model(filename);
+  for (const auto& texture : textures) {
+    Image image;
+    loadImage(texture, image);
+  }
+  return (elapsedMs(start));
+}
+
+// Startup work of the package: the mesh cache copy and a read of every page
+// of the texture levels, which the uploads would fault in
+static float timePackage(const std::string& filename,
+                         const std::vector<std::string>& textures) {
+  auto start = std::chrono::steady_clock::now();
+  Package package(filename);
+  const PackageEntry* scene =
+      package.find(PACKAGE_SCENE_ENTRY, PackageEntryType::Mesh);
+  Model model;
+  if (scene != nullptr) {
+    readMeshCache(package.data(*scene), scene->size, 0, model);
+  }
+  volatile unsigned char sink = 0;
+  for (const auto& texture : textures) {
+    const PackageEntry* entry =
+        package.find(texture, PackageEntryType::Texture);
+    if (entry == nullptr) continue;
+    const unsigned char* data = package.data(*entry);
+    for (uint64_t i = 0; i < entry->size; i += 4096) sink ^= data[i];
+  }
+  return (elapsedMs(start));
+}
+
+static bool writeTexture(PackageWriter& writer, const std::string& name,
+                         const Image& image) {
+  PackageTexture texture;
+  texture.width = static_cast<uint32_t>(image.levels[0].width);
+  texture.height = static_cast<uint32_t>(image.levels[0].height);
+  texture.channels = static_cast<uint32_t>(image.channels);
+  texture.level_count = static_cast<uint32_t>(
+      std::min<size_t>(image.levels.size(), PACKAGE_MAX_LEVELS));
+  PackageWriter::Parts parts;
+  parts.emplace_back(&texture, sizeof(PackageTexture));
+  uint64_t offset = sizeof(PackageTexture);
+  for (uint32_t level = 0; level < texture.level_count; level++) {
+    const std::vector<unsigned char>& pixels = image.levels[level].pixels;
+    offset = PackageWriter::partOffset(offset);
+    texture.level_offsets[level] = offset;
+    texture.level_sizes[level] = pixels.size();
+    offset += pixels.size();
+    parts.emplace_back(pixels.data(), pixels.size());
+  }
+  return (writer.add(name, PackageEntryType::Texture, parts));
+}
+
+int main(int argc, char** argv) {
+  initImageLoading();
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " scene.obj [scene.pack]"
+              << std::endl;
+    return (EXIT_FAILURE);
+  }
+  std::string filename = argv[1];
+  std::string package_filename =
+      argc > 2 ? argv[2]
+               : filename.substr(0, filename.find_last_of('.')) + ".pack";
+
+  auto start = std::chrono::steady_clock::now();
+  Model model(filename);
+  if (model.meshes.empty()) return (EXIT_FAILURE);
+  std::vector<std::string> textures = sceneTextures(model);
+  // Albedo levels are filtered in linear space
+  std::set<std::string> srgb_textures;
+  for (const auto& mesh : model.meshes) {
+    srgb_textures.insert(mesh.diffuse_texname);
+  }
+  std::vector<Image> images(textures.size());
+  ThreadPool::shared().parallelFor(
+      textures.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          if (loadImage(textures[i], images[i])) {
+            generateMips(images[i], srgb_textures.count(textures[i]) > 0);
+          }
+        }
+      });
+
+  PackageWriter writer(package_filename);
+  std::ostringstream mesh_cache;
+  writeMeshCache(mesh_cache, hashModelSources(filename), model);
+  std::string mesh_data = mesh_cache.str();
+  bool success = writer.add(PACKAGE_SCENE_ENTRY, PackageEntryType::Mesh,
+                            {{mesh_data.data(), mesh_data.size()}});
+  size_t texture_count = 0;
+  for (size_t i = 0; i < textures.size(); i++) {
+    if (images[i].levels.empty()) {
+      std::cerr << "Cannot load texture: " << textures[i] << std::endl;
+    } else if (writeTexture(writer, textures[i], images[i]) == false) {
+      std::cerr << "Cannot pack texture: " << textures[i] << std::endl;
+    } else {
+      texture_count++;
+    }
+  }
+  images.clear();
+  if (success == false || writer.finish() == false) {
+    std::cerr << "Cannot write package: " << package_filename << std::endl;
+    return (EXIT_FAILURE);
+  }
+  std::cout << package_filename << ": " << model.meshes.size() << " meshes, "
+            << texture_count << " textures, "
+            << io::get_filesize(package_filename) / (1024 * 1024)
+            << " MiB cooked in " << elapsedMs(start) << " ms" << std::endl;
+
+  // Cold runs evict the files from the page cache first, where the OS lets
+  // us, warm runs follow right after
+  std::vector<std::string> loose_files;
+  for (const auto& texture : textures) {
+    std::vector<std::string> sources = textureSources(texture);
+    loose_files.insert(loose_files.end(), sources.begin(), sources.end());
+  }
+  loose_files.push_back(filename);
+  loose_files.push_back(filename + ".cache");
+  for (const auto& file : loose_files) io::dropFileCache(file);
+  float loose_cold = timeLoose(filename, textures);
+  float loose_warm = timeLoose(filename, textures);
+  io::dropFileCache(package_filename);
+  float package_cold = timePackage(package_filename, textures);
+  float package_warm = timePackage(package_filename, textures);
+  std::cout << "startup, cold / warm:" << std::endl
+            << "  loose files " << loose_cold << " / " << loose_warm << " ms"
+            << std::endl
+            << "  package     " << package_cold << " / " << package_warm
+            << " ms" << std::endl;
+  return (EXIT_SUCCESS);
+}
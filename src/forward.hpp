@@ -2,9 +2,13 @@
 #define TILE_SIZE 16
 #define NUM_LIGHTS 16
 #define MAX_LIGHTS_PER_TILE 1024
+#define PACKED_VERTICES 1
+#define STATIC_BATCHING 1
+#define MAX_BATCH_MATERIALS 64
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/random.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -36,6 +40,12 @@ struct Material {
   glm::vec2 padding = {};
 };
 
+// Material table entry of the static batch, indexed by a per vertex id
+struct BatchMaterial {
+  struct Material material = {};
+  glm::ivec4 textures = glm::ivec4(-1);  // albedo, normal, material, unused
+};
+
 struct Light {
   glm::vec3 position = {};
   float radius = 1.0f;
@@ -54,6 +64,15 @@ struct Vertex {
   glm::vec3 tangent = {0, 0, 0};
 };
 
+// 20 bytes vertex, position is quantized in the mesh AABB, normal and
+// tangent are octahedral encoded and uv are half floats
+struct PackedVertex {
+  uint16_t position[4] = {0, 0, 0, 0};  // w holds the bitangent sign
+  int16_t normal[2] = {0, 0};
+  uint16_t uv[2] = {0, 0};
+  int16_t tangent[2] = {0, 0};
+};
+
 static std::ostream& operator<<(std::ostream& o, glm::vec3 const& v) {
   o << glm::to_string(v);
   return (o);
@@ -0,0 +1,39 @@
+#include "frustum.hpp"
+
+Frustum::Frustum(const glm::mat4& view_proj) {
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; i++) {
+    rows[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i],
+                        view_proj[3][i]);
+  }
+  planes[0] = rows[3] + rows[0];  // left
+  planes[1] = rows[3] - rows[0];  // right
+  planes[2] = rows[3] + rows[1];  // bottom
+  planes[3] = rows[3] - rows[1];  // top
+  planes[4] = rows[3] + rows[2];  // near
+  planes[5] = rows[3] - rows[2];  // far
+  for (auto& plane : planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const {
+  for (const auto& plane : planes) {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+      return (false);
+    }
+  }
+  return (true);
+}
+
+bool Frustum::intersectsAABB(const glm::vec3& center,
+                             const glm::vec3& halfsize) const {
+  for (const auto& plane : planes) {
+    glm::vec3 normal = glm::vec3(plane);
+    float extent = glm::dot(halfsize, glm::abs(normal));
+    if (glm::dot(normal, center) + plane.w < -extent) {
+      return (false);
+    }
+  }
+  return (true);
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "forward.hpp"
+
+// Clip planes of a view projection matrix, when built from a MVP matrix the
+// planes are in object space
+class Frustum {
+ public:
+  Frustum(const glm::mat4& view_proj);
+
+  bool intersectsSphere(const glm::vec3& center, float radius) const;
+  bool intersectsAABB(const glm::vec3& center,
+                      const glm::vec3& halfsize) const;
+
+  glm::vec4 planes[6];
+};
@@ -1,74 +1,824 @@
 #include "game.hpp"
 
-Game::Game(void) {
-  _camera = std::make_unique<Camera>(glm::vec3(-6.0f, -5.0f, 0.0f),
-                                     glm::vec3(-5.0f, -5.0f, 0.0f));
+// Vertices are quantized in the attrib bounds when packed
+static void setVertices(SceneMesh& mesh, const std::vector<Vertex>& vertices) {
+#if PACKED_VERTICES
+  mesh.vertices = packVertices(vertices.data(), vertices.size(),
+                               mesh.attrib.aabb_center,
+                               mesh.attrib.aabb_halfsize,
+                               mesh.attrib.position_bias,
+                               mesh.attrib.position_scale);
+  mesh.attrib.packed_vertices = true;
+#else
+  mesh.vertices = vertices;
+#endif
+}
 
-  Model* model = new Model("data/sponza/sponza.obj");
+static std::shared_ptr<VAO> createVAO(const SceneMesh& mesh) {
+#if PACKED_VERTICES
+  if (mesh.vertices.size() < 65536) {
+    std::vector<uint16_t> short_indices(mesh.indices.begin(),
+                                        mesh.indices.end());
+    return (std::make_shared<VAO>(mesh.vertices, short_indices));
+  }
+#endif
+  return (std::make_shared<VAO>(mesh.vertices, mesh.indices));
+}
+
+static TextureNames meshTextures(const Mesh& mesh) {
+  return (TextureNames{
+      {mesh.diffuse_texname, mesh.bump_texname,
+       materialTextureName(mesh.metallic_texname, mesh.roughness_texname)}});
+}
+
+static glm::mat4 sceneTransform(const Model& model) {
   glm::mat4 scene_scale = glm::scale(glm::vec3(0.01f));
   glm::mat4 scene_transform = glm::translate(
-      -glm::vec3(scene_scale * glm::vec4(model->aabb_center, 1.0f)));
+      -glm::vec3(scene_scale * glm::vec4(model.aabb_center, 1.0f)));
+  return (scene_transform * scene_scale);
+}
 
-  glm::mat4 scene_model = scene_transform * scene_scale;
-  scene_aabb_center =
-      glm::vec3(scene_model * glm::vec4(model->aabb_center, 1.0f));
-  scene_aabb_halfsize =
-      glm::vec3(scene_model * glm::vec4(model->aabb_halfsize, 0.0f));
+// Builds the attribs of a model without touching GL, emit returns false to
+// stop early. Opaque meshes are merged in static batches within a cell, each
+// part keeps its own bounds, levels and meshlets so they are still culled one
+// by one
+static void buildSceneMeshes(const Model& model, const glm::mat4& scene_model,
+                             const CellGrid& grid,
+                             const std::function<bool(SceneMesh&)>& emit) {
+  std::vector<BatchMaterial> batch_materials;
+  std::vector<TextureNames> batch_textures;
+  SceneMesh batch;
+  std::vector<Vertex> batch_vertices;
+  std::shared_ptr<std::vector<Meshlet>> batch_meshlets;
+  std::shared_ptr<std::vector<MeshLod>> batch_lods;
+  std::shared_ptr<std::vector<render::DrawPart>> batch_parts;
+  glm::vec3 batch_min, batch_max;
+  size_t batch_count = 0;
+  size_t batched_meshes = 0;
+  auto resetBatch = [&]() {
+    batch = SceneMesh();
+    batch.attrib.model = scene_model;
+    batch.attrib.batched = true;
+    batch_meshlets = std::make_shared<std::vector<Meshlet>>();
+    batch_lods = std::make_shared<std::vector<MeshLod>>();
+    batch_parts = std::make_shared<std::vector<render::DrawPart>>();
+    batch.attrib.meshlets = batch_meshlets;
+    batch.attrib.lods = batch_lods;
+    batch.attrib.parts = batch_parts;
+    batch_vertices.clear();
+    batch_min = glm::vec3(std::numeric_limits<float>::max());
+    batch_max = glm::vec3(-std::numeric_limits<float>::max());
+  };
+  auto flushBatch = [&]() {
+    if (batch_parts->empty()) return (true);
+    batch.attrib.aabb_center = (batch_min + batch_max) * 0.5f;
+    batch.attrib.aabb_halfsize = (batch_max - batch_min) * 0.5f;
+    setVertices(batch, batch_vertices);
+    batch.batch_materials = batch_materials;
+    batch.batch_textures = batch_textures;
+    batch_count++;
+    batched_meshes += batch_parts->size();
+    bool keep_going = emit(batch);
+    resetBatch();
+    return (keep_going);
+  };
+  resetBatch();
+  // Meshes are walked cell by cell, a batch never spans two cells
+  std::vector<size_t> mesh_cells(model.meshes.size());
+  std::vector<size_t> order(model.meshes.size());
+  for (size_t i = 0; i < model.meshes.size(); i++) {
+    mesh_cells[i] = grid.cellOf(glm::vec3(
+        scene_model * glm::vec4(model.meshes[i].aabb_center, 1.0f)));
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return (mesh_cells[a] < mesh_cells[b]);
+  });
+  for (size_t mesh_index : order) {
+    const Mesh& mesh = model.meshes[mesh_index];
+    size_t cell = mesh_cells[mesh_index];
+    TextureNames textures = meshTextures(mesh);
+#if STATIC_BATCHING
+    if (mesh.alpha_mask == false && mesh.instanceCount == 0) {
+      if (batch.cell != cell && flushBatch() == false) return;
+      batch.cell = cell;
+      // Texture indices are resolved by Game::resolveBatchMaterials
+      BatchMaterial batch_material;
+      batch_material.material = mesh.material;
+      size_t material_id = 0;
+      while (material_id < batch_materials.size() &&
+             (std::memcmp(&batch_materials[material_id], &batch_material,
+                          sizeof(BatchMaterial)) != 0 ||
+              batch_textures[material_id] != textures)) {
+        material_id++;
+      }
+      if (material_id < MAX_BATCH_MATERIALS) {
+        if (material_id == batch_materials.size()) {
+          batch_materials.push_back(batch_material);
+          batch_textures.push_back(textures);
+        }
+        render::DrawPart part;
+        part.index_offset = static_cast<uint32_t>(batch.indices.size());
+        part.index_count = mesh.indexCount;
+        part.meshlet_offset = static_cast<uint32_t>(batch_meshlets->size());
+        part.meshlet_count = mesh.meshletCount;
+        part.lod_offset = static_cast<uint32_t>(batch_lods->size());
+        part.lod_count = mesh.lodCount;
+        part.aabb_center = mesh.aabb_center;
+        part.aabb_halfsize = mesh.aabb_halfsize;
+        batch_parts->push_back(part);
 
-  std::vector<std::string> albedo_textures;
-  std::vector<std::string> normal_textures;
-  std::vector<std::string> metallic_textures;
-  std::vector<std::string> roughness_textures;
-  for (const auto& mesh : model->meshes) {
-    albedo_textures.push_back(mesh.diffuse_texname);
-    normal_textures.push_back(mesh.bump_texname);
-    metallic_textures.push_back(mesh.metallic_texname);
-    roughness_textures.push_back(mesh.roughness_texname);
-  }
-  _albedo_array = std::make_shared<TextureArray>(albedo_textures);
-  _normal_array = std::make_shared<TextureArray>(normal_textures);
-  _metallic_array = std::make_shared<TextureArray>(metallic_textures);
-  _roughness_array = std::make_shared<TextureArray>(roughness_textures);
-
-  for (const auto& mesh : model->meshes) {
-    std::vector<Vertex> vertices;
-    for (size_t i = mesh.vertexOffset;
-         i < model->vertices.size() && i < mesh.vertexOffset + mesh.indexCount;
-         i++) {
-      vertices.push_back(model->vertices[i]);
+        unsigned int vertex_base =
+            static_cast<unsigned int>(batch_vertices.size());
+        batch_vertices.insert(
+            batch_vertices.end(),
+            model.vertices.begin() + mesh.vertexOffset,
+            model.vertices.begin() + mesh.vertexOffset + mesh.vertexCount);
+        batch.material_ids.resize(batch_vertices.size(),
+                                  static_cast<uint16_t>(material_id));
+        for (uint32_t i = 0; i < mesh.indexCount; i++) {
+          batch.indices.push_back(vertex_base +
+                                  model.indices[mesh.indexOffset + i]);
+        }
+        batch_meshlets->insert(
+            batch_meshlets->end(),
+            model.meshlets.begin() + mesh.meshletOffset,
+            model.meshlets.begin() + mesh.meshletOffset + mesh.meshletCount);
+        batch_lods->insert(batch_lods->end(), mesh.lods,
+                           mesh.lods + mesh.lodCount);
+        batch_min = glm::min(batch_min, mesh.aabb_center - mesh.aabb_halfsize);
+        batch_max = glm::max(batch_max, mesh.aabb_center + mesh.aabb_halfsize);
+        if (batch.indices.size() / 3 >= STATIC_BATCH_MAX_TRIANGLES &&
+            flushBatch() == false) {
+          return;
+        }
+        continue;
+      }
     }
-    render::Attrib attrib;
+#endif
+
+    SceneMesh scene_mesh;
+    render::Attrib& attrib = scene_mesh.attrib;
     attrib.model = scene_model;
     attrib.material = mesh.material;
+    attrib.alpha_mask = mesh.alpha_mask;
+    attrib.meshlets = std::make_shared<std::vector<Meshlet>>(
+        model.meshlets.begin() + mesh.meshletOffset,
+        model.meshlets.begin() + mesh.meshletOffset + mesh.meshletCount);
+    attrib.lods = std::make_shared<std::vector<MeshLod>>(
+        mesh.lods, mesh.lods + mesh.lodCount);
+    attrib.aabb_center = mesh.aabb_center;
+    attrib.aabb_halfsize = mesh.aabb_halfsize;
+    if (mesh.instanceCount > 0) {
+      attrib.instances = std::make_shared<std::vector<glm::mat4>>(
+          model.instances.begin() + mesh.instanceOffset,
+          model.instances.begin() + mesh.instanceOffset + mesh.instanceCount);
+    }
+    setVertices(scene_mesh, std::vector<Vertex>(
+                                model.vertices.begin() + mesh.vertexOffset,
+                                model.vertices.begin() + mesh.vertexOffset +
+                                    mesh.vertexCount));
+    scene_mesh.indices.assign(
+        model.indices.begin() + mesh.indexOffset,
+        model.indices.begin() + mesh.indexOffset + mesh.indexCount);
+    scene_mesh.textures = textures;
+    scene_mesh.cell = cell;
+    if (emit(scene_mesh) == false) return;
+  }
+  if (flushBatch() && batch_count > 0) {
+    std::cout << "Static batches: " << batch_count << ", " << batched_meshes
+              << " meshes, " << batch_materials.size() << " materials"
+              << std::endl;
+  }
+}
 
-    attrib.albedo_index = _albedo_array->getTextureIndex(mesh.diffuse_texname);
-    attrib.normal_index = _normal_array->getTextureIndex(mesh.bump_texname);
-    attrib.metallic_index =
-        _metallic_array->getTextureIndex(mesh.metallic_texname);
-    attrib.roughness_index =
-        _roughness_array->getTextureIndex(mesh.roughness_texname);
+// Layers of a streamed array from the image headers, they have to match the
+// first one as in the package path
+struct TextureLayout {
+  std::vector<std::string> textures;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  bool alpha = false;  // any of the files has an alpha channel
+  BlockFormat format = BlockFormat::None;
+};
 
-    attrib.alpha_mask = mesh.alpha_mask;
+static TextureLayout textureLayout(const std::set<std::string>& textures) {
+  TextureLayout layout;
+  for (const auto& texture : textures) {
+    int width, height, channels;
+    bool alpha;
+    if (loadImageInfo(texture, width, height, channels, alpha) == false) {
+      continue;
+    }
+    if (layout.textures.empty()) {
+      layout.width = width;
+      layout.height = height;
+      layout.channels = channels;
+    } else if (width != layout.width || height != layout.height ||
+               channels != layout.channels) {
+      std::cout << "skipping " << texture << ": " << width << "x" << height
+                << " in a " << layout.width << "x" << layout.height
+                << " array" << std::endl;
+      continue;
+    }
+    layout.textures.push_back(texture);
+    layout.alpha = layout.alpha || alpha;
+  }
+  return (layout);
+}
+
+// Albedo keeps its alpha in BC3 only when there is one, normals keep x and y
+// in BC5 and the shader rebuilds z, metallic and roughness share BC5 as well,
+// single channel maps go to BC4
+static BlockFormat blockFormat(size_t slot, const TextureLayout& layout) {
+  if (layout.width % 4 != 0 || layout.height % 4 != 0) {
+    return (BlockFormat::None);
+  }
+  if (layout.channels == 1) return (BlockFormat::BC4);
+  if (slot >= 1) return (BlockFormat::BC5);
+  return (layout.alpha ? BlockFormat::BC3 : BlockFormat::BC1);
+}
+
+Game::Game(void) : Game(StressScene()) {}
+
+Game::Game(const std::string& scene_filename)
+    : Game([&scene_filename]() {
+        StressScene stress;
+        stress.scene = scene_filename;
+        return (stress);
+      }()) {}
+
+Game::Game(const StressScene& stress)
+    : _static_light_mode(stress.static_lights),
+      _cluster_culling_mode(stress.cluster_culling),
+      _lod_mode(stress.lod),
+      _stress(stress),
+      _rng(stress.seed),
+      _start_time(std::chrono::steady_clock::now()) {
+  const std::string& scene_filename = stress.scene;
+  _camera = std::make_unique<Camera>(glm::vec3(-6.0f, -5.0f, 0.0f),
+                                     glm::vec3(-5.0f, -5.0f, 0.0f));
+
+  // Feedback is written with image stores
+  if (_stress.virtual_texturing &&
+      (GLVersion.major < 4 || (GLVersion.major == 4 && GLVersion.minor < 3))) {
+    std::cout << "Virtual texturing needs OpenGL 4.3, streaming whole textures"
+              << std::endl;
+    _stress.virtual_texturing = false;
+  }
+  // Arrays allocated from now on can drop levels past the budget
+  TextureResidency& residency = TextureResidency::shared();
+  residency.setBudget(static_cast<size_t>(_stress.texture_budget) * 1024 *
+                      1024);
+  if (_stress.texture_budget > 0 && residency.sparse() == false) {
+    std::cout << "Texture budget needs ARB_sparse_texture, memory is only "
+                 "reported"
+              << std::endl;
+  }
+  std::string extension =
+      scene_filename.substr(scene_filename.find_last_of('.') + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 ::tolower);
+  if (extension == "glb") {
+    loadGLBScene(scene_filename);
+  } else if (extension == "pack") {
+    loadPackageScene(scene_filename);
+  } else {
+    loadOBJScene(scene_filename);
+  }
+  if (_streamer == nullptr) {
+    std::cout << scene_filename << ": scene ready in "
+              << std::chrono::duration<float, std::milli>(
+                     std::chrono::steady_clock::now() - _start_time)
+                     .count()
+              << " ms" << std::endl;
+  }
+  std::cout << _tiles.size() << " tiles"
+            << (_stress.instancing ? " instanced, " : ", ") << _stress.lights
+            << " lights, seed " << _stress.seed << std::endl;
+}
+
+// Bounds of one copy of the scene, the stress grid tiles it around the origin
+void Game::setSceneBounds(const glm::vec3& aabb_center,
+                          const glm::vec3& aabb_halfsize) {
+  _tiles = _stress.tileOffsets(aabb_halfsize);
+  scene_aabb_center = aabb_center;
+  scene_aabb_halfsize = _stress.tiledHalfsize(aabb_halfsize);
+  _cell_grid = CellGrid(scene_aabb_center, scene_aabb_halfsize);
+  _cells = SceneCells(_cell_grid, size_t(_stress.cell_budget) * 1024 * 1024);
+  _scene_root = _scene_graph.addNode(SCENE_NODE_NONE, glm::mat4(1.0f));
+  for (const glm::vec3& offset : _tiles) {
+    _tile_nodes.push_back(
+        _scene_graph.addNode(_scene_root, glm::translate(offset)));
+  }
+  _rng.seed(_stress.seed);
+  for (unsigned int i = 0; i < _stress.lights; i++) spawnLight(i);
+}
+
+// Lights spawn on the floor of the spread area and rise through the scene
+void Game::spawnLight(unsigned int i) {
+  auto random = [this](float min, float max) {
+    return (std::uniform_real_distribution<float>(min, max)(_rng));
+  };
+  glm::vec3 halfsize =
+      glm::max(scene_aabb_halfsize - glm::vec3(3.0f, 0.0f, 3.0f),
+               glm::vec3(0.0f)) *
+      glm::vec3(_stress.light_spread, 1.0f, _stress.light_spread);
+  Light& light = lights.lights[i];
+  light.position =
+      scene_aabb_center + glm::vec3(random(-halfsize.x, halfsize.x),
+                                    -halfsize.y,
+                                    random(-halfsize.z, halfsize.z));
+  light.radius = random(_stress.light_radius_min, _stress.light_radius_max);
+  light.color = glm::vec3(random(0.0f, 1.0f), random(0.0f, 1.0f),
+                          random(0.0f, 1.0f));
+  light.intensity = 1.0f;
+  lights_speed[i] = random(_stress.light_speed_min, _stress.light_speed_max);
+}
+
+// The first frame renders right away, meshes appear as they are uploaded and
+// draw with placeholder values until their textures land
+void Game::loadOBJScene(const std::string& filename) {
+  std::vector<std::string> no_textures;
+  _albedo_array = std::make_shared<TextureArray>(no_textures);
+  _normal_array = std::make_shared<TextureArray>(no_textures);
+  _material_array = std::make_shared<TextureArray>(no_textures);
+  // Decoders write the textures straight into the ring, the render thread
+  // only queues the copies from it
+  if (_stress.virtual_texturing == false && UploadRing::supported()) {
+    _upload_ring = std::make_unique<UploadRing>();
+  }
+  _streamer = std::make_unique<AssetStreamer>(
+      [this, filename](AssetStreamer& streamer) {
+        streamOBJScene(streamer, filename);
+      });
+}
+
+void Game::streamOBJScene(AssetStreamer& streamer,
+                          const std::string& filename) {
+  Model model(filename);
+  if (model.meshes.empty()) {
+    std::cerr << "Empty scene: " << filename << std::endl;
+    return;
+  }
+  glm::mat4 scene_model = sceneTransform(model);
+  glm::vec3 aabb_center =
+      glm::vec3(scene_model * glm::vec4(model.aabb_center, 1.0f));
+  glm::vec3 aabb_halfsize =
+      glm::vec3(scene_model * glm::vec4(model.aabb_halfsize, 0.0f));
+  CellGrid grid(aabb_center, aabb_halfsize);
+  streamer.push([this, aabb_center, aabb_halfsize]() {
+    setSceneBounds(aabb_center, aabb_halfsize);
+  });
+
+  // Arrays are allocated from the headers, before any mesh refers to them
+  std::array<std::set<std::string>, 3> texture_sets;
+  for (const auto& mesh : model.meshes) {
+    TextureNames textures = meshTextures(mesh);
+    for (size_t i = 0; i < textures.size(); i++) {
+      texture_sets[i].insert(textures[i]);
+    }
+  }
+  std::array<TextureLayout, 3> layouts;
+  for (size_t i = 0; i < layouts.size(); i++) {
+    layouts[i] = textureLayout(texture_sets[i]);
+    if (_stress.texture_compression) {
+      layouts[i].format = blockFormat(i, layouts[i]);
+    }
+  }
+  streamer.push([this, layouts]() {
+    std::shared_ptr<TextureArray>* arrays[] = {&_albedo_array, &_normal_array,
+                                               &_material_array};
+    for (size_t i = 0; i < layouts.size(); i++) {
+      if (_stress.virtual_texturing) {
+        // Albedo is the only sRGB texture
+        _virtual_textures[i] = std::make_shared<VirtualTexture>(
+            layouts[i].textures, layouts[i].width, layouts[i].height,
+            layouts[i].channels, layouts[i].format, i == 0);
+      } else {
+        *arrays[i] = std::make_shared<TextureArray>(
+            layouts[i].textures, layouts[i].width, layouts[i].height,
+            layouts[i].channels, layouts[i].format, i == 0);
+      }
+    }
+    printTextureMemory();
+  });
+
+  buildSceneMeshes(
+      model, scene_model, grid, [this, &streamer](SceneMesh& scene_mesh) {
+        std::shared_ptr<const SceneMesh> mesh =
+            std::make_shared<SceneMesh>(std::move(scene_mesh));
+        streamer.push([this, mesh]() { addSceneMesh(mesh); });
+        return (streamer.cancelled() == false);
+      });
+
+  // Virtual textures read their pages as the feedback asks for them
+  if (_stress.virtual_texturing) return;
+
+  // Decoders hold back once enough images wait for the render thread
+  std::vector<std::pair<size_t, std::string>> textures;
+  for (size_t i = 0; i < layouts.size(); i++) {
+    for (const auto& texture : layouts[i].textures) {
+      textures.emplace_back(i, texture);
+    }
+  }
+  ThreadPool::shared().parallelFor(
+      textures.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          streamer.waitForBacklog(STREAMING_MAX_PENDING_UPLOADS);
+          if (streamer.cancelled()) return;
+          size_t array = textures[i].first;
+          std::string name = textures[i].second;
+          // Albedo is the only sRGB array
+          if (stageTexture(streamer, name, layouts[array].format, array == 0,
+                           array)) {
+            continue;
+          }
+          if (streamer.cancelled()) return;
+          auto image = std::make_shared<Image>();
+          if (loadCachedImage(name, layouts[array].format, array == 0,
+                              *image) == false) {
+            continue;
+          }
+          streamer.push([this, array, name, image]() {
+            TextureArray* arrays[] = {_albedo_array.get(),
+                                      _normal_array.get(),
+                                      _material_array.get()};
+            if (arrays[array]->uploadLayer(name, *image)) {
+              textureUploaded(name);
+            }
+          });
+        }
+      });
+}
+
+// Levels are copied from the mapped cache into the ring, waiting for room
+// as long as the stream goes on. False when the texture has to be loaded in
+// client memory instead
+bool Game::stageTexture(AssetStreamer& streamer, const std::string& name,
+                        BlockFormat format, bool srgb, size_t array) {
+  MappedImage cached;
+  if (_upload_ring == nullptr ||
+      mapCachedImage(name, format, srgb, cached) == false ||
+      _upload_ring->fits(cached) == false) {
+    return (false);
+  }
+  auto staged = std::make_shared<StagedImage>();
+  while (_upload_ring->stage(cached, *staged) == false) {
+    if (streamer.cancelled()) return (false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  streamer.push([this, array, name, staged]() {
+    TextureArray* arrays[] = {_albedo_array.get(), _normal_array.get(),
+                              _material_array.get()};
+    if (arrays[array]->uploadLayer(name, *staged)) textureUploaded(name);
+    _upload_ring->release(staged->block);
+  });
+  return (true);
+}
+
+// Cooked scene, the mesh cache and mipmapped textures are read in place
+void Game::loadPackageScene(const std::string& filename) {
+  // Placeholders so a missing package renders an empty scene
+  std::vector<std::string> no_textures;
+  _albedo_array = std::make_shared<TextureArray>(no_textures);
+  _normal_array = std::make_shared<TextureArray>(no_textures);
+  _material_array = std::make_shared<TextureArray>(no_textures);
+  Package package(filename);
+  const PackageEntry* entry =
+      package.find(PACKAGE_SCENE_ENTRY, PackageEntryType::Mesh);
+  Model model;
+  if (package.valid == false || entry == nullptr ||
+      readMeshCache(package.data(*entry), entry->size, 0, model) == false) {
+    std::cerr << "Empty scene: " << filename << std::endl;
+    return;
+  }
+  glm::mat4 scene_model = sceneTransform(model);
+  glm::vec3 aabb_center =
+      glm::vec3(scene_model * glm::vec4(model.aabb_center, 1.0f));
+  glm::vec3 aabb_halfsize =
+      glm::vec3(scene_model * glm::vec4(model.aabb_halfsize, 0.0f));
+  setSceneBounds(aabb_center, aabb_halfsize);
+
+  std::array<std::vector<std::string>, 3> textures;
+  for (const auto& mesh : model.meshes) {
+    TextureNames names = meshTextures(mesh);
+    for (size_t i = 0; i < names.size(); i++) textures[i].push_back(names[i]);
+  }
+  _albedo_array = std::make_shared<TextureArray>(textures[0], package, true);
+  _normal_array = std::make_shared<TextureArray>(textures[1], package);
+  _material_array = std::make_shared<TextureArray>(textures[2], package);
+  printTextureMemory();
+
+  CellGrid grid(aabb_center, aabb_halfsize);
+  buildSceneMeshes(model, scene_model, grid, [this](SceneMesh& mesh) {
+    addSceneMesh(std::make_shared<SceneMesh>(std::move(mesh)));
+    return (true);
+  });
+}
+
+static size_t gpuBytes(const SceneMesh& mesh, const render::Attrib& attrib) {
+  size_t index_size = sizeof(unsigned int);
+#if PACKED_VERTICES
+  if (mesh.vertices.size() < 65536) index_size = sizeof(uint16_t);
+#endif
+  size_t bytes = mesh.vertices.size() * sizeof(mesh.vertices[0]) +
+                 mesh.indices.size() * index_size +
+                 mesh.material_ids.size() * sizeof(uint16_t);
+  if (attrib.instances != nullptr) {
+    bytes += attrib.instances->size() * sizeof(glm::mat4);
+  }
+  return (bytes);
+}
+
+static std::shared_ptr<VAO> createAttribVAO(const SceneMesh& mesh,
+                                            const render::Attrib& attrib) {
+  std::shared_ptr<VAO> vao = createVAO(mesh);
+  if (attrib.instances != nullptr) {
+    vao->addInstanceTransforms(*attrib.instances);
+  }
+  if (attrib.batched) vao->addMaterialIds(mesh.material_ids);
+  return (vao);
+}
+
+// Render thread. Each tile of the stress grid gets its own attrib, or the
+// tiles falling in a cell share an instanced one
+void Game::addSceneMesh(const std::shared_ptr<const SceneMesh>& mesh) {
+  const render::Attrib& base = mesh->attrib;
+  if (base.batched) {
+    _batch_material_table = mesh->batch_materials;
+    _batch_material_textures = mesh->batch_textures;
+    resolveBatchMaterials();
+  }
+  bool instanced = _stress.instancing && _tiles.size() > 1;
+  std::map<size_t, std::vector<glm::mat4>> cell_instances;
+  for (size_t i = 0; i < _tiles.size(); i++) {
+    glm::mat4 model = glm::translate(_tiles[i]) * base.model;
+    size_t cell = _cell_grid.cellOf(
+        glm::vec3(model * glm::vec4(base.aabb_center, 1.0f)));
+    if (instanced == false) {
+      render::Attrib attrib = base;
+      attrib.model = model;
+      attrib.node = addAttribNode(_tile_nodes[i], base.model, attrib);
+      addCellAttrib(mesh, attrib, cell);
+      continue;
+    }
+    // Instances stay in the space of the mesh model matrix
+    glm::mat4 tile = glm::inverse(base.model) * model;
+    std::vector<glm::mat4>& instances = cell_instances[cell];
+    if (base.instances == nullptr) {
+      instances.push_back(tile);
+    } else {
+      for (const glm::mat4& instance : *base.instances) {
+        instances.push_back(tile * instance);
+      }
+    }
+  }
+  for (auto& cell : cell_instances) {
+    render::Attrib attrib = base;
+    attrib.instances =
+        std::make_shared<std::vector<glm::mat4>>(std::move(cell.second));
+    attrib.node = addAttribNode(_scene_root, base.model, attrib);
+    addCellAttrib(mesh, attrib, cell.first);
+  }
+}
+
+// Node bounds cover every instance of the attrib, in the space of its model
+SceneGraph::NodeId Game::addAttribNode(SceneGraph::NodeId parent,
+                                       const glm::mat4& local,
+                                       const render::Attrib& attrib) {
+  glm::vec3 aabb_center = attrib.aabb_center;
+  glm::vec3 aabb_halfsize = attrib.aabb_halfsize;
+  if (attrib.instances != nullptr && attrib.instances->empty() == false) {
+    glm::vec3 aabb_min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 aabb_max = glm::vec3(-std::numeric_limits<float>::max());
+    for (const glm::mat4& instance : *attrib.instances) {
+      glm::vec3 center = attrib.aabb_center;
+      glm::vec3 halfsize = attrib.aabb_halfsize;
+      transformAABB(instance, center, halfsize);
+      aabb_min = glm::min(aabb_min, center - halfsize);
+      aabb_max = glm::max(aabb_max, center + halfsize);
+    }
+    aabb_center = (aabb_min + aabb_max) * 0.5f;
+    aabb_halfsize = (aabb_max - aabb_min) * 0.5f;
+  }
+  SceneGraph::NodeId node = _scene_graph.addNode(parent, local);
+  _scene_graph.setBounds(node, aabb_center, aabb_halfsize);
+  return (node);
+}
+
+// The vertex array is only created if the cell is resident
+void Game::addCellAttrib(const std::shared_ptr<const SceneMesh>& mesh,
+                         render::Attrib attrib, size_t cell) {
+  if (_cells.resident(cell)) attrib.vao = createAttribVAO(*mesh, attrib);
+  _cells.addItem(cell, attribs.size(), gpuBytes(*mesh, attrib));
+  size_t index = attribs.size();
+  attribs.push_back(attrib);
+  _attrib_textures.push_back(mesh->textures);
+  _scene_meshes.push_back(mesh);
+  for (const auto& texture : mesh->textures) {
+    std::vector<size_t>& users = _texture_attribs[texture];
+    if (users.empty() || users.back() != index) users.push_back(index);
+  }
+  resolveAttribTextures(index);
+}
+
+// Evictions free their vertex arrays right away, loads are uploaded in
+// priority order until the frame budget is spent
+void Game::updateCells() {
+  _cells.update(_camera->pos, _camera->dir, _cell_evictions, _cell_loads);
+  for (size_t cell : _cell_evictions) {
+    for (size_t item : _cells.items(cell)) attribs[item].vao = nullptr;
+    _cells.setResident(cell, false);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (size_t cell : _cell_loads) {
+    for (size_t item : _cells.items(cell)) {
+      attribs[item].vao =
+          createAttribVAO(*_scene_meshes[item], attribs[item]);
+    }
+    _cells.setResident(cell, true);
+    if (std::chrono::duration<float, std::milli>(
+            std::chrono::steady_clock::now() - start)
+            .count() >= _stress.upload_budget) {
+      break;
+    }
+  }
+}
+
+void Game::printTextureMemory() const {
+  const char* names[] = {"albedo", "normal", "material"};
+  const TextureArray* arrays[] = {_albedo_array.get(), _normal_array.get(),
+                                  _material_array.get()};
+  for (size_t i = 0; i < 3; i++) {
+    const VirtualTexture* texture = _virtual_textures[i].get();
+    if (texture != nullptr) {
+      std::cout << names[i] << " virtual texture: " << texture->width << "x"
+                << texture->height << " "
+                << blockFormatName(texture->format) << ", "
+                << texture->level_count << " levels, "
+                << texture->gpu_bytes / (1024 * 1024) << " MiB resident ("
+                << texture->virtual_bytes / (1024 * 1024) << " MiB virtual)"
+                << std::endl;
+      continue;
+    }
+    std::cout << names[i] << " array: " << arrays[i]->width << "x"
+              << arrays[i]->height << " "
+              << blockFormatName(arrays[i]->format) << ", "
+              << arrays[i]->gpu_bytes / (1024 * 1024) << " MiB ("
+              << arrays[i]->uncompressed_bytes / (1024 * 1024)
+              << " MiB uncompressed)" << std::endl;
+  }
+}
 
-    attrib.vao = std::make_shared<VAO>(vertices);
-    attribs.push_back(attrib);
+// Layers that are not resident yet stay at -1, the shader falls back to
+// placeholder values for them
+glm::ivec4 Game::resolveTextures(const TextureNames& textures) const {
+  const TextureArray* arrays[] = {_albedo_array.get(), _normal_array.get(),
+                                  _material_array.get()};
+  glm::ivec4 indices(-1);
+  for (int i = 0; i < 3; i++) {
+    indices[i] = _virtual_textures[i] != nullptr
+                     ? _virtual_textures[i]->findTextureIndex(textures[i])
+                     : arrays[i]->findTextureIndex(textures[i]);
   }
-  delete model;
-  glm::vec3 min_bound = scene_aabb_center - scene_aabb_halfsize;
-  glm::vec3 max_bound = scene_aabb_center + scene_aabb_halfsize;
-  min_bound = glm::vec3(min_bound.x + 3.0f, min_bound.y, min_bound.z + 3.0f);
-  max_bound = glm::vec3(max_bound.x - 3.0f, max_bound.y, max_bound.z - 3.0f);
-  for (int i = 0; i < NUM_LIGHTS; i++) {
-    // lights.lights[i].position = glm::vec3(-10.0 + i * 10.0, -6.0f, 0.0f);
-    lights.lights[i].position =
-        glm::vec3(glm::linearRand(min_bound.x, max_bound.x), min_bound.y,
-                  glm::linearRand(min_bound.z, max_bound.z));
-    lights.lights[i].radius = 4.0f;
-    lights.lights[i].color =
-        glm::vec3(glm::linearRand(0.0f, 1.0f), glm::linearRand(0.0f, 1.0f),
-                  glm::linearRand(0.0f, 1.0f));
-    lights.lights[i].intensity = 1.0f;
-    lights_speed[i] = glm::linearRand(0.5f, 5.0f);
+  return (indices);
+}
+
+void Game::resolveAttribTextures(size_t attrib) {
+  glm::ivec4 textures = resolveTextures(_attrib_textures[attrib]);
+  attribs[attrib].albedo_index = textures.x;
+  attribs[attrib].normal_index = textures.y;
+  attribs[attrib].material_index = textures.z;
+}
+
+// The table holds at most MAX_BATCH_MATERIALS entries, it is resolved and
+// handed to the renderer as a whole
+void Game::resolveBatchMaterials() {
+  if (_batch_material_table.empty()) return;
+  auto batch_materials =
+      std::make_shared<std::vector<BatchMaterial>>(_batch_material_table);
+  for (size_t i = 0; i < batch_materials->size(); i++) {
+    (*batch_materials)[i].textures =
+        resolveTextures(_batch_material_textures[i]);
+  }
+  _batch_materials = batch_materials;
+}
+
+// Only the attribs and the batch materials using the texture change
+void Game::textureUploaded(const std::string& name) {
+  auto users = _texture_attribs.find(name);
+  if (users != _texture_attribs.end()) {
+    for (size_t attrib : users->second) resolveAttribTextures(attrib);
+  }
+  for (const auto& textures : _batch_material_textures) {
+    if (std::find(textures.begin(), textures.end(), name) != textures.end()) {
+      resolveBatchMaterials();
+      break;
+    }
+  }
+}
+
+// Primitives are uploaded from the mapped file, nodes sharing a mesh draw it
+// instanced
+void Game::loadGLBScene(const std::string& filename) {
+  // Placeholders so a missing file renders an empty scene
+  std::vector<std::string> no_textures;
+  _albedo_array = std::make_shared<TextureArray>(no_textures);
+  _normal_array = std::make_shared<TextureArray>(no_textures);
+  _material_array = std::make_shared<TextureArray>(no_textures);
+  GltfModel model(filename);
+  if (model.valid == false) {
+    std::cerr << "Empty scene: " << filename << std::endl;
+    return;
+  }
+  // Units are meters already, the scene is only centered
+  glm::mat4 scene_model = glm::translate(-model.aabb_center);
+  setSceneBounds(glm::vec3(0.0f), model.aabb_halfsize);
+
+  std::vector<std::string> albedo_textures;
+  std::vector<std::string> normal_textures;
+  std::vector<std::string> material_textures;
+  for (const auto& material : model.materials) {
+    albedo_textures.push_back(material.albedo_texname);
+    normal_textures.push_back(material.normal_texname);
+    material_textures.push_back(materialTextureName(
+        material.metallic_texname, material.roughness_texname));
+  }
+  // Extracted albedo is always rgba, only alpha tested materials need BC3
+  bool alpha = false;
+  for (const auto& material : model.materials) {
+    alpha = alpha || material.alpha_mask;
+  }
+  bool compression = _stress.texture_compression;
+  _albedo_array = std::make_shared<TextureArray>(
+      albedo_textures,
+      compression ? (alpha ? BlockFormat::BC3 : BlockFormat::BC1)
+                  : BlockFormat::None,
+      true);
+  _normal_array = std::make_shared<TextureArray>(
+      normal_textures, compression ? BlockFormat::BC5 : BlockFormat::None);
+  _material_array = std::make_shared<TextureArray>(
+      material_textures, compression ? BlockFormat::BC5 : BlockFormat::None);
+  printTextureMemory();
+
+  for (const auto& primitive : model.primitives) {
+    const GltfMaterial& material = model.materials[primitive.material];
+    render::Attrib attrib;
+    attrib.material = material.material;
+    attrib.alpha_mask = material.alpha_mask;
+    attrib.albedo_index =
+        _albedo_array->getTextureIndex(material.albedo_texname);
+    attrib.normal_index =
+        _normal_array->getTextureIndex(material.normal_texname);
+    attrib.material_index = _material_array->getTextureIndex(
+        materialTextureName(material.metallic_texname,
+                            material.roughness_texname));
+    attrib.aabb_center = primitive.aabb_center;
+    attrib.aabb_halfsize = primitive.aabb_halfsize;
+    attrib.vao = std::make_shared<VAO>(
+        primitive.streams, primitive.vertex_count, primitive.indices,
+        primitive.index_count, primitive.index_type);
+    // Tiles of the stress grid are more instances, or copies sharing the
+    // vertex array when instancing is off
+    std::vector<glm::mat4> tiles;
+    for (const glm::vec3& offset : _tiles) {
+      tiles.push_back(glm::translate(offset) * scene_model);
+    }
+    if (_stress.instancing) {
+      std::vector<glm::mat4> transforms;
+      for (const glm::mat4& tile : tiles) {
+        for (const glm::mat4& transform : primitive.transforms) {
+          transforms.push_back(tile * transform);
+        }
+      }
+      tiles = {glm::mat4(1.0f)};
+      if (transforms.size() == 1) {
+        tiles[0] = transforms[0];
+      } else {
+        attrib.instances =
+            std::make_shared<std::vector<glm::mat4>>(transforms);
+      }
+    } else if (primitive.transforms.size() == 1) {
+      for (glm::mat4& tile : tiles) tile = tile * primitive.transforms[0];
+    } else {
+      attrib.instances =
+          std::make_shared<std::vector<glm::mat4>>(primitive.transforms);
+    }
+    if (attrib.instances != nullptr) {
+      attrib.vao->addInstanceTransforms(*attrib.instances);
+    }
+    // Copies hang below their tile node, an instanced attrib below the root
+    for (size_t i = 0; i < tiles.size(); i++) {
+      attrib.model = tiles[i];
+      attrib.node =
+          _stress.instancing
+              ? addAttribNode(_scene_root, tiles[i], attrib)
+              : addAttribNode(_tile_nodes[i],
+                              glm::translate(-_tiles[i]) * tiles[i], attrib);
+      attribs.push_back(attrib);
+    }
   }
 }
 
@@ -83,28 +833,46 @@ Game& Game::operator=(Game const& rhs) {
     _camera = std::make_unique<Camera>(*rhs._camera);
     _albedo_array = std::make_shared<TextureArray>(*rhs._albedo_array);
     _normal_array = std::make_shared<TextureArray>(*rhs._normal_array);
-    _metallic_array = std::make_shared<TextureArray>(*rhs._metallic_array);
-    _roughness_array = std::make_shared<TextureArray>(*rhs._roughness_array);
+    _material_array = std::make_shared<TextureArray>(*rhs._material_array);
+    _virtual_textures = rhs._virtual_textures;
   }
   return (*this);
 }
 
 void Game::update(Env& env) {
+  if (_streamer != nullptr && _streamer->done() == false) {
+    if (_upload_ring != nullptr) _upload_ring->reclaim();
+    _streamer->drain(_stress.upload_budget);
+    if (_streamer->done()) {
+      std::cout << "scene streamed in " << _streamer->elapsedMs() << " ms"
+                << std::endl;
+      if (_upload_ring != nullptr) {
+        UploadRingStats ring = _upload_ring->stats();
+        std::cout << ring.staged_images << " textures, "
+                  << ring.staged_bytes / (1024 * 1024)
+                  << " MiB staged through the upload ring, " << ring.stalls
+                  << " stalls" << std::endl;
+        _upload_ring = nullptr;
+      }
+    }
+  }
+  updateCells();
+  // Tiles spin about their center in alternate directions, only the nodes
+  // below them are recomputed
+  if (_stress.tile_spin != 0.0f) {
+    float angle = glm::radians(_stress.tile_spin) * env.getAbsoluteTime();
+    for (size_t i = 0; i < _tile_nodes.size(); i++) {
+      _scene_graph.setRotation(
+          _tile_nodes[i],
+          glm::angleAxis(i % 2 ? -angle : angle, glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+  }
+  _graph_updates = _scene_graph.update();
   _camera->update(env, env.getDeltaTime());
-  glm::vec3 min_bound = scene_aabb_center - scene_aabb_halfsize;
-  glm::vec3 max_bound = scene_aabb_center + scene_aabb_halfsize;
-  min_bound = glm::vec3(min_bound.x + 3.0f, min_bound.y, min_bound.z + 3.0f);
-  max_bound = glm::vec3(max_bound.x - 3.0f, max_bound.y, max_bound.z - 3.0f);
-  for (int i = 0; i < NUM_LIGHTS; i++) {
-    if (lights.lights[i].position.y > max_bound.y + 3.0f) {
-      lights.lights[i].position =
-          glm::vec3(glm::linearRand(min_bound.x, max_bound.x), min_bound.y,
-                    glm::linearRand(min_bound.z, max_bound.z));
-      lights.lights[i].radius = 2.0f;
-      lights.lights[i].color =
-          glm::vec3(glm::linearRand(0.0f, 1.0f), glm::linearRand(0.0f, 1.0f),
-                    glm::linearRand(0.0f, 1.0f));
-      lights_speed[i] = glm::linearRand(0.5f, 5.0f);
+  float max_height = scene_aabb_center.y + scene_aabb_halfsize.y;
+  for (unsigned int i = 0; i < _stress.lights; i++) {
+    if (lights.lights[i].position.y > max_height + 3.0f) {
+      spawnLight(i);
     } else if (_static_light_mode == false) {
       lights.lights[i].position.y += lights_speed[i] * env.getDeltaTime();
     }
@@ -125,16 +893,27 @@ void Game::update(Env& env) {
     env.inputHandler.keys[GLFW_KEY_E] = false;
     _visibilty_debug_mode = !_visibilty_debug_mode;
   }
+  if (env.inputHandler.keys[GLFW_KEY_C]) {
+    env.inputHandler.keys[GLFW_KEY_C] = false;
+    _cluster_culling_mode = !_cluster_culling_mode;
+  }
+  if (env.inputHandler.keys[GLFW_KEY_L]) {
+    env.inputHandler.keys[GLFW_KEY_L] = false;
+    _lod_mode = !_lod_mode;
+  }
 }
 
 void Game::render(const Env& env, render::Renderer& renderer) {
   float fwidth = static_cast<float>(renderer.getScreenWidth());
   float fheight = static_cast<float>(renderer.getScreenHeight());
   renderer.uniforms.lights = lights;
+  renderer.uniforms.num_lights = static_cast<int>(_stress.lights);
   renderer.uniforms.albedo_array = _albedo_array;
   renderer.uniforms.normal_array = _normal_array;
-  renderer.uniforms.metallic_array = _metallic_array;
-  renderer.uniforms.roughness_array = _roughness_array;
+  renderer.uniforms.material_array = _material_array;
+  renderer.uniforms.virtual_textures = _virtual_textures;
+  renderer.uniforms.batch_materials = _batch_materials;
+  renderer.uniforms.scene_graph = &_scene_graph;
   renderer.uniforms.view = _camera->view;
   renderer.uniforms.proj = _camera->proj;
   renderer.uniforms.inv_proj = glm::inverse(_camera->proj);
@@ -146,12 +925,22 @@ void Game::render(const Env& env, render::Renderer& renderer) {
   renderer.uniforms.debug = _debug_mode ? 1 : 0;
   renderer.uniforms.light_debug = _light_debug_mode ? 1 : 0;
   renderer.uniforms.visibilty_debug = _visibilty_debug_mode ? 1 : 0;
+  renderer.uniforms.cluster_culling = _cluster_culling_mode ? 1 : 0;
+  renderer.uniforms.lod_selection = _lod_mode ? 1 : 0;
 
   for (const auto& attrib : attribs) {
-    renderer.addAttrib(attrib);
+    if (attrib.vao != nullptr) renderer.addAttrib(attrib);
   }
 
   renderer.draw();
+  if (_first_frame) {
+    _first_frame = false;
+    std::cout << "first frame after "
+              << std::chrono::duration<float, std::milli>(
+                     std::chrono::steady_clock::now() - _start_time)
+                     .count()
+              << " ms" << std::endl;
+  }
 
   renderer.flushAttribs();
   if (_debug_mode) {
@@ -183,6 +972,128 @@ void Game::print_debug_info(const Env& env, render::Renderer& renderer,
                           " z: " + float_to_string(camera.pos.z, 2),
                       glm::vec3(1.0f, 1.0f, 1.0f));
   renderer.renderText(10.0f, fheight - 75.0f, 0.35f,
-                      std::to_string(NUM_LIGHTS) + " lights",
+                      std::to_string(_stress.lights) + " lights",
+                      glm::vec3(1.0f, 1.0f, 1.0f));
+  renderer.renderText(
+      10.0f, fheight - 100.0f, 0.35f,
+      "prepass: " +
+          float_to_string(
+              renderer.getPassTime(render::RenderPass::DepthPrepass), 2) +
+          " ms culling: " +
+          float_to_string(
+              renderer.getPassTime(render::RenderPass::LightCulling), 2) +
+          " ms shading: " +
+          float_to_string(renderer.getPassTime(render::RenderPass::Shading),
+                          2) +
+          " ms",
+      glm::vec3(1.0f, 1.0f, 1.0f));
+  renderer.renderText(
+      10.0f, fheight - 125.0f, 0.35f,
+      std::to_string(renderer.stats.triangles_submitted) + " / " +
+          std::to_string(renderer.stats.triangles_total) + " triangles, " +
+          std::to_string(renderer.stats.meshlets_visible) + " / " +
+          std::to_string(renderer.stats.meshlets_total) + " meshlets" +
+          (_cluster_culling_mode ? "" : " (culling off)"),
+      glm::vec3(1.0f, 1.0f, 1.0f));
+  std::string lod_draws = "LOD draws:";
+  for (uint32_t draws : renderer.stats.lod_draws) {
+    lod_draws += " " + std::to_string(draws);
+  }
+  renderer.renderText(10.0f, fheight - 150.0f, 0.35f,
+                      lod_draws + (_lod_mode ? "" : " (LOD off)"),
+                      glm::vec3(1.0f, 1.0f, 1.0f));
+  const render::RenderStats& stats = renderer.stats;
+  float culled_percent =
+      stats.triangles_total > 0
+          ? 100.0f * stats.triangles_chunk_culled / stats.triangles_total
+          : 0.0f;
+  renderer.renderText(10.0f, fheight - 175.0f, 0.35f,
+                      std::to_string(stats.chunks_visible) + " / " +
+                          std::to_string(stats.chunks_total) + " chunks, " +
+                          float_to_string(culled_percent, 1) +
+                          "% triangles culled, " +
+                          std::to_string(stats.draw_calls) + " draws",
                       glm::vec3(1.0f, 1.0f, 1.0f));
+  const CellStats& cells = _cells.stats();
+  if (cells.cells_total > 0) {
+    renderer.renderText(
+        10.0f, fheight - 225.0f, 0.35f,
+        std::to_string(cells.cells_resident) + " / " +
+            std::to_string(cells.cells_total) + " cells, " +
+            std::to_string(cells.resident_bytes / (1024 * 1024)) + " / " +
+            std::to_string(cells.budget_bytes / (1024 * 1024)) + " MiB, " +
+            std::to_string(cells.loads) + " loads, " +
+            std::to_string(cells.evictions) + " evictions",
+        glm::vec3(1.0f, 1.0f, 1.0f));
+  }
+  size_t texture_bytes = 0;
+  size_t uncompressed_bytes = 0;
+  for (const auto& array : {_albedo_array, _normal_array, _material_array}) {
+    texture_bytes += array->gpu_bytes;
+    uncompressed_bytes += array->uncompressed_bytes;
+  }
+  renderer.renderText(10.0f, fheight - 275.0f, 0.35f,
+                      "textures: " +
+                          std::to_string(texture_bytes / (1024 * 1024)) +
+                          " / " +
+                          std::to_string(uncompressed_bytes / (1024 * 1024)) +
+                          " MiB uncompressed",
+                      glm::vec3(1.0f, 1.0f, 1.0f));
+  if (_virtual_textures[0] != nullptr) {
+    size_t resident = 0;
+    size_t slots = 0;
+    size_t loaded = 0;
+    size_t evicted = 0;
+    for (const auto& texture : _virtual_textures) {
+      resident += texture->resident_pages;
+      slots += texture->slot_count;
+      loaded += texture->pages_loaded;
+      evicted += texture->pages_evicted;
+    }
+    renderer.renderText(10.0f, fheight - 300.0f, 0.35f,
+                        "pages: " + std::to_string(resident) + " / " +
+                            std::to_string(slots) + " resident, " +
+                            std::to_string(loaded) + " loaded, " +
+                            std::to_string(evicted) + " evicted",
+                        glm::vec3(1.0f, 1.0f, 1.0f));
+  }
+  const TextureResidencyStats& residency = TextureResidency::shared().stats();
+  renderer.renderText(
+      10.0f, fheight - 325.0f, 0.35f,
+      "texture memory: " +
+          std::to_string(residency.used_bytes / (1024 * 1024)) + " / " +
+          (residency.budget_bytes > 0
+               ? std::to_string(residency.budget_bytes / (1024 * 1024)) +
+                     " MiB"
+               : std::string("no budget")) +
+          ", " + std::to_string(residency.evictions) + " evictions, " +
+          std::to_string(residency.restores) + " restores, " +
+          std::to_string(residency.dropped_levels) + " levels dropped",
+      glm::vec3(1.0f, 1.0f, 1.0f));
+  renderer.renderText(10.0f, fheight - 250.0f, 0.35f,
+                      std::to_string(_scene_graph.size()) + " nodes, " +
+                          std::to_string(_graph_updates) + " updated",
+                      glm::vec3(1.0f, 1.0f, 1.0f));
+  if (_streamer != nullptr) {
+    std::string progress =
+        std::to_string(_streamer->completed()) + " / " +
+        std::to_string(_streamer->total()) + " uploads";
+    renderer.renderText(
+        10.0f, fheight - 200.0f, 0.35f,
+        (_streamer->done() ? "streamed: " : "streaming: ") + progress +
+            " in " + float_to_string(_streamer->elapsedMs(), 0) + " ms",
+        glm::vec3(1.0f, 1.0f, 1.0f));
+  }
+  if (_upload_ring != nullptr) {
+    UploadRingStats ring = _upload_ring->stats();
+    renderer.renderText(
+        10.0f, fheight - 350.0f, 0.35f,
+        "uploads: " + float_to_string(_streamer->drainMs(), 2) + " / " +
+            float_to_string(_stress.upload_budget, 2) + " ms, ring " +
+            std::to_string(ring.used_bytes / (1024 * 1024)) + " / " +
+            std::to_string(ring.capacity_bytes / (1024 * 1024)) + " MiB, " +
+            std::to_string(ring.staged_bytes / (1024 * 1024)) +
+            " MiB staged, " + std::to_string(ring.stalls) + " stalls",
+        glm::vec3(1.0f, 1.0f, 1.0f));
+  }
 }
@@ -1,14 +1,56 @@
 #pragma once
+#include <array>
 #include <iomanip>
+#include <map>
 #include <memory>
+#include <random>
+#include <set>
+#include "asset_streamer.hpp"
+#include "block_compression.hpp"
 #include "camera.hpp"
 #include "forward.hpp"
+#include "gltf.hpp"
+#include "mesh_cache.hpp"
 #include "model.hpp"
+#include "package.hpp"
 #include "renderer.hpp"
+#include "scene_cells.hpp"
+#include "scene_graph.hpp"
+#include "stress_scene.hpp"
+#include "thread_pool.hpp"
+#include "vertex_packing.hpp"
+#include "virtual_texture.hpp"
+
+// Opaque meshes are batched up to this many triangles, smaller batches show
+// up sooner while streaming
+#define STATIC_BATCH_MAX_TRIANGLES 65536
+
+// Albedo, normal and the material texture packing metallic and roughness
+typedef std::array<std::string, 3> TextureNames;
+
+// Attrib built off the render thread, kept on the CPU so Game can recreate
+// its vertex array whenever its cell becomes resident again
+struct SceneMesh {
+  render::Attrib attrib;
+  TextureNames textures;
+  size_t cell = 0;  // in the untiled scene, batches never span two cells
+#if PACKED_VERTICES
+  std::vector<PackedVertex> vertices;
+#else
+  std::vector<Vertex> vertices;
+#endif
+  std::vector<unsigned int> indices;
+  // Static batches only, the material table as of this batch
+  std::vector<uint16_t> material_ids;
+  std::vector<BatchMaterial> batch_materials;
+  std::vector<TextureNames> batch_textures;
+};
 
 class Game {
  public:
   Game(void);
+  Game(const std::string& scene_filename);
+  Game(const StressScene& stress);
   Game(Game const& src);
   ~Game(void);
   Game& operator=(Game const& rhs);
@@ -20,20 +62,76 @@ class Game {
   bool _light_debug_mode = false;
   bool _visibilty_debug_mode = false;
   bool _static_light_mode = false;
+  bool _cluster_culling_mode = true;
+  bool _lod_mode = true;
   std::unique_ptr<Camera> _camera;
   Lights lights;
-  float lights_speed[NUM_LIGHTS] = {};
+  float lights_speed[MAX_LIGHTS_PER_TILE] = {};
+  StressScene _stress;
+  std::mt19937 _rng;
+  std::vector<glm::vec3> _tiles;  // offsets of the copies of the scene
+  // Attribs with a node draw with its world matrix, tile nodes sit below the
+  // root at the tile offsets
+  SceneGraph _scene_graph;
+  SceneGraph::NodeId _scene_root = SCENE_NODE_NONE;
+  std::vector<SceneGraph::NodeId> _tile_nodes;
+  size_t _graph_updates = 0;
 
   std::shared_ptr<TextureArray> _albedo_array;
   std::shared_ptr<TextureArray> _normal_array;
-  std::shared_ptr<TextureArray> _metallic_array;
-  std::shared_ptr<TextureArray> _roughness_array;
+  std::shared_ptr<TextureArray> _material_array;  // metallic and roughness
+  // Streamed obj scenes with virtual texturing, replace the arrays
+  std::array<std::shared_ptr<VirtualTexture>, 3> _virtual_textures;
+  std::shared_ptr<const std::vector<BatchMaterial>> _batch_materials;
 
-  glm::vec3 scene_aabb_center;
-  glm::vec3 scene_aabb_halfsize;
+  glm::vec3 scene_aabb_center = glm::vec3(0.0f);
+  glm::vec3 scene_aabb_halfsize = glm::vec3(0.0f);
 
+  // Attribs of evicted cells have no vertex array and are not drawn
   std::vector<render::Attrib> attribs;
+  std::vector<std::shared_ptr<const SceneMesh>> _scene_meshes;
+  CellGrid _cell_grid;
+  SceneCells _cells;
+  std::vector<size_t> _cell_evictions;
+  std::vector<size_t> _cell_loads;
+  // Texture names of the attribs and of the batch material table, indices
+  // are resolved as layers become resident
+  std::vector<TextureNames> _attrib_textures;
+  // Attribs using each texture, the only ones resolved again on its upload
+  std::map<std::string, std::vector<size_t>> _texture_attribs;
+  std::vector<BatchMaterial> _batch_material_table;
+  std::vector<TextureNames> _batch_material_textures;
+
+  std::chrono::steady_clock::time_point _start_time;
+  bool _first_frame = true;
 
+  void loadOBJScene(const std::string& filename);
+  void loadGLBScene(const std::string& filename);
+  void loadPackageScene(const std::string& filename);
+  // Runs on the loader thread, Game is only touched by the uploads it pushes
+  void streamOBJScene(AssetStreamer& streamer, const std::string& filename);
+  bool stageTexture(AssetStreamer& streamer, const std::string& name,
+                    BlockFormat format, bool srgb, size_t array);
+  void addSceneMesh(const std::shared_ptr<const SceneMesh>& mesh);
+  void addCellAttrib(const std::shared_ptr<const SceneMesh>& mesh,
+                     render::Attrib attrib, size_t cell);
+  SceneGraph::NodeId addAttribNode(SceneGraph::NodeId parent,
+                                   const glm::mat4& local,
+                                   const render::Attrib& attrib);
+  void updateCells();
+  glm::ivec4 resolveTextures(const TextureNames& textures) const;
+  void resolveAttribTextures(size_t attrib);
+  void resolveBatchMaterials();
+  void textureUploaded(const std::string& name);
+  void printTextureMemory() const;
+  void setSceneBounds(const glm::vec3& aabb_center,
+                      const glm::vec3& aabb_halfsize);
+  void spawnLight(unsigned int i);
   void print_debug_info(const Env& env, render::Renderer& renderer,
                         Camera& camera);
+
+  // Staging memory of the streamed textures, freed once streaming is done
+  std::unique_ptr<UploadRing> _upload_ring;
+  // Last so the loader is joined before anything it uploads to goes away
+  std::unique_ptr<AssetStreamer> _streamer;
 };
@@ -0,0 +1,776 @@
+#include "gltf.hpp"
+#include <stb_image.h>
+
+#define GLB_MAGIC 0x46546C67       // "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A  // "JSON"
+#define GLB_CHUNK_BIN 0x004E4942   // "BIN\0"
+
+enum class TextureSlot { Albedo, Normal, Metallic, Roughness, Count };
+
+static uint32_t readU32(const unsigned char* data) {
+  uint32_t value = 0;
+  std::memcpy(&value, data, sizeof(value));
+  return (value);
+}
+
+static size_t componentSize(GLenum component_type) {
+  switch (component_type) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+      return (1);
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+      return (2);
+    default:
+      return (4);
+  }
+}
+
+size_t GltfAccessor::elementSize() const {
+  return (componentSize(component_type) * components);
+}
+
+size_t GltfAccessor::byteStride() const {
+  return (stride > 0 ? static_cast<size_t>(stride) : elementSize());
+}
+
+// Accessor elements as floats, normalized integers are mapped to [0, 1] or
+// [-1, 1] the way the vertex fetch would
+static std::vector<float> readFloats(const GltfAccessor& accessor) {
+  std::vector<float> values(accessor.count * accessor.components);
+  size_t stride = accessor.byteStride();
+  for (uint32_t i = 0; i < accessor.count; i++) {
+    const unsigned char* element =
+        accessor.view + accessor.offset + i * stride;
+    for (GLint c = 0; c < accessor.components; c++) {
+      float value = 0.0f;
+      switch (accessor.component_type) {
+        case GL_BYTE: {
+          int8_t v = static_cast<int8_t>(element[c]);
+          value = accessor.normalized ? std::max(v / 127.0f, -1.0f) : v;
+          break;
+        }
+        case GL_UNSIGNED_BYTE:
+          value = accessor.normalized ? element[c] / 255.0f : element[c];
+          break;
+        case GL_SHORT: {
+          int16_t v;
+          std::memcpy(&v, element + c * 2, sizeof(v));
+          value = accessor.normalized ? std::max(v / 32767.0f, -1.0f) : v;
+          break;
+        }
+        case GL_UNSIGNED_SHORT: {
+          uint16_t v;
+          std::memcpy(&v, element + c * 2, sizeof(v));
+          value = accessor.normalized ? v / 65535.0f : v;
+          break;
+        }
+        case GL_UNSIGNED_INT: {
+          uint32_t v;
+          std::memcpy(&v, element + c * 4, sizeof(v));
+          value = static_cast<float>(v);
+          break;
+        }
+        default:
+          std::memcpy(&value, element + c * 4, sizeof(value));
+          break;
+      }
+      values[i * accessor.components + c] = value;
+    }
+  }
+  return (values);
+}
+
+static std::vector<uint32_t> readIndices(const GltfAccessor& accessor) {
+  std::vector<uint32_t> indices(accessor.count);
+  size_t stride = accessor.byteStride();
+  for (uint32_t i = 0; i < accessor.count; i++) {
+    const unsigned char* element =
+        accessor.view + accessor.offset + i * stride;
+    if (accessor.component_type == GL_UNSIGNED_BYTE) {
+      indices[i] = element[0];
+    } else if (accessor.component_type == GL_UNSIGNED_SHORT) {
+      uint16_t index;
+      std::memcpy(&index, element, sizeof(index));
+      indices[i] = index;
+    } else {
+      std::memcpy(&indices[i], element, sizeof(uint32_t));
+    }
+  }
+  return (indices);
+}
+
+static glm::vec3 readVec3(const std::vector<float>& values, uint32_t i) {
+  return (glm::vec3(values[i * 3 + 0], values[i * 3 + 1], values[i * 3 + 2]));
+}
+
+static std::vector<float> generateNormals(const std::vector<float>& positions,
+                                          const std::vector<uint32_t>& indices,
+                                          uint32_t vertex_count) {
+  std::vector<glm::vec3> accumulated(vertex_count, glm::vec3(0.0f));
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    glm::vec3 p0 = readVec3(positions, indices[i + 0]);
+    glm::vec3 p1 = readVec3(positions, indices[i + 1]);
+    glm::vec3 p2 = readVec3(positions, indices[i + 2]);
+    // Area weighted face normal
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    for (size_t c = 0; c < 3; c++) accumulated[indices[i + c]] += normal;
+  }
+  std::vector<float> normals(vertex_count * 3);
+  for (uint32_t v = 0; v < vertex_count; v++) {
+    float length = glm::length(accumulated[v]);
+    glm::vec3 normal = length > 0.0f ? accumulated[v] / length
+                                     : glm::vec3(0.0f, 1.0f, 0.0f);
+    normals[v * 3 + 0] = normal.x;
+    normals[v * 3 + 1] = normal.y;
+    normals[v * 3 + 2] = normal.z;
+  }
+  return (normals);
+}
+
+// Per vertex tangent and bitangent sign from the uv gradients, v is flipped
+// since gltf uvs start at the top of the image
+static std::vector<float> generateTangents(const std::vector<float>& positions,
+                                           const std::vector<float>& normals,
+                                           const std::vector<float>& uvs,
+                                           const std::vector<uint32_t>& indices,
+                                           uint32_t vertex_count) {
+  std::vector<glm::vec3> tangents(vertex_count, glm::vec3(0.0f));
+  std::vector<glm::vec3> bitangents(vertex_count, glm::vec3(0.0f));
+  for (size_t i = 0; uvs.empty() == false && i + 2 < indices.size(); i += 3) {
+    uint32_t i0 = indices[i + 0];
+    uint32_t i1 = indices[i + 1];
+    uint32_t i2 = indices[i + 2];
+    glm::vec3 p0 = readVec3(positions, i0);
+    glm::vec3 edge1 = readVec3(positions, i1) - p0;
+    glm::vec3 edge2 = readVec3(positions, i2) - p0;
+    glm::vec2 uv0(uvs[i0 * 2], -uvs[i0 * 2 + 1]);
+    glm::vec2 delta1 = glm::vec2(uvs[i1 * 2], -uvs[i1 * 2 + 1]) - uv0;
+    glm::vec2 delta2 = glm::vec2(uvs[i2 * 2], -uvs[i2 * 2 + 1]) - uv0;
+    float det = delta1.x * delta2.y - delta2.x * delta1.y;
+    if (std::abs(det) < 1e-12f) continue;
+    glm::vec3 tangent = (edge1 * delta2.y - edge2 * delta1.y) / det;
+    glm::vec3 bitangent = (edge2 * delta1.x - edge1 * delta2.x) / det;
+    for (uint32_t v : {i0, i1, i2}) {
+      tangents[v] += tangent;
+      bitangents[v] += bitangent;
+    }
+  }
+  std::vector<float> result(vertex_count * 4);
+  for (uint32_t v = 0; v < vertex_count; v++) {
+    glm::vec3 normal = readVec3(normals, v);
+    glm::vec3 tangent = tangents[v] - normal * glm::dot(normal, tangents[v]);
+    float length = glm::length(tangent);
+    tangent = length > 1e-12f ? tangent / length : perpendicular(normal);
+    float sign =
+        glm::dot(glm::cross(normal, tangent), bitangents[v]) < 0.0f ? -1.0f
+                                                                    : 1.0f;
+    result[v * 4 + 0] = tangent.x;
+    result[v * 4 + 1] = tangent.y;
+    result[v * 4 + 2] = tangent.z;
+    result[v * 4 + 3] = sign;
+  }
+  return (result);
+}
+
+static glm::mat4 nodeTransform(const json::Value& node) {
+  const json::Value& matrix = node["matrix"];
+  if (matrix.size() == 16) {
+    glm::mat4 transform(1.0f);
+    float* values = glm::value_ptr(transform);
+    for (size_t i = 0; i < 16; i++) {
+      values[i] = static_cast<float>(matrix[i].asNumber());
+    }
+    return (transform);
+  }
+  glm::mat4 transform(1.0f);
+  const json::Value& translation = node["translation"];
+  if (translation.size() == 3) {
+    transform = glm::translate(glm::vec3(translation[0].asNumber(),
+                                         translation[1].asNumber(),
+                                         translation[2].asNumber()));
+  }
+  const json::Value& rotation = node["rotation"];
+  if (rotation.size() == 4) {
+    glm::quat q(static_cast<float>(rotation[3].asNumber(1.0)),
+                static_cast<float>(rotation[0].asNumber()),
+                static_cast<float>(rotation[1].asNumber()),
+                static_cast<float>(rotation[2].asNumber()));
+    transform = transform * glm::mat4_cast(q);
+  }
+  const json::Value& scale = node["scale"];
+  if (scale.size() == 3) {
+    transform = transform * glm::scale(glm::vec3(scale[0].asNumber(1.0),
+                                                 scale[1].asNumber(1.0),
+                                                 scale[2].asNumber(1.0)));
+  }
+  return (transform);
+}
+
+// Bottom-left origin so that the vertical flip of TextureArray on load
+// restores the top-down gltf layout
+static bool writeTGA(const std::string& filename, const unsigned char* pixels,
+                     int width, int height, int channels) {
+  unsigned char header[18] = {};
+  header[2] = channels == 1 ? 3 : 2;
+  header[12] = width & 0xFF;
+  header[13] = (width >> 8) & 0xFF;
+  header[14] = height & 0xFF;
+  header[15] = (height >> 8) & 0xFF;
+  header[16] = static_cast<unsigned char>(channels * 8);
+  header[17] = channels == 4 ? 8 : 0;
+  std::vector<unsigned char> data(pixels,
+                                  pixels + size_t(width) * height * channels);
+  for (size_t i = 0; channels == 4 && i < data.size(); i += 4) {
+    std::swap(data[i + 0], data[i + 2]);
+  }
+  std::ofstream file(filename, std::ios::binary);
+  if (!file) return (false);
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+  return (file.good());
+}
+
+static std::string texturePath(const std::string& directory, uint64_t hash) {
+  std::ostringstream path;
+  path << directory << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << hash << ".tga";
+  return (path.str());
+}
+
+// Decode an image into the layout its slot expects: rgba albedo scaled by
+// the base color factor, rgba normals, single channel metallic (blue) and
+// roughness (green) scaled by their factors
+static std::string extractTexture(const std::string& directory,
+                                  const unsigned char* data, size_t size,
+                                  TextureSlot slot, const glm::vec4& factor,
+                                  glm::ivec2& slot_size) {
+  uint64_t seed = static_cast<uint64_t>(slot);
+  seed = io::hash(&factor, sizeof(factor), seed);
+  std::string path = texturePath(directory, io::hash(data, size, seed));
+  int width, height, channels;
+  if (io::exists(path)) {
+    if (slot_size.x == 0 && stbi_info_from_memory(data, static_cast<int>(size),
+                                                  &width, &height, &channels)) {
+      slot_size = glm::ivec2(width, height);
+    }
+    return (path);
+  }
+
+  stbi_uc* pixels = stbi_load_from_memory(data, static_cast<int>(size), &width,
+                                          &height, &channels, 4);
+  if (pixels == nullptr) {
+    std::cerr << "Unable to decode gltf image: " << stbi_failure_reason()
+              << std::endl;
+    return ("");
+  }
+  if (slot_size.x == 0) slot_size = glm::ivec2(width, height);
+  size_t pixel_count = size_t(width) * height;
+  std::vector<unsigned char> out;
+  if (slot == TextureSlot::Albedo || slot == TextureSlot::Normal) {
+    out.assign(pixels, pixels + pixel_count * 4);
+    for (size_t i = 0; slot == TextureSlot::Albedo && i < out.size(); i++) {
+      out[i] = static_cast<unsigned char>(out[i] * factor[i % 4] + 0.5f);
+    }
+  } else {
+    size_t channel = slot == TextureSlot::Metallic ? 2 : 1;
+    out.resize(pixel_count);
+    for (size_t i = 0; i < pixel_count; i++) {
+      out[i] = static_cast<unsigned char>(
+          pixels[i * 4 + channel] * factor.x + 0.5f);
+    }
+  }
+  stbi_image_free(pixels);
+  int out_channels = static_cast<int>(out.size() / pixel_count);
+  // Decoded bottom-up, the file keeps the top row first
+  size_t row_size = size_t(width) * out_channels;
+  for (int y = 0; y < height / 2; y++) {
+    std::swap_ranges(out.begin() + y * row_size,
+                     out.begin() + (y + 1) * row_size,
+                     out.begin() + (height - 1 - y) * row_size);
+  }
+  if (writeTGA(path, out.data(), width, height, out_channels) == false) {
+    std::cerr << "Unable to write " << path << std::endl;
+    return ("");
+  }
+  return (path);
+}
+
+// Constant texture for a material without image in this slot, sized like
+// the other layers of the slot texture array
+static std::string solidTexture(const std::string& directory, TextureSlot slot,
+                                const glm::vec4& value, glm::ivec2 size) {
+  if (size.x == 0) size = glm::ivec2(4, 4);
+  int channels =
+      slot == TextureSlot::Albedo || slot == TextureSlot::Normal ? 4 : 1;
+  unsigned char texel[4];
+  for (int c = 0; c < 4; c++) {
+    texel[c] = static_cast<unsigned char>(
+        glm::clamp(value[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+  }
+  uint64_t seed = static_cast<uint64_t>(TextureSlot::Count) +
+                  static_cast<uint64_t>(slot);
+  seed = io::hash(&size, sizeof(size), seed);
+  std::string path = texturePath(directory, io::hash(texel, channels, seed));
+  if (io::exists(path)) return (path);
+  std::vector<unsigned char> pixels(size_t(size.x) * size.y * channels);
+  for (size_t i = 0; i < pixels.size(); i++) {
+    pixels[i] = texel[i % channels];
+  }
+  if (writeTGA(path, pixels.data(), size.x, size.y, channels) == false) {
+    std::cerr << "Unable to write " << path << std::endl;
+    return ("");
+  }
+  return (path);
+}
+
+GltfModel::GltfModel(const std::string& filename) : _filename(filename) {
+  auto start = std::chrono::high_resolution_clock::now();
+  _file = std::make_unique<io::MappedFile>(filename);
+  if (_file->data == nullptr) {
+    std::cerr << "Unable to open " << filename << std::endl;
+    return;
+  }
+  if (parseContainer() == false) {
+    std::cerr << "Invalid glb file: " << filename << std::endl;
+    return;
+  }
+  const json::Value& required = _document["extensionsRequired"];
+  for (size_t i = 0; i < required.size(); i++) {
+    if (required[i].asString() != "KHR_mesh_quantization") {
+      std::cerr << filename << ": unsupported extension "
+                << required[i].asString() << std::endl;
+    }
+  }
+  loadMaterials();
+  loadScene();
+
+  glm::vec3 bounds_min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 bounds_max = glm::vec3(-std::numeric_limits<float>::max());
+  for (const auto& primitive : primitives) {
+    for (const auto& transform : primitive.transforms) {
+      glm::vec3 center = primitive.aabb_center;
+      glm::vec3 halfsize = primitive.aabb_halfsize;
+      transformAABB(transform, center, halfsize);
+      bounds_min = glm::min(bounds_min, center - halfsize);
+      bounds_max = glm::max(bounds_max, center + halfsize);
+    }
+  }
+  if (primitives.empty()) bounds_min = bounds_max = glm::vec3(0.0f);
+  aabb_center = (bounds_min + bounds_max) * 0.5f;
+  aabb_halfsize = (bounds_max - bounds_min) * 0.5f;
+  valid = primitives.empty() == false;
+
+  size_t generated = 0;
+  for (const auto& data : _storage) generated += data->size();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "Loaded " << filename << ": " << primitives.size()
+            << " primitives, " << materials.size() << " materials, "
+            << generated << " bytes generated in "
+            << std::chrono::duration<double, std::milli>(end - start).count()
+            << " ms" << std::endl;
+}
+
+GltfModel::~GltfModel() {}
+
+bool GltfModel::parseContainer() {
+  const unsigned char* data = _file->data;
+  size_t size = _file->size;
+  if (size < 20 || readU32(data) != GLB_MAGIC || readU32(data + 4) != 2) {
+    return (false);
+  }
+  size = std::min<size_t>(size, readU32(data + 8));
+  // JSON chunk first, then an optional binary chunk
+  size_t offset = 12;
+  bool has_json = false;
+  while (offset + 8 <= size) {
+    size_t length = readU32(data + offset);
+    uint32_t type = readU32(data + offset + 4);
+    const unsigned char* chunk = data + offset + 8;
+    if (length > size - offset - 8) return (false);
+    if (type == GLB_CHUNK_JSON && has_json == false) {
+      const char* text = reinterpret_cast<const char*>(chunk);
+      if (json::parse(text, text + length, _document) == false) {
+        return (false);
+      }
+      has_json = true;
+    } else if (type == GLB_CHUNK_BIN && _bin == nullptr) {
+      _bin = chunk;
+      _bin_size = length;
+    }
+    offset += 8 + ((length + 3) & ~size_t(3));
+  }
+  return (has_json && _document.type == json::Type::Object);
+}
+
+bool GltfModel::getAccessor(const json::Value& index,
+                            GltfAccessor& accessor) const {
+  const json::Value& object =
+      _document["accessors"][static_cast<size_t>(index.asInt(-1))];
+  if (object.isNull()) return (false);
+  if (object["sparse"].isNull() == false) {
+    std::cerr << _filename << ": sparse accessors are not supported"
+              << std::endl;
+    return (false);
+  }
+  const json::Value& view =
+      _document["bufferViews"][static_cast<size_t>(
+          object["bufferView"].asInt(-1))];
+  // Only the binary chunk, which is the first buffer without uri
+  if (view.isNull() || view["buffer"].asInt() != 0 || _bin == nullptr ||
+      _document["buffers"][0]["uri"].isNull() == false) {
+    return (false);
+  }
+  static const std::pair<const char*, GLint> types[] = {
+      {"SCALAR", 1}, {"VEC2", 2}, {"VEC3", 3}, {"VEC4", 4}};
+  accessor.components = 0;
+  for (const auto& type : types) {
+    if (object["type"].asString() == type.first) {
+      accessor.components = type.second;
+    }
+  }
+  accessor.component_type =
+      static_cast<GLenum>(object["componentType"].asInt());
+  accessor.normalized = object["normalized"].boolean ? GL_TRUE : GL_FALSE;
+  accessor.count = static_cast<uint32_t>(object["count"].asNumber());
+  accessor.offset = static_cast<size_t>(object["byteOffset"].asNumber());
+  accessor.stride = static_cast<GLsizei>(view["byteStride"].asInt());
+  size_t view_offset = static_cast<size_t>(view["byteOffset"].asNumber());
+  accessor.view_size = static_cast<size_t>(view["byteLength"].asNumber());
+  if (accessor.components == 0 || accessor.count == 0 ||
+      view_offset > _bin_size || accessor.view_size > _bin_size - view_offset) {
+    return (false);
+  }
+  accessor.view = _bin + view_offset;
+  size_t span =
+      (accessor.count - 1) * accessor.byteStride() + accessor.elementSize();
+  return (accessor.offset <= accessor.view_size &&
+          span <= accessor.view_size - accessor.offset);
+}
+
+const void* GltfModel::store(const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  _storage.push_back(
+      std::make_unique<std::vector<unsigned char>>(bytes, bytes + size));
+  return (_storage.back()->data());
+}
+
+// Scene hierarchy, meshes referenced by several nodes are loaded once and
+// get a transform per node
+void GltfModel::loadScene() {
+  const json::Value& nodes = _document["nodes"];
+  std::vector<size_t> roots;
+  const json::Value& scene =
+      _document["scenes"][static_cast<size_t>(_document["scene"].asInt())];
+  if (scene.isNull() == false) {
+    for (size_t i = 0; i < scene["nodes"].size(); i++) {
+      roots.push_back(static_cast<size_t>(scene["nodes"][i].asInt()));
+    }
+  } else {
+    std::vector<bool> is_child(nodes.size(), false);
+    for (size_t n = 0; n < nodes.size(); n++) {
+      const json::Value& children = nodes[n]["children"];
+      for (size_t c = 0; c < children.size(); c++) {
+        size_t child = static_cast<size_t>(children[c].asInt());
+        if (child < is_child.size()) is_child[child] = true;
+      }
+    }
+    for (size_t n = 0; n < nodes.size(); n++) {
+      if (is_child[n] == false) roots.push_back(n);
+    }
+  }
+
+  const json::Value& meshes = _document["meshes"];
+  std::vector<std::vector<size_t>> mesh_primitives(meshes.size());
+  std::vector<bool> mesh_loaded(meshes.size(), false);
+  std::vector<bool> visited(nodes.size(), false);
+  std::vector<std::pair<size_t, glm::mat4>> stack;
+  for (auto it = roots.rbegin(); it != roots.rend(); it++) {
+    stack.emplace_back(*it, glm::mat4(1.0f));
+  }
+  while (stack.empty() == false) {
+    size_t n = stack.back().first;
+    glm::mat4 parent = stack.back().second;
+    stack.pop_back();
+    if (n >= nodes.size() || visited[n]) continue;
+    visited[n] = true;
+    const json::Value& node = nodes[n];
+    glm::mat4 transform = parent * nodeTransform(node);
+
+    size_t m = static_cast<size_t>(node["mesh"].asInt(-1));
+    if (m < meshes.size()) {
+      if (mesh_loaded[m] == false) {
+        mesh_loaded[m] = true;
+        const json::Value& mesh_primitive_list = meshes[m]["primitives"];
+        for (size_t p = 0; p < mesh_primitive_list.size(); p++) {
+          size_t count = primitives.size();
+          loadPrimitive(mesh_primitive_list[p], transform);
+          if (primitives.size() > count) mesh_primitives[m].push_back(count);
+        }
+      } else {
+        for (size_t p : mesh_primitives[m]) {
+          primitives[p].transforms.push_back(transform);
+        }
+      }
+    }
+    const json::Value& children = node["children"];
+    for (size_t c = children.size(); c > 0; c--) {
+      stack.emplace_back(static_cast<size_t>(children[c - 1].asInt()),
+                         transform);
+    }
+  }
+}
+
+void GltfModel::loadPrimitive(const json::Value& object,
+                              const glm::mat4& transform) {
+  if (object["mode"].asInt(4) != 4) {
+    std::cerr << _filename << ": skipping non triangle primitive" << std::endl;
+    return;
+  }
+  const json::Value& attributes = object["attributes"];
+  GltfAccessor positions;
+  if (getAccessor(attributes["POSITION"], positions) == false ||
+      positions.components != 3) {
+    std::cerr << _filename << ": skipping primitive without positions"
+              << std::endl;
+    return;
+  }
+  GltfPrimitive primitive;
+  primitive.vertex_count = static_cast<GLsizei>(positions.count);
+  primitive.transforms.push_back(transform);
+  size_t material = static_cast<size_t>(object["material"].asInt(-1));
+  primitive.material = std::min(material, materials.size() - 1);
+
+  auto addStream = [&primitive](GLuint location, const GltfAccessor& view) {
+    VertexStream stream;
+    stream.location = location;
+    stream.components = view.components;
+    stream.type = view.component_type;
+    stream.normalized = view.normalized;
+    stream.stride = static_cast<GLsizei>(view.byteStride());
+    stream.offset = view.offset;
+    stream.data = view.view;
+    stream.size = view.view_size;
+    primitive.streams.push_back(stream);
+  };
+  auto addGenerated = [this, &primitive](GLuint location, GLint components,
+                                         const std::vector<float>& values) {
+    VertexStream stream;
+    stream.location = location;
+    stream.components = components;
+    stream.size = values.size() * sizeof(float);
+    stream.data = store(values.data(), stream.size);
+    primitive.streams.push_back(stream);
+  };
+  addStream(0, positions);
+
+  // Indices are uploaded in place unless they are bytes, which the culling
+  // ranges do not handle
+  GltfAccessor indices;
+  std::vector<uint32_t> index_values;
+  bool indexed = getAccessor(object["indices"], indices) &&
+                 indices.components == 1;
+  if (indexed && indices.component_type != GL_UNSIGNED_BYTE &&
+      indices.byteStride() == indices.elementSize()) {
+    primitive.indices = indices.view + indices.offset;
+    primitive.index_type = indices.component_type;
+    primitive.index_count = static_cast<GLsizei>(indices.count);
+  } else {
+    if (indexed) {
+      index_values = readIndices(indices);
+    } else {
+      index_values.resize(positions.count);
+      for (uint32_t i = 0; i < positions.count; i++) index_values[i] = i;
+    }
+    primitive.indices =
+        store(index_values.data(), index_values.size() * sizeof(uint32_t));
+    primitive.index_type = GL_UNSIGNED_INT;
+    primitive.index_count = static_cast<GLsizei>(index_values.size());
+  }
+  primitive.index_count -= primitive.index_count % 3;
+
+  GltfAccessor normals, uvs, tangents;
+  bool has_normals = getAccessor(attributes["NORMAL"], normals) &&
+                     normals.components == 3 &&
+                     normals.count == positions.count;
+  bool has_uvs = getAccessor(attributes["TEXCOORD_0"], uvs) &&
+                 uvs.components == 2 && uvs.count == positions.count;
+  bool has_tangents = getAccessor(attributes["TANGENT"], tangents) &&
+                      tangents.components == 4 &&
+                      tangents.count == positions.count;
+  if (has_uvs) addStream(2, uvs);
+
+  std::vector<float> position_values;
+  const json::Value& min = _document["accessors"][static_cast<size_t>(
+      attributes["POSITION"].asInt())]["min"];
+  const json::Value& max = _document["accessors"][static_cast<size_t>(
+      attributes["POSITION"].asInt())]["max"];
+  if (has_normals == false || has_tangents == false ||
+      positions.component_type != GL_FLOAT || min.size() != 3 ||
+      max.size() != 3) {
+    position_values = readFloats(positions);
+  }
+  if (has_normals == false || has_tangents == false) {
+    if (index_values.empty()) index_values = readIndices(indices);
+    index_values.resize(primitive.index_count);
+    for (auto& index : index_values) {
+      if (index >= positions.count) index = 0;
+    }
+  }
+  std::vector<float> normal_values;
+  if (has_normals) {
+    addStream(1, normals);
+  } else {
+    normal_values =
+        generateNormals(position_values, index_values, positions.count);
+    addGenerated(1, 3, normal_values);
+  }
+  if (has_tangents) {
+    addStream(3, tangents);
+  } else {
+    if (has_normals) normal_values = readFloats(normals);
+    std::vector<float> uv_values;
+    if (has_uvs) uv_values = readFloats(uvs);
+    addGenerated(3, 4,
+                 generateTangents(position_values, normal_values, uv_values,
+                                  index_values, positions.count));
+  }
+
+  glm::vec3 bounds_min, bounds_max;
+  if (position_values.empty()) {
+    for (int c = 0; c < 3; c++) {
+      bounds_min[c] = static_cast<float>(min[c].asNumber());
+      bounds_max[c] = static_cast<float>(max[c].asNumber());
+    }
+  } else {
+    bounds_min = glm::vec3(std::numeric_limits<float>::max());
+    bounds_max = glm::vec3(-std::numeric_limits<float>::max());
+    for (uint32_t v = 0; v < positions.count; v++) {
+      bounds_min = glm::min(bounds_min, readVec3(position_values, v));
+      bounds_max = glm::max(bounds_max, readVec3(position_values, v));
+    }
+  }
+  primitive.aabb_center = (bounds_min + bounds_max) * 0.5f;
+  primitive.aabb_halfsize = (bounds_max - bounds_min) * 0.5f;
+  primitives.push_back(std::move(primitive));
+}
+
+// Metallic-roughness materials, images are split per texture array and
+// baked with the material factors
+void GltfModel::loadMaterials() {
+  std::string directory = _filename + GLTF_TEXTURE_DIRECTORY;
+  if (io::exists(directory) == false) io::makedir(directory);
+  std::string basedir = getBaseDir(_filename);
+  if (basedir.empty() == false) basedir += "/";
+
+  // Encoded image bytes, from the binary chunk or an external file
+  std::vector<std::vector<unsigned char>> external_images;
+  auto imageData = [&](const json::Value& texture, size_t& size)
+      -> const unsigned char* {
+    const json::Value& image = _document["images"][static_cast<size_t>(
+        texture["source"].asInt(-1))];
+    const json::Value& buffer_view =
+        _document["bufferViews"][static_cast<size_t>(
+            image["bufferView"].asInt(-1))];
+    if (buffer_view.isNull() == false && _bin != nullptr) {
+      size_t offset = static_cast<size_t>(buffer_view["byteOffset"].asNumber());
+      size = static_cast<size_t>(buffer_view["byteLength"].asNumber());
+      if (offset > _bin_size || size > _bin_size - offset) return (nullptr);
+      return (_bin + offset);
+    }
+    std::string uri = image["uri"].asString();
+    if (uri.empty() || uri.compare(0, 5, "data:") == 0) {
+      if (image.isNull() == false) {
+        std::cerr << _filename << ": unsupported image source" << std::endl;
+      }
+      return (nullptr);
+    }
+    std::ifstream file(sanitizeFilename(basedir + uri), std::ios::binary);
+    if (!file) return (nullptr);
+    external_images.emplace_back((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+    size = external_images.back().size();
+    return (external_images.back().data());
+  };
+
+  const json::Value& objects = _document["materials"];
+  materials.resize(objects.size() + 1);
+  glm::ivec2 slot_sizes[static_cast<int>(TextureSlot::Count)] = {};
+  std::vector<glm::vec4> base_colors(materials.size(), glm::vec4(1.0f));
+  std::vector<glm::vec2> metallic_roughness(materials.size(), glm::vec2(1.0f));
+  for (size_t m = 0; m < objects.size(); m++) {
+    const json::Value& object = objects[m];
+    const json::Value& pbr = object["pbrMetallicRoughness"];
+    GltfMaterial& material = materials[m];
+    for (int c = 0; c < 4 && pbr["baseColorFactor"].size() == 4; c++) {
+      base_colors[m][c] =
+          static_cast<float>(pbr["baseColorFactor"][c].asNumber());
+    }
+    metallic_roughness[m] =
+        glm::vec2(pbr["metallicFactor"].asNumber(1.0),
+                  pbr["roughnessFactor"].asNumber(1.0));
+    material.material.diffuse = base_colors[m];
+    material.material.opacity = base_colors[m].a;
+    material.material.metallic = metallic_roughness[m].x;
+    material.material.roughness = metallic_roughness[m].y;
+    for (int c = 0; c < 3 && object["emissiveFactor"].size() == 3; c++) {
+      material.material.emission[c] =
+          static_cast<float>(object["emissiveFactor"][c].asNumber());
+    }
+    std::string alpha_mode = object["alphaMode"].asString("OPAQUE");
+    material.alpha_mask = alpha_mode == "MASK" || alpha_mode == "BLEND";
+
+    const json::Value& textures = _document["textures"];
+    size_t size = 0;
+    const unsigned char* data = nullptr;
+    const json::Value& albedo = textures[static_cast<size_t>(
+        pbr["baseColorTexture"]["index"].asInt(-1))];
+    if ((data = imageData(albedo, size)) != nullptr) {
+      material.albedo_texname =
+          extractTexture(directory, data, size, TextureSlot::Albedo,
+                         base_colors[m], slot_sizes[0]);
+    }
+    const json::Value& normal = textures[static_cast<size_t>(
+        object["normalTexture"]["index"].asInt(-1))];
+    if ((data = imageData(normal, size)) != nullptr) {
+      material.normal_texname =
+          extractTexture(directory, data, size, TextureSlot::Normal,
+                         glm::vec4(1.0f), slot_sizes[1]);
+    }
+    const json::Value& metal_rough = textures[static_cast<size_t>(
+        pbr["metallicRoughnessTexture"]["index"].asInt(-1))];
+    if ((data = imageData(metal_rough, size)) != nullptr) {
+      material.metallic_texname = extractTexture(
+          directory, data, size, TextureSlot::Metallic,
+          glm::vec4(metallic_roughness[m].x), slot_sizes[2]);
+      material.roughness_texname = extractTexture(
+          directory, data, size, TextureSlot::Roughness,
+          glm::vec4(metallic_roughness[m].y), slot_sizes[3]);
+    }
+    external_images.clear();
+  }
+
+  // Untextured slots sample a constant layer holding the factor
+  for (size_t m = 0; m < materials.size(); m++) {
+    GltfMaterial& material = materials[m];
+    if (material.albedo_texname.empty()) {
+      material.albedo_texname = solidTexture(directory, TextureSlot::Albedo,
+                                             base_colors[m], slot_sizes[0]);
+    }
+    if (material.normal_texname.empty()) {
+      material.normal_texname =
+          solidTexture(directory, TextureSlot::Normal,
+                       glm::vec4(0.5f, 0.5f, 1.0f, 1.0f), slot_sizes[1]);
+    }
+    if (material.metallic_texname.empty()) {
+      material.metallic_texname =
+          solidTexture(directory, TextureSlot::Metallic,
+                       glm::vec4(metallic_roughness[m].x), slot_sizes[2]);
+    }
+    if (material.roughness_texname.empty()) {
+      material.roughness_texname =
+          solidTexture(directory, TextureSlot::Roughness,
+                       glm::vec4(metallic_roughness[m].y), slot_sizes[3]);
+    }
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "forward.hpp"
+#include "io.hpp"
+#include "json.hpp"
+#include "model.hpp"
+#include "vao.hpp"
+
+// Images are decoded once into this directory next to the .glb, as
+// uncompressed tga that TextureArray loads like obj textures
+#define GLTF_TEXTURE_DIRECTORY ".textures"
+
+// Typed view of an accessor in the binary chunk
+struct GltfAccessor {
+  const unsigned char* view = nullptr;  // start of the buffer view
+  size_t view_size = 0;
+  size_t offset = 0;  // first element in the buffer view
+  GLenum component_type = GL_FLOAT;
+  GLint components = 0;
+  GLboolean normalized = GL_FALSE;
+  GLsizei stride = 0;  // 0 when tightly packed
+  uint32_t count = 0;
+
+  size_t elementSize() const;
+  size_t byteStride() const;
+};
+
+struct GltfMaterial {
+  Material material;
+  std::string albedo_texname;
+  std::string normal_texname;
+  std::string metallic_texname;
+  std::string roughness_texname;
+  bool alpha_mask = false;
+};
+
+// Mesh primitive, streams point in the mapped file unless their data had to
+// be generated, one transform per node referencing the mesh
+struct GltfPrimitive {
+  std::vector<VertexStream> streams;
+  GLsizei vertex_count = 0;
+  const void* indices = nullptr;
+  GLsizei index_count = 0;
+  GLenum index_type = GL_UNSIGNED_INT;
+  size_t material = 0;
+  std::vector<glm::mat4> transforms;
+  glm::vec3 aabb_center = glm::vec3(0.0f);
+  glm::vec3 aabb_halfsize = glm::vec3(0.0f);
+};
+
+class GltfModel {
+ public:
+  GltfModel(const std::string& filename);
+  GltfModel(GltfModel const& src) = delete;
+  GltfModel& operator=(GltfModel const& rhs) = delete;
+  ~GltfModel();
+
+  bool valid = false;
+  std::vector<GltfPrimitive> primitives;
+  std::vector<GltfMaterial> materials;  // last one is the default material
+
+  glm::vec3 aabb_center = glm::vec3(0.0f);
+  glm::vec3 aabb_halfsize = glm::vec3(0.0f);
+
+ private:
+  std::unique_ptr<io::MappedFile> _file;
+  json::Value _document;
+  const unsigned char* _bin = nullptr;
+  size_t _bin_size = 0;
+  std::string _filename;
+  std::vector<std::unique_ptr<std::vector<unsigned char>>> _storage;
+
+  bool parseContainer();
+  bool getAccessor(const json::Value& index, GltfAccessor& accessor) const;
+  void loadScene();
+  void loadPrimitive(const json::Value& primitive, const glm::mat4& transform);
+  void loadMaterials();
+  const void* store(const void* data, size_t size);
+};
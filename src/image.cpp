@@ -0,0 +1,177 @@
+#include "image.hpp"
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+std::string materialTextureName(const std::string& metallic,
+                                const std::string& roughness) {
+  return (metallic + MATERIAL_TEXTURE_SEPARATOR + roughness);
+}
+
+std::vector<std::string> textureSources(const std::string& filename) {
+  size_t separator = filename.find(MATERIAL_TEXTURE_SEPARATOR);
+  if (separator == std::string::npos) return {filename};
+  return {filename.substr(0, separator), filename.substr(separator + 1)};
+}
+
+// Metallic 0 and roughness 0.5 when a file is missing
+static bool loadMaterialImage(const std::string& filename, Image& image) {
+  const unsigned char defaults[2] = {0, 128};
+  std::vector<std::string> sources = textureSources(filename);
+  Image parts[2];
+  bool loaded[2];
+  for (int i = 0; i < 2; i++) loaded[i] = loadImage(sources[i], parts[i]);
+  if (loaded[0] == false && loaded[1] == false) return (false);
+  const ImageLevel& first = parts[loaded[0] ? 0 : 1].levels[0];
+  if (loaded[0] && loaded[1] &&
+      (parts[1].levels[0].width != first.width ||
+       parts[1].levels[0].height != first.height)) {
+    std::cerr << filename << ": metallic and roughness sizes differ"
+              << std::endl;
+    return (false);
+  }
+  image.channels = 2;
+  image.format = BlockFormat::None;
+  image.levels.resize(1);
+  image.levels[0].width = first.width;
+  image.levels[0].height = first.height;
+  size_t texel_count = size_t(first.width) * first.height;
+  std::vector<unsigned char>& pixels = image.levels[0].pixels;
+  pixels.resize(texel_count * 2);
+  for (int i = 0; i < 2; i++) {
+    const unsigned char* source =
+        loaded[i] ? parts[i].levels[0].pixels.data() : nullptr;
+    for (size_t t = 0; t < texel_count; t++) {
+      pixels[t * 2 + i] =
+          source != nullptr ? source[t * parts[i].channels] : defaults[i];
+    }
+  }
+  return (true);
+}
+
+void initImageLoading() { stbi_set_flip_vertically_on_load(true); }
+
+bool loadImage(const std::string& filename, Image& image) {
+  if (filename.find(MATERIAL_TEXTURE_SEPARATOR) != std::string::npos) {
+    return (loadMaterialImage(filename, image));
+  }
+  int width, height, channels;
+  if (stbi_info(filename.c_str(), &width, &height, &channels) == 0) {
+    return (false);
+  }
+  int desired_channels = channels == 1 ? 1 : 4;
+  stbi_uc* pixels = stbi_load(filename.c_str(), &width, &height, &channels,
+                              desired_channels);
+  if (pixels == nullptr) return (false);
+  image.channels = desired_channels;
+  image.levels.resize(1);
+  image.levels[0].width = width;
+  image.levels[0].height = height;
+  image.levels[0].pixels.assign(
+      pixels, pixels + size_t(width) * height * desired_channels);
+  stbi_image_free(pixels);
+  return (true);
+}
+
+bool loadImageInfo(const std::string& filename, int& width, int& height,
+                   int& channels, bool& alpha) {
+  std::vector<std::string> sources = textureSources(filename);
+  if (sources.size() > 1) {
+    // The first file found gives the size, loadImage checks the other one
+    for (const auto& source : sources) {
+      if (loadImageInfo(source, width, height, channels, alpha)) {
+        channels = 2;
+        alpha = false;
+        return (true);
+      }
+    }
+    return (false);
+  }
+  if (stbi_info(filename.c_str(), &width, &height, &channels) == 0) {
+    return (false);
+  }
+  alpha = channels == 2 || channels == 4;
+  channels = channels == 1 ? 1 : 4;
+  return (true);
+}
+
+// 8 bit sRGB to linear, and back from linear values scaled to 4095
+static const std::vector<float>& srgbToLinear() {
+  static const std::vector<float> table = []() {
+    std::vector<float> values(256);
+    for (int i = 0; i < 256; i++) {
+      float c = i / 255.0f;
+      values[i] = c <= 0.04045f ? c / 12.92f
+                                : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return (values);
+  }();
+  return (table);
+}
+
+static const std::vector<unsigned char>& linearToSrgb() {
+  static const std::vector<unsigned char> table = []() {
+    std::vector<unsigned char> values(4096);
+    for (int i = 0; i < 4096; i++) {
+      float c = i / 4095.0f;
+      c = c <= 0.0031308f ? c * 12.92f
+                          : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+      values[i] = static_cast<unsigned char>(c * 255.0f + 0.5f);
+    }
+    return (values);
+  }();
+  return (table);
+}
+
+// 2x2 box filter of the rows [begin, end) of dst, the first color_channels
+// are sRGB
+static void filterRows(const ImageLevel& src, ImageLevel& dst, int channels,
+                       int color_channels, int begin, int end) {
+  const std::vector<float>& to_linear = srgbToLinear();
+  const std::vector<unsigned char>& to_srgb = linearToSrgb();
+  for (int y = begin; y < end; y++) {
+    size_t row_size = size_t(src.width) * channels;
+    const unsigned char* row0 =
+        &src.pixels[std::min(y * 2, src.height - 1) * row_size];
+    const unsigned char* row1 =
+        &src.pixels[std::min(y * 2 + 1, src.height - 1) * row_size];
+    unsigned char* out = &dst.pixels[size_t(y) * dst.width * channels];
+    for (int x = 0; x < dst.width; x++) {
+      int x0 = std::min(x * 2, src.width - 1) * channels;
+      int x1 = std::min(x * 2 + 1, src.width - 1) * channels;
+      for (int c = 0; c < channels; c++) {
+        if (c < color_channels) {
+          float sum = to_linear[row0[x0 + c]] + to_linear[row0[x1 + c]] +
+                      to_linear[row1[x0 + c]] + to_linear[row1[x1 + c]];
+          out[x * channels + c] =
+              to_srgb[static_cast<int>(sum * (4095.0f / 4.0f) + 0.5f)];
+        } else {
+          int sum =
+              row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+          out[x * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+        }
+      }
+    }
+  }
+}
+
+void generateMips(Image& image, bool srgb) {
+  if (image.levels.empty()) return;
+  image.levels.resize(1);
+  int channels = image.channels;
+  // Alpha and non color data are averaged as they are
+  int color_channels = srgb ? std::min(channels, 3) : 0;
+  while (image.levels.back().width > 1 || image.levels.back().height > 1) {
+    const ImageLevel& src = image.levels.back();
+    ImageLevel dst;
+    dst.width = std::max(src.width / 2, 1);
+    dst.height = std::max(src.height / 2, 1);
+    dst.pixels.resize(size_t(dst.width) * dst.height * channels);
+    ThreadPool::shared().parallelFor(
+        dst.height, std::max(4096 / dst.width, 1),
+        [&](size_t begin, size_t end) {
+          filterRows(src, dst, channels, color_channels,
+                     static_cast<int>(begin), static_cast<int>(end));
+        });
+    image.levels.push_back(std::move(dst));
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "thread_pool.hpp"
+
+// CPU side image, rows are stored bottom-up the way TextureArray uploads them
+struct ImageLevel {
+  int width = 0;
+  int height = 0;
+  std::vector<unsigned char> pixels;
+};
+
+// 4x4 block layouts, levels hold blocks instead of texels when not None
+enum class BlockFormat : uint32_t { None, BC1, BC3, BC4, BC5 };
+
+struct Image {
+  int channels = 0;  // of the source texels, compressed or not
+  BlockFormat format = BlockFormat::None;
+  std::vector<ImageLevel> levels;  // levels[0] is the full resolution
+};
+
+// Metallic and roughness are packed in the red and green channels of one
+// material texture, named after both files
+#define MATERIAL_TEXTURE_SEPARATOR '|'
+
+std::string materialTextureName(const std::string& metallic,
+                                const std::string& roughness);
+// Files a texture is built from, the two files of a material texture
+std::vector<std::string> textureSources(const std::string& filename);
+
+// stb keeps the vertical flip in a global, it is set once at startup before
+// any thread decodes so images are always loaded bottom-up
+void initImageLoading();
+// Single channel images stay single channel, others are expanded to rgba.
+// Material textures have two channels, the first channel of each file or,
+// when one is missing, the value the shader uses without a texture
+bool loadImage(const std::string& filename, Image& image);
+// Header only, channels as loadImage returns them, alpha when the file has an
+// alpha channel
+bool loadImageInfo(const std::string& filename, int& width, int& height,
+                   int& channels, bool& alpha);
+// Box filtered chain down to 1x1, replaces the levels after the first. Color
+// channels of sRGB images are averaged in linear space. Rows are filtered in
+// parallel on the shared pool
+void generateMips(Image& image, bool srgb = false);
@@ -0,0 +1,117 @@
+#include "instancing.hpp"
+
+// Quantized geometry of a group relative to its bounds center, translated
+// copies produce the same values
+struct GroupKey {
+  ObjFaceRange faces;
+  glm::vec3 center = glm::vec3(0.0f);
+  std::vector<int32_t> values;
+  uint64_t hash = 0;
+};
+
+static int32_t quantize(float value, float step) {
+  return (static_cast<int32_t>(std::lround(value / step)));
+}
+
+static void buildGroupKey(const ObjData& obj, GroupKey& key) {
+  glm::vec3 bounds_min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 bounds_max = glm::vec3(-std::numeric_limits<float>::max());
+  size_t first = static_cast<size_t>(key.faces.first) * 3;
+  size_t last = first + static_cast<size_t>(key.faces.count) * 3;
+  for (size_t c = first; c < last; c++) {
+    int v = obj.indices[c].vertex_index;
+    if (v < 0) continue;
+    glm::vec3 p(obj.positions[v * 3 + 0], obj.positions[v * 3 + 1],
+                obj.positions[v * 3 + 2]);
+    bounds_min = glm::min(bounds_min, p);
+    bounds_max = glm::max(bounds_max, p);
+  }
+  if (bounds_min.x > bounds_max.x) bounds_min = bounds_max = glm::vec3(0.0f);
+  key.center = (bounds_min + bounds_max) * 0.5f;
+  glm::vec3 extent = bounds_max - bounds_min;
+  float size = std::max(std::max(extent.x, extent.y), extent.z);
+  // Power of two steps, so that copies with rounded extents agree on it
+  float step = std::exp2(
+      std::ceil(std::log2(std::max(size * INSTANCING_PRECISION, 1e-30f))));
+  const float attribute_step = 1.0f / 4096.0f;
+
+  key.values.clear();
+  key.values.reserve(key.faces.count * 25 + 1);
+  key.values.push_back(quantize(size, step));
+  for (size_t c = first; c < last; c++) {
+    if (c % 3 == 0) key.values.push_back(obj.material_ids[c / 3]);
+    const ObjIndex& index = obj.indices[c];
+    for (int i = 0; i < 3; i++) {
+      int v = index.vertex_index;
+      key.values.push_back(
+          v < 0 ? INT_MIN
+                : quantize(obj.positions[v * 3 + i] - key.center[i], step));
+      int n = index.normal_index;
+      key.values.push_back(
+          n < 0 ? INT_MIN : quantize(obj.normals[n * 3 + i], attribute_step));
+    }
+    for (int i = 0; i < 2; i++) {
+      int t = index.texcoord_index;
+      key.values.push_back(t < 0 ? INT_MIN
+                                 : quantize(obj.texcoords[t * 2 + i],
+                                            attribute_step));
+    }
+  }
+  key.hash = io::hash(key.values.data(), key.values.size() * sizeof(int32_t));
+}
+
+std::vector<ObjInstances> findObjInstances(const ObjData& obj) {
+  // Every run of faces of the same group is a candidate
+  std::vector<GroupKey> keys;
+  size_t face_count = obj.group_ids.size();
+  for (size_t f = 0; f < face_count;) {
+    size_t end = f + 1;
+    while (end < face_count && obj.group_ids[end] == obj.group_ids[f]) end++;
+    if (end - f >= INSTANCING_MIN_TRIANGLES) {
+      GroupKey key;
+      key.faces.first = static_cast<uint32_t>(f);
+      key.faces.count = static_cast<uint32_t>(end - f);
+      keys.push_back(key);
+    }
+    f = end;
+  }
+  ThreadPool::shared().parallelFor(keys.size(), 1, [&](size_t begin,
+                                                       size_t end) {
+    for (size_t k = begin; k < end; k++) buildGroupKey(obj, keys[k]);
+  });
+
+  // The first occurrence of a geometry is its prototype
+  std::vector<ObjInstances> candidates;
+  std::vector<size_t> prototype_keys;
+  std::unordered_map<uint64_t, std::vector<size_t>> lookup;
+  for (size_t k = 0; k < keys.size(); k++) {
+    GroupKey& key = keys[k];
+    std::vector<size_t>& matches = lookup[key.hash];
+    auto match = std::find_if(
+        matches.begin(), matches.end(), [&](size_t candidate) {
+          return (keys[prototype_keys[candidate]].values == key.values);
+        });
+    if (match == matches.end()) {
+      matches.push_back(candidates.size());
+      prototype_keys.push_back(k);
+      ObjInstances instances;
+      instances.prototype = key.faces;
+      instances.transforms.push_back(glm::mat4(1.0f));
+      candidates.push_back(instances);
+      continue;
+    }
+    ObjInstances& instances = candidates[*match];
+    instances.duplicates.push_back(key.faces);
+    instances.transforms.push_back(glm::translate(
+        key.center - keys[prototype_keys[*match]].center));
+    key.values = std::vector<int32_t>();
+  }
+
+  std::vector<ObjInstances> result;
+  for (auto& instances : candidates) {
+    if (instances.duplicates.empty() == false) {
+      result.push_back(std::move(instances));
+    }
+  }
+  return (result);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+#include "forward.hpp"
+#include "io.hpp"
+#include "obj_parser.hpp"
+#include "thread_pool.hpp"
+
+#define INSTANCING_MIN_TRIANGLES 32  // Smaller groups are cheaper to duplicate
+#define INSTANCING_PRECISION 1e-4f   // Position tolerance, relative to a group
+
+// Contiguous faces of an obj group
+struct ObjFaceRange {
+  uint32_t first = 0;
+  uint32_t count = 0;
+};
+
+// Obj group repeated further in the file up to a translation, the faces of
+// the duplicates are dropped and drawn as instances of the prototype
+struct ObjInstances {
+  ObjFaceRange prototype;
+  std::vector<ObjFaceRange> duplicates;
+  std::vector<glm::mat4> transforms;  // identity, then one per duplicate
+};
+
+// Groups are compared relative to their bounds center, faces, materials,
+// normals and uvs have to match in order
+std::vector<ObjInstances> findObjInstances(const ObjData& obj);
@@ -1,4 +1,11 @@
 #include "io.hpp"
+#if defined(__APPLE__) || defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
 
 namespace io {
 bool exists(std::string filename) {
@@ -23,4 +30,70 @@ unsigned int get_filesize(std::string filename) {
   return (0);
 }
 
+// FNV-1a over 64-bit words, the tail is folded byte by byte
+uint64_t hash(const void* data, size_t size, uint64_t seed) {
+  const uint64_t prime = 0x100000001b3ULL;
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    h = (h ^ word) * prime;
+    h ^= h >> 29;
+  }
+  for (; i < size; i++) {
+    h = (h ^ bytes[i]) * prime;
+  }
+  return (h);
+}
+
+void dropFileCache(std::string filename) {
+#if defined(__linux__)
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) return;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+#endif
+}
+
+MappedFile::MappedFile(const std::string& filename) {
+#if defined(__APPLE__) || defined(__linux__)
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) return;
+  struct stat st = {0};
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      data = static_cast<const unsigned char*>(ptr);
+      size = static_cast<size_t>(st.st_size);
+    }
+  }
+  close(fd);
+#elif defined(_WIN32)
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return;
+  _file = file;
+  LARGE_INTEGER file_size;
+  if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+    _mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping != nullptr) {
+      data = static_cast<const unsigned char*>(
+          MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+      if (data != nullptr) size = static_cast<size_t>(file_size.QuadPart);
+    }
+  }
+#endif
+}
+MappedFile::~MappedFile() {
+#if defined(__APPLE__) || defined(__linux__)
+  if (data != nullptr) munmap(const_cast<unsigned char*>(data), size);
+#elif defined(_WIN32)
+  if (data != nullptr) UnmapViewOfFile(data);
+  if (_mapping != nullptr) CloseHandle(_mapping);
+  if (_file != nullptr) CloseHandle(_file);
+#endif
+}
+
 }  // namespace io
@@ -6,6 +6,8 @@
 #endif
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <string>
 
@@ -13,5 +15,27 @@ namespace io {
 bool exists(std::string filename);
 void makedir(std::string filename);
 unsigned int get_filesize(std::string filename);
+uint64_t hash(const void* data, size_t size, uint64_t seed = 0);
+// Evict the file from the page cache where the OS allows it, so that the next
+// read is a cold one
+void dropFileCache(std::string filename);
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+ public:
+  MappedFile(const std::string& filename);
+  MappedFile(MappedFile const& src) = delete;
+  MappedFile& operator=(MappedFile const& rhs) = delete;
+  ~MappedFile();
+
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+
+ private:
+#if defined(_WIN32)
+  void* _file = nullptr;
+  void* _mapping = nullptr;
+#endif
+};
 
 }  // namespace io
@@ -0,0 +1,204 @@
+#include "json.hpp"
+
+namespace json {
+
+static const Value null_value;
+
+const Value& Value::operator[](const std::string& key) const {
+  for (const auto& member : object) {
+    if (member.first == key) return (member.second);
+  }
+  return (null_value);
+}
+
+const Value& Value::operator[](size_t index) const {
+  return (index < array.size() ? array[index] : null_value);
+}
+
+size_t Value::size() const {
+  return (type == Type::Object ? object.size() : array.size());
+}
+
+bool Value::isNull() const { return (type == Type::Null); }
+
+double Value::asNumber(double fallback) const {
+  return (type == Type::Number ? number : fallback);
+}
+
+int Value::asInt(int fallback) const {
+  return (type == Type::Number ? static_cast<int>(number) : fallback);
+}
+
+std::string Value::asString(const std::string& fallback) const {
+  return (type == Type::String ? string : fallback);
+}
+
+struct Parser {
+  const char* p;
+  const char* end;
+
+  void skipSpace() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+      p++;
+    }
+  }
+
+  bool consume(const char* literal) {
+    size_t length = std::strlen(literal);
+    if (static_cast<size_t>(end - p) < length ||
+        std::strncmp(p, literal, length) != 0) {
+      return (false);
+    }
+    p += length;
+    return (true);
+  }
+
+  static void appendUtf8(std::string& out, unsigned int code) {
+    if (code < 0x80) {
+      out.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+      out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+      out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+      out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+  }
+
+  bool parseHex(unsigned int& code) {
+    if (end - p < 4) return (false);
+    code = 0;
+    for (int i = 0; i < 4; i++, p++) {
+      char c = *p;
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        code |= c - 'A' + 10;
+      } else {
+        return (false);
+      }
+    }
+    return (true);
+  }
+
+  bool parseString(std::string& out) {
+    if (p >= end || *p != '"') return (false);
+    p++;
+    while (p < end && *p != '"') {
+      if (*p != '\\') {
+        out.push_back(*p++);
+        continue;
+      }
+      if (++p >= end) return (false);
+      char escape = *p++;
+      switch (escape) {
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u': {
+          unsigned int code = 0;
+          if (parseHex(code) == false) return (false);
+          // Surrogate pairs encode code points above the basic plane
+          if (code >= 0xD800 && code < 0xDC00 && consume("\\u")) {
+            unsigned int low = 0;
+            if (parseHex(low) == false) return (false);
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          }
+          appendUtf8(out, code);
+          break;
+        }
+        default: out.push_back(escape); break;
+      }
+    }
+    if (p >= end) return (false);
+    p++;
+    return (true);
+  }
+
+  bool parseValue(Value& value, int depth) {
+    if (depth > 128) return (false);
+    skipSpace();
+    if (p >= end) return (false);
+    if (*p == '{') {
+      p++;
+      value.type = Type::Object;
+      skipSpace();
+      if (p < end && *p == '}') {
+        p++;
+        return (true);
+      }
+      while (true) {
+        skipSpace();
+        std::pair<std::string, Value> member;
+        if (parseString(member.first) == false) return (false);
+        skipSpace();
+        if (consume(":") == false) return (false);
+        if (parseValue(member.second, depth + 1) == false) return (false);
+        value.object.push_back(std::move(member));
+        skipSpace();
+        if (consume("}")) return (true);
+        if (consume(",") == false) return (false);
+      }
+    }
+    if (*p == '[') {
+      p++;
+      value.type = Type::Array;
+      skipSpace();
+      if (p < end && *p == ']') {
+        p++;
+        return (true);
+      }
+      while (true) {
+        value.array.emplace_back();
+        if (parseValue(value.array.back(), depth + 1) == false) return (false);
+        skipSpace();
+        if (consume("]")) return (true);
+        if (consume(",") == false) return (false);
+      }
+    }
+    if (*p == '"') {
+      value.type = Type::String;
+      return (parseString(value.string));
+    }
+    if (consume("true") || consume("false")) {
+      value.type = Type::Bool;
+      value.boolean = p[-1] == 'e' && p[-2] == 'u';
+      return (true);
+    }
+    if (consume("null")) {
+      value.type = Type::Null;
+      return (true);
+    }
+    // strtod stops at the first character that is not part of the number
+    std::string number;
+    while (p < end && std::strchr("+-0123456789.eE", *p) != nullptr) {
+      number.push_back(*p++);
+    }
+    if (number.empty()) return (false);
+    char* number_end = nullptr;
+    value.type = Type::Number;
+    value.number = std::strtod(number.c_str(), &number_end);
+    return (*number_end == '\0');
+  }
+};
+
+bool parse(const char* begin, const char* end, Value& value) {
+  Parser parser = {begin, end};
+  value = Value();
+  if (parser.parseValue(value, 0) == false) return (false);
+  parser.skipSpace();
+  return (parser.p == end || *parser.p == '\0');
+}
+
+}  // namespace json
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace json {
+
+enum class Type { Null, Bool, Number, String, Array, Object };
+
+// Read only document tree, missing members and out of range elements
+// resolve to a shared null value so lookups can be chained
+class Value {
+ public:
+  Type type = Type::Null;
+  bool boolean = false;
+  double number = 0.0;
+  std::string string;
+  std::vector<Value> array;
+  std::vector<std::pair<std::string, Value>> object;
+
+  const Value& operator[](const std::string& key) const;
+  const Value& operator[](size_t index) const;
+  size_t size() const;
+  bool isNull() const;
+  double asNumber(double fallback = 0.0) const;
+  int asInt(int fallback = 0) const;
+  std::string asString(const std::string& fallback = "") const;
+};
+
+bool parse(const char* begin, const char* end, Value& value);
+
+}  // namespace json
@@ -3,13 +3,19 @@
 #include "renderer.hpp"
 
 int main(int argc, char **argv) {
+  initImageLoading();
+  StressScene stress;
+  if (parseStressScene(argc, argv, stress) == false) {
+    printStressSceneUsage(argv[0]);
+    return (EXIT_FAILURE);
+  }
   Env env(1600, 900);
   // Env env(0, 0);
   if (env.window == nullptr) {
     return (EXIT_FAILURE);
   }
   render::Renderer renderer(env.width, env.height);
-  Game game;
+  Game game(stress);
   while (!glfwWindowShouldClose(env.window)) {
     env.update();
     glfwPollEvents();
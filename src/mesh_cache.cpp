@@ -0,0 +1,271 @@
+#include "mesh_cache.hpp"
+
+static std::string Mesh::*const texname_members[MESH_CACHE_TEXNAMES] = {
+    &Mesh::ambient_texname,   &Mesh::diffuse_texname,
+    &Mesh::specular_texname,  &Mesh::specular_highlight_texname,
+    &Mesh::bump_texname,      &Mesh::displacement_texname,
+    &Mesh::alpha_texname,     &Mesh::roughness_texname,
+    &Mesh::metallic_texname,  &Mesh::sheen_texname,
+    &Mesh::emissive_texname,  &Mesh::normal_texname};
+
+static uint64_t alignOffset(uint64_t offset) {
+  return ((offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1ULL));
+}
+
+uint64_t hashModelSources(const std::string& filename) {
+  io::MappedFile obj(filename);
+  if (obj.data == nullptr) return (0);
+  // Caches built with another chunk size are stale as well
+  const uint32_t settings[] = {MESH_CACHE_VERSION, MESH_CHUNK_TRIANGLES};
+  uint64_t source_hash =
+      io::hash(obj.data, obj.size, io::hash(settings, sizeof(settings)));
+
+  std::string basedir = getBaseDir(filename);
+  if (basedir.empty()) basedir = ".";
+  basedir += "/";
+  // Material libraries are only referenced from the obj, look them up
+  const char* begin = reinterpret_cast<const char*>(obj.data);
+  const char* end = begin + obj.size;
+  const char* line = begin;
+  while (line < end) {
+    const char* eol =
+        static_cast<const char*>(std::memchr(line, '\n', end - line));
+    if (eol == nullptr) eol = end;
+    if (eol - line > 7 && std::strncmp(line, "mtllib", 6) == 0) {
+      std::string mtl_filename(line + 7, eol);
+      mtl_filename.erase(mtl_filename.find_last_not_of(" \t\r") + 1);
+      io::MappedFile mtl(sanitizeFilename(basedir + mtl_filename));
+      if (mtl.data != nullptr) {
+        source_hash = io::hash(mtl.data, mtl.size, source_hash);
+      }
+    }
+    line = eol + 1;
+  }
+  return (source_hash);
+}
+
+// Aligned section of count elements inside the size bytes of the cache,
+// without overflowing on corrupted counts
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t element_size,
+                        size_t size) {
+  if (offset % MESH_CACHE_ALIGNMENT != 0 || offset > size) return (false);
+  return (count <= (size - offset) / element_size);
+}
+
+// Ranges of a record inside the model sections, first + count never wraps as
+// both are 32 bits, and names ending inside the string table
+static bool validRecord(const MeshCacheRecord& record,
+                        const MeshCacheHeader& header,
+                        const uint32_t* indices, const Meshlet* meshlets,
+                        const char* strings) {
+  if (record.vertex_offset < 0 ||
+      uint64_t(record.vertex_offset) + record.vertex_count >
+          header.vertex_count ||
+      uint64_t(record.index_offset) + record.index_count >
+          header.index_count ||
+      uint64_t(record.meshlet_offset) + record.meshlet_count >
+          header.meshlet_count ||
+      uint64_t(record.instance_offset) + record.instance_count >
+          header.instance_count ||
+      record.lod_count > MESH_LOD_COUNT) {
+    return (false);
+  }
+  for (uint32_t i = 0; i < record.lod_count; i++) {
+    const MeshLod& lod = record.lods[i];
+    if (uint64_t(lod.index_offset) + lod.index_count > record.index_count ||
+        uint64_t(lod.meshlet_offset) + lod.meshlet_count >
+            record.meshlet_count) {
+      return (false);
+    }
+  }
+  for (uint32_t i = 0; i < record.meshlet_count; i++) {
+    const Meshlet& meshlet = meshlets[record.meshlet_offset + i];
+    if (uint64_t(meshlet.index_offset) + meshlet.index_count >
+        record.index_count) {
+      return (false);
+    }
+  }
+  // Indices are relative to the first vertex of the mesh
+  const uint32_t* mesh_indices = indices + record.index_offset;
+  for (uint32_t i = 0; i < record.index_count; i++) {
+    if (mesh_indices[i] >= record.vertex_count) return (false);
+  }
+  for (uint32_t texname : record.texnames) {
+    if (texname >= header.strings_size ||
+        std::memchr(strings + texname, '\0', header.strings_size - texname) ==
+            nullptr) {
+      return (false);
+    }
+  }
+  return (true);
+}
+
+bool loadMeshCache(const std::string& cache_filename, uint64_t source_hash,
+                   Model& model) {
+  io::MappedFile cache(cache_filename);
+  return (readMeshCache(cache.data, cache.size, source_hash, model));
+}
+
+bool readMeshCache(const unsigned char* data, size_t size,
+                   uint64_t source_hash, Model& model) {
+  if (data == nullptr || size < sizeof(MeshCacheHeader)) {
+    return (false);
+  }
+  MeshCacheHeader header;
+  std::memcpy(&header, data, sizeof(MeshCacheHeader));
+  if (std::memcmp(header.magic, MeshCacheHeader().magic, 4) != 0 ||
+      header.version != MESH_CACHE_VERSION ||
+      (source_hash != 0 && header.source_hash != source_hash) ||
+      header.vertex_size != sizeof(Vertex) ||
+      header.material_size != sizeof(Material) ||
+      header.meshlet_size != sizeof(Meshlet) ||
+      sectionFits(header.vertices_offset, header.vertex_count, sizeof(Vertex),
+                  size) == false ||
+      sectionFits(header.indices_offset, header.index_count, sizeof(uint32_t),
+                  size) == false ||
+      sectionFits(header.meshes_offset, header.mesh_count,
+                  sizeof(MeshCacheRecord), size) == false ||
+      sectionFits(header.meshlets_offset, header.meshlet_count,
+                  sizeof(Meshlet), size) == false ||
+      sectionFits(header.instances_offset, header.instance_count,
+                  sizeof(glm::mat4), size) == false ||
+      sectionFits(header.strings_offset, header.strings_size, 1, size) ==
+          false) {
+    return (false);
+  }
+  const Vertex* vertices =
+      reinterpret_cast<const Vertex*>(data + header.vertices_offset);
+  const uint32_t* indices =
+      reinterpret_cast<const uint32_t*>(data + header.indices_offset);
+  const MeshCacheRecord* records = reinterpret_cast<const MeshCacheRecord*>(
+      data + header.meshes_offset);
+  const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(
+      data + header.meshlets_offset);
+  const glm::mat4* instances = reinterpret_cast<const glm::mat4*>(
+      data + header.instances_offset);
+  const char* strings =
+      reinterpret_cast<const char*>(data + header.strings_offset);
+  // The model is left untouched by a corrupted cache
+  for (uint64_t i = 0; i < header.mesh_count; i++) {
+    if (validRecord(records[i], header, indices, meshlets, strings) == false) {
+      return (false);
+    }
+  }
+
+  model.vertices.assign(vertices, vertices + header.vertex_count);
+  model.indices.assign(indices, indices + header.index_count);
+  model.meshlets.assign(meshlets, meshlets + header.meshlet_count);
+  model.instances.assign(instances, instances + header.instance_count);
+  model.meshes.clear();
+  model.meshes.reserve(header.mesh_count);
+  for (uint64_t i = 0; i < header.mesh_count; i++) {
+    const MeshCacheRecord& record = records[i];
+    Mesh mesh(record.index_count, record.vertex_offset);
+    mesh.indexOffset = record.index_offset;
+    mesh.vertexCount = record.vertex_count;
+    mesh.meshletCount = record.meshlet_count;
+    mesh.meshletOffset = record.meshlet_offset;
+    mesh.lodCount = record.lod_count;
+    mesh.instanceCount = record.instance_count;
+    mesh.instanceOffset = record.instance_offset;
+    std::copy(record.lods, record.lods + MESH_LOD_COUNT, mesh.lods);
+    mesh.material = record.material;
+    mesh.alpha_mask = record.alpha_mask != 0;
+    mesh.aabb_center = record.aabb_center;
+    mesh.aabb_halfsize = record.aabb_halfsize;
+    for (int t = 0; t < MESH_CACHE_TEXNAMES; t++) {
+      mesh.*texname_members[t] = std::string(strings + record.texnames[t]);
+    }
+    model.meshes.push_back(mesh);
+  }
+  model.aabb_center = header.aabb_center;
+  model.aabb_halfsize = header.aabb_halfsize;
+  return (true);
+}
+
+bool writeMeshCache(std::ostream& file, uint64_t source_hash,
+                    const Model& model) {
+  std::string strings;
+  std::vector<MeshCacheRecord> records;
+  for (const auto& mesh : model.meshes) {
+    MeshCacheRecord record;
+    record.material = mesh.material;
+    record.aabb_center = mesh.aabb_center;
+    record.aabb_halfsize = mesh.aabb_halfsize;
+    record.index_count = mesh.indexCount;
+    record.index_offset = mesh.indexOffset;
+    record.vertex_count = mesh.vertexCount;
+    record.vertex_offset = mesh.vertexOffset;
+    record.meshlet_count = mesh.meshletCount;
+    record.meshlet_offset = mesh.meshletOffset;
+    record.lod_count = mesh.lodCount;
+    record.instance_count = mesh.instanceCount;
+    record.instance_offset = mesh.instanceOffset;
+    std::copy(mesh.lods, mesh.lods + MESH_LOD_COUNT, record.lods);
+    record.alpha_mask = mesh.alpha_mask ? 1 : 0;
+    for (int t = 0; t < MESH_CACHE_TEXNAMES; t++) {
+      record.texnames[t] = static_cast<uint32_t>(strings.size());
+      strings += mesh.*texname_members[t];
+      strings.push_back('\0');
+    }
+    records.push_back(record);
+  }
+
+  MeshCacheHeader header;
+  header.source_hash = source_hash;
+  header.vertex_count = model.vertices.size();
+  header.index_count = model.indices.size();
+  header.mesh_count = records.size();
+  header.meshlet_count = model.meshlets.size();
+  header.instance_count = model.instances.size();
+  header.vertices_offset = alignOffset(sizeof(MeshCacheHeader));
+  header.indices_offset = alignOffset(header.vertices_offset +
+                                      header.vertex_count * sizeof(Vertex));
+  header.meshes_offset = alignOffset(header.indices_offset +
+                                     header.index_count * sizeof(uint32_t));
+  header.meshlets_offset = alignOffset(
+      header.meshes_offset + header.mesh_count * sizeof(MeshCacheRecord));
+  header.instances_offset = alignOffset(
+      header.meshlets_offset + header.meshlet_count * sizeof(Meshlet));
+  header.strings_offset = alignOffset(
+      header.instances_offset + header.instance_count * sizeof(glm::mat4));
+  header.strings_size = strings.size();
+  header.aabb_center = model.aabb_center;
+  header.aabb_halfsize = model.aabb_halfsize;
+
+  const char padding[MESH_CACHE_ALIGNMENT] = {};
+  auto writeAt = [&](uint64_t offset, const void* data, size_t size) {
+    uint64_t position = static_cast<uint64_t>(file.tellp());
+    file.write(padding, offset - position);
+    file.write(static_cast<const char*>(data), size);
+  };
+  writeAt(0, &header, sizeof(MeshCacheHeader));
+  writeAt(header.vertices_offset, model.vertices.data(),
+          model.vertices.size() * sizeof(Vertex));
+  writeAt(header.indices_offset, model.indices.data(),
+          model.indices.size() * sizeof(uint32_t));
+  writeAt(header.meshes_offset, records.data(),
+          records.size() * sizeof(MeshCacheRecord));
+  writeAt(header.meshlets_offset, model.meshlets.data(),
+          model.meshlets.size() * sizeof(Meshlet));
+  writeAt(header.instances_offset, model.instances.data(),
+          model.instances.size() * sizeof(glm::mat4));
+  writeAt(header.strings_offset, strings.data(), strings.size());
+  return (file.good());
+}
+
+bool writeMeshCache(const std::string& cache_filename, uint64_t source_hash,
+                    const Model& model) {
+  // Write next to the final file and rename, a partial cache is never seen
+  std::string tmp_filename = cache_filename + ".tmp";
+  std::ofstream file(tmp_filename, std::ios::binary | std::ios::trunc);
+  if (!file) return (false);
+  writeMeshCache(file, source_hash, model);
+  file.close();
+  if (!file) {
+    std::remove(tmp_filename.c_str());
+    return (false);
+  }
+  std::remove(cache_filename.c_str());
+  return (std::rename(tmp_filename.c_str(), cache_filename.c_str()) == 0);
+}
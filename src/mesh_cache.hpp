@@ -0,0 +1,65 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <vector>
+#include "io.hpp"
+#include "model.hpp"
+
+// Bump whenever the layout below or the Vertex/Material structs change
+#define MESH_CACHE_VERSION 9
+#define MESH_CACHE_ALIGNMENT 16
+#define MESH_CACHE_TEXNAMES 12
+
+struct MeshCacheHeader {
+  char magic[4] = {'M', 'S', 'H', 'C'};
+  uint32_t version = MESH_CACHE_VERSION;
+  uint64_t source_hash = 0;
+  uint32_t vertex_size = sizeof(Vertex);
+  uint32_t material_size = sizeof(Material);
+  uint32_t meshlet_size = sizeof(Meshlet);
+  uint64_t vertex_count = 0;
+  uint64_t index_count = 0;
+  uint64_t mesh_count = 0;
+  uint64_t meshlet_count = 0;
+  uint64_t instance_count = 0;
+  uint64_t vertices_offset = 0;
+  uint64_t indices_offset = 0;
+  uint64_t meshes_offset = 0;
+  uint64_t meshlets_offset = 0;
+  uint64_t instances_offset = 0;
+  uint64_t strings_offset = 0;
+  uint64_t strings_size = 0;
+  glm::vec3 aabb_center = {};
+  glm::vec3 aabb_halfsize = {};
+};
+
+struct MeshCacheRecord {
+  Material material;
+  glm::vec3 aabb_center = {};
+  glm::vec3 aabb_halfsize = {};
+  uint32_t index_count = 0;
+  uint32_t index_offset = 0;
+  uint32_t vertex_count = 0;
+  int32_t vertex_offset = 0;
+  uint32_t meshlet_count = 0;
+  uint32_t meshlet_offset = 0;
+  uint32_t lod_count = 0;
+  MeshLod lods[MESH_LOD_COUNT];
+  uint32_t instance_count = 0;
+  uint32_t instance_offset = 0;
+  uint32_t alpha_mask = 0;
+  uint32_t texnames[MESH_CACHE_TEXNAMES] = {};  // string table offsets
+};
+
+// Hash of the obj file and every mtllib it references, 0 if unreadable
+uint64_t hashModelSources(const std::string& filename);
+bool loadMeshCache(const std::string& cache_filename, uint64_t source_hash,
+                   Model& model);
+bool writeMeshCache(const std::string& cache_filename, uint64_t source_hash,
+                    const Model& model);
+// In memory variants, used to embed the cache in a package, a source_hash of
+// 0 accepts any source
+bool readMeshCache(const unsigned char* data, size_t size,
+                   uint64_t source_hash, Model& model);
+bool writeMeshCache(std::ostream& file, uint64_t source_hash,
+                    const Model& model);
@@ -0,0 +1,336 @@
+#include "mesh_optimizer.hpp"
+
+static const float cache_decay_power = 1.5f;
+static const float last_triangle_score = 0.75f;
+static const float valence_boost_scale = 2.0f;
+static const float valence_boost_power = 0.5f;
+static const uint32_t invalid_index = std::numeric_limits<uint32_t>::max();
+
+static float vertexScore(int cache_position, uint32_t remaining_triangles) {
+  if (remaining_triangles == 0) return (-1.0f);
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      // The last triangle vertices are penalized so strips are avoided
+      score = last_triangle_score;
+    } else {
+      float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+      score = std::pow(1.0f - (cache_position - 3) * scaler, cache_decay_power);
+    }
+  }
+  // Favor vertices with few triangles left so they leave the cache early
+  score += valence_boost_scale *
+           std::pow(static_cast<float>(remaining_triangles),
+                    -valence_boost_power);
+  return (score);
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t index_count,
+                         size_t vertex_count) {
+  size_t triangle_count = index_count / 3;
+  if (triangle_count == 0) return;
+
+  // Vertex to triangles adjacency
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (size_t i = 0; i < index_count; i++) remaining[indices[i]]++;
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (size_t v = 0; v < vertex_count; v++) {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  std::vector<uint32_t> adjacency(index_count);
+  std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < index_count; i++) {
+    adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> vertex_scores(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++) {
+    vertex_scores[v] = vertexScore(-1, remaining[v]);
+  }
+  std::vector<float> triangle_scores(triangle_count);
+  std::vector<bool> emitted(triangle_count, false);
+  uint32_t best_triangle = 0;
+  for (size_t t = 0; t < triangle_count; t++) {
+    triangle_scores[t] = vertex_scores[indices[t * 3 + 0]] +
+                         vertex_scores[indices[t * 3 + 1]] +
+                         vertex_scores[indices[t * 3 + 2]];
+    if (triangle_scores[t] > triangle_scores[best_triangle]) {
+      best_triangle = static_cast<uint32_t>(t);
+    }
+  }
+
+  std::vector<uint32_t> output;
+  output.reserve(index_count);
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> new_cache;
+  size_t cursor = 0;
+  while (best_triangle != invalid_index) {
+    const uint32_t* triangle = &indices[best_triangle * 3];
+    emitted[best_triangle] = true;
+    new_cache.clear();
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = triangle[k];
+      output.push_back(v);
+      // Remove the triangle from the vertex adjacency list
+      uint32_t* begin = &adjacency[offsets[v]];
+      uint32_t* end = begin + remaining[v];
+      *std::find(begin, end, best_triangle) = *(end - 1);
+      remaining[v]--;
+      new_cache.push_back(v);
+    }
+    for (uint32_t v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        new_cache.push_back(v);
+      }
+    }
+    cache.swap(new_cache);
+
+    // Vertices pushed out of the cache are updated one last time
+    for (size_t i = 0; i < cache.size(); i++) {
+      uint32_t v = cache[i];
+      cache_position[v] = i < VERTEX_CACHE_SIZE ? static_cast<int>(i) : -1;
+      float score = vertexScore(cache_position[v], remaining[v]);
+      float diff = score - vertex_scores[v];
+      vertex_scores[v] = score;
+      for (uint32_t a = 0; a < remaining[v]; a++) {
+        triangle_scores[adjacency[offsets[v] + a]] += diff;
+      }
+    }
+    if (cache.size() > VERTEX_CACHE_SIZE) cache.resize(VERTEX_CACHE_SIZE);
+
+    best_triangle = invalid_index;
+    float best_score = -1.0f;
+    for (uint32_t v : cache) {
+      for (uint32_t a = 0; a < remaining[v]; a++) {
+        uint32_t t = adjacency[offsets[v] + a];
+        if (triangle_scores[t] > best_score) {
+          best_score = triangle_scores[t];
+          best_triangle = t;
+        }
+      }
+    }
+    if (best_triangle == invalid_index) {
+      // Dead end, restart from the next triangle in input order
+      while (cursor < triangle_count && emitted[cursor]) cursor++;
+      if (cursor < triangle_count) {
+        best_triangle = static_cast<uint32_t>(cursor);
+      }
+    }
+  }
+  std::copy(output.begin(), output.end(), indices);
+}
+
+// Simulates a FIFO cache and returns the number of misses per triangle
+static std::vector<uint32_t> simulateFifo(const uint32_t* indices,
+                                          size_t index_count,
+                                          size_t vertex_count,
+                                          unsigned int cache_size) {
+  std::vector<uint32_t> timestamps(vertex_count, 0);
+  std::vector<uint32_t> misses(index_count / 3, 0);
+  uint32_t time = cache_size + 1;
+  for (size_t i = 0; i + 2 < index_count; i += 3) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[i + k];
+      if (time - timestamps[v] > cache_size) {
+        timestamps[v] = time++;
+        misses[i / 3]++;
+      }
+    }
+  }
+  return (misses);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t index_count,
+                      const Vertex* vertices, size_t vertex_count,
+                      float threshold) {
+  size_t triangle_count = index_count / 3;
+  if (triangle_count == 0) return;
+  std::vector<uint32_t> misses =
+      simulateFifo(indices, index_count, vertex_count, FIFO_CACHE_SIZE);
+
+  // Hard boundaries are triangles missing the cache on every vertex, soft
+  // ones are accepted while the extra misses keep ACMR within threshold
+  std::vector<size_t> clusters;
+  size_t hard_start = 0;
+  while (hard_start < triangle_count) {
+    size_t hard_end = hard_start + 1;
+    while (hard_end < triangle_count && misses[hard_end] != 3) hard_end++;
+    uint32_t cluster_misses = 0;
+    for (size_t t = hard_start; t < hard_end; t++) {
+      cluster_misses += misses[t];
+    }
+    float budget = cluster_misses * (threshold - 1.0f);
+    float extra_misses = 0.0f;
+    clusters.push_back(hard_start);
+    for (size_t t = hard_start + 1; t < hard_end; t++) {
+      if (misses[t] >= 2 && extra_misses + (3 - misses[t]) <= budget) {
+        extra_misses += 3 - misses[t];
+        clusters.push_back(t);
+      }
+    }
+    hard_start = hard_end;
+  }
+  clusters.push_back(triangle_count);
+
+  glm::vec3 mesh_centroid = glm::vec3(0.0f);
+  for (size_t v = 0; v < vertex_count; v++) {
+    mesh_centroid += vertices[v].position;
+  }
+  mesh_centroid /= static_cast<float>(std::max<size_t>(vertex_count, 1));
+
+  // Outward facing clusters occlude the rest of the mesh, draw them first
+  std::vector<float> sort_keys(clusters.size() - 1);
+  for (size_t c = 0; c + 1 < clusters.size(); c++) {
+    glm::vec3 centroid = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    float area = 0.0f;
+    for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+      const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+      const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+      glm::vec3 triangle_normal = glm::cross(p1 - p0, p2 - p0);
+      float triangle_area = glm::length(triangle_normal);
+      centroid += (p0 + p1 + p2) * (triangle_area / 3.0f);
+      normal += triangle_normal;
+      area += triangle_area;
+    }
+    float normal_length = glm::length(normal);
+    if (area > 0.0f && normal_length > 0.0f) {
+      sort_keys[c] =
+          glm::dot(centroid / area - mesh_centroid, normal / normal_length);
+    } else {
+      sort_keys[c] = 0.0f;
+    }
+  }
+  std::vector<uint32_t> order(sort_keys.size());
+  for (size_t c = 0; c < order.size(); c++) order[c] = c;
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return (sort_keys[a] > sort_keys[b]);
+  });
+
+  std::vector<uint32_t> output;
+  output.reserve(index_count);
+  for (uint32_t c : order) {
+    output.insert(output.end(), indices + clusters[c] * 3,
+                  indices + clusters[c + 1] * 3);
+  }
+  std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeVertexFetch(Vertex* vertices, uint32_t* indices,
+                         size_t index_count, size_t vertex_count) {
+  std::vector<uint32_t> remap(vertex_count, invalid_index);
+  std::vector<Vertex> reordered;
+  reordered.reserve(vertex_count);
+  for (size_t i = 0; i < index_count; i++) {
+    uint32_t v = indices[i];
+    if (remap[v] == invalid_index) {
+      remap[v] = static_cast<uint32_t>(reordered.size());
+      reordered.push_back(vertices[v]);
+    }
+    indices[i] = remap[v];
+  }
+  // Unreferenced vertices are kept at the end so the vertex count holds
+  for (size_t v = 0; v < vertex_count; v++) {
+    if (remap[v] == invalid_index) reordered.push_back(vertices[v]);
+  }
+  std::copy(reordered.begin(), reordered.end(), vertices);
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices,
+                                    size_t index_count, size_t vertex_count,
+                                    unsigned int cache_size) {
+  VertexCacheStats stats;
+  std::vector<uint32_t> misses =
+      simulateFifo(indices, index_count, vertex_count, cache_size);
+  for (uint32_t m : misses) stats.vertices_transformed += m;
+  stats.triangles = static_cast<uint32_t>(misses.size());
+  stats.vertices = static_cast<uint32_t>(vertex_count);
+  if (stats.triangles > 0) {
+    stats.acmr = static_cast<float>(stats.vertices_transformed) /
+                 static_cast<float>(stats.triangles);
+  }
+  if (stats.vertices > 0) {
+    stats.atvr = static_cast<float>(stats.vertices_transformed) /
+                 static_cast<float>(stats.vertices);
+  }
+  return (stats);
+}
+
+OverdrawStats analyzeOverdraw(const uint32_t* indices, size_t index_count,
+                              const Vertex* vertices, size_t vertex_count) {
+  OverdrawStats stats;
+  if (index_count < 3 || vertex_count == 0) return (stats);
+  glm::vec3 aabb_min = vertices[0].position;
+  glm::vec3 aabb_max = vertices[0].position;
+  for (size_t v = 1; v < vertex_count; v++) {
+    aabb_min = glm::min(aabb_min, vertices[v].position);
+    aabb_max = glm::max(aabb_max, vertices[v].position);
+  }
+  glm::vec3 extent = aabb_max - aabb_min;
+  float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+  if (max_extent <= 0.0f) return (stats);
+  float scale = static_cast<float>(OVERDRAW_GRID_SIZE) / max_extent;
+
+  std::vector<float> depth_buffer(OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE);
+  for (int axis = 0; axis < 3; axis++) {
+    int u_axis = (axis + 1) % 3;
+    int v_axis = (axis + 2) % 3;
+    for (float dir = 1.0f; dir >= -1.0f; dir -= 2.0f) {
+      std::fill(depth_buffer.begin(), depth_buffer.end(),
+                std::numeric_limits<float>::max());
+      for (size_t i = 0; i + 2 < index_count; i += 3) {
+        glm::vec3 p[3];
+        for (int k = 0; k < 3; k++) {
+          glm::vec3 position = vertices[indices[i + k]].position - aabb_min;
+          p[k] = glm::vec3(position[u_axis] * scale, position[v_axis] * scale,
+                           -dir * position[axis]);
+        }
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) -
+                     (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        // Backface culling, triangles facing away from the view are skipped
+        if (area * dir <= 0.0f) continue;
+        int min_x = std::max(0, static_cast<int>(std::floor(
+                                    std::min(p[0].x, std::min(p[1].x, p[2].x)))));
+        int min_y = std::max(0, static_cast<int>(std::floor(
+                                    std::min(p[0].y, std::min(p[1].y, p[2].y)))));
+        int max_x = std::min(OVERDRAW_GRID_SIZE - 1,
+                             static_cast<int>(std::ceil(std::max(
+                                 p[0].x, std::max(p[1].x, p[2].x)))));
+        int max_y = std::min(OVERDRAW_GRID_SIZE - 1,
+                             static_cast<int>(std::ceil(std::max(
+                                 p[0].y, std::max(p[1].y, p[2].y)))));
+        float inv_area = 1.0f / area;
+        for (int y = min_y; y <= max_y; y++) {
+          for (int x = min_x; x <= max_x; x++) {
+            float px = x + 0.5f;
+            float py = y + 0.5f;
+            float w0 = ((p[2].x - p[1].x) * (py - p[1].y) -
+                        (p[2].y - p[1].y) * (px - p[1].x)) *
+                       inv_area;
+            float w1 = ((p[0].x - p[2].x) * (py - p[2].y) -
+                        (p[0].y - p[2].y) * (px - p[2].x)) *
+                       inv_area;
+            float w2 = 1.0f - w0 - w1;
+            if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+            float depth = w0 * p[0].z + w1 * p[1].z + w2 * p[2].z;
+            float& stored = depth_buffer[y * OVERDRAW_GRID_SIZE + x];
+            if (depth < stored) {
+              stored = depth;
+              stats.pixels_shaded++;
+            }
+          }
+        }
+      }
+      for (float depth : depth_buffer) {
+        if (depth != std::numeric_limits<float>::max()) stats.pixels_covered++;
+      }
+    }
+  }
+  if (stats.pixels_covered > 0) {
+    stats.overdraw = static_cast<float>(stats.pixels_shaded) /
+                     static_cast<float>(stats.pixels_covered);
+  }
+  return (stats);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "forward.hpp"
+
+#define VERTEX_CACHE_SIZE 32  // LRU cache modelled by the reordering
+#define FIFO_CACHE_SIZE 16    // Post-transform FIFO used for the analysis
+#define OVERDRAW_THRESHOLD 1.05f
+#define OVERDRAW_GRID_SIZE 256
+
+struct VertexCacheStats {
+  uint32_t vertices_transformed = 0;
+  uint32_t triangles = 0;
+  uint32_t vertices = 0;
+  float acmr = 0.0f;  // transformed vertices per triangle
+  float atvr = 0.0f;  // transformed vertices per unique vertex
+};
+
+struct OverdrawStats {
+  uint64_t pixels_covered = 0;
+  uint64_t pixels_shaded = 0;
+  float overdraw = 0.0f;  // shaded pixels per covered pixel
+};
+
+// Forsyth's linear-speed vertex cache optimisation, reorders triangles
+void optimizeVertexCache(uint32_t* indices, size_t index_count,
+                         size_t vertex_count);
+// Splits the cache optimised triangle list into clusters and sorts them so
+// outward facing clusters are drawn first, keeps ACMR within threshold
+void optimizeOverdraw(uint32_t* indices, size_t index_count,
+                      const Vertex* vertices, size_t vertex_count,
+                      float threshold = OVERDRAW_THRESHOLD);
+// Reorders vertices in order of first use and remaps the indices
+void optimizeVertexFetch(Vertex* vertices, uint32_t* indices,
+                         size_t index_count, size_t vertex_count);
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices,
+                                    size_t index_count, size_t vertex_count,
+                                    unsigned int cache_size = FIFO_CACHE_SIZE);
+// Rasterizes the mesh from the 6 axis aligned directions with backface
+// culling and counts how many fragments pass the depth test
+OverdrawStats analyzeOverdraw(const uint32_t* indices, size_t index_count,
+                              const Vertex* vertices, size_t vertex_count);
@@ -0,0 +1,255 @@
+#include "mesh_simplifier.hpp"
+
+// Symmetric 4x4 matrix of the plane equations, only the upper half is kept
+struct Quadric {
+  double xx = 0, xy = 0, xz = 0, xw = 0;
+  double yy = 0, yz = 0, yw = 0;
+  double zz = 0, zw = 0;
+  double ww = 0;
+
+  void addPlane(double a, double b, double c, double d) {
+    xx += a * a, xy += a * b, xz += a * c, xw += a * d;
+    yy += b * b, yz += b * c, yw += b * d;
+    zz += c * c, zw += c * d;
+    ww += d * d;
+  }
+
+  void add(const Quadric& rhs) {
+    xx += rhs.xx, xy += rhs.xy, xz += rhs.xz, xw += rhs.xw;
+    yy += rhs.yy, yz += rhs.yz, yw += rhs.yw;
+    zz += rhs.zz, zw += rhs.zw;
+    ww += rhs.ww;
+  }
+
+  // Sum of the squared distances of p to the planes
+  double evaluate(const glm::vec3& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double result = x * x * xx + y * y * yy + z * z * zz + ww +
+                    2.0 * (x * y * xy + x * z * xz + y * z * yz + x * xw +
+                           y * yw + z * zw);
+    return (std::max(result, 0.0));
+  }
+};
+
+struct Collapse {
+  uint32_t from = 0;
+  uint32_t to = 0;
+  double cost = 0.0;
+};
+
+struct PositionHasher {
+  size_t operator()(const glm::vec3& p) const {
+    uint32_t bits[3];
+    std::memcpy(bits, &p, sizeof(bits));
+    return ((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^
+            (bits[2] * 83492791u));
+  }
+};
+
+struct PositionEqual {
+  bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+    return (a.x == b.x && a.y == b.y && a.z == b.z);
+  }
+};
+
+static glm::vec3 triangleNormal(const glm::vec3& p0, const glm::vec3& p1,
+                                const glm::vec3& p2) {
+  return (glm::cross(p1 - p0, p2 - p0));
+}
+
+// Vertices sharing a position with another vertex sit on a seam, and
+// vertices of an edge without its opposite half edge sit on a border
+static std::vector<uint8_t> findLockedVertices(const uint32_t* indices,
+                                               size_t index_count,
+                                               const Vertex* vertices,
+                                               size_t vertex_count) {
+  std::vector<uint8_t> locked(vertex_count, 0);
+  std::vector<uint32_t> position_ids(vertex_count);
+  std::unordered_map<glm::vec3, uint32_t, PositionHasher, PositionEqual>
+      positions;
+  positions.reserve(vertex_count);
+  for (uint32_t v = 0; v < vertex_count; v++) {
+    auto it = positions.insert({vertices[v].position, v});
+    position_ids[v] = it.first->second;
+    if (it.second == false) {
+      locked[v] = 1;
+      locked[it.first->second] = 1;
+    }
+  }
+  std::unordered_map<uint64_t, uint32_t> half_edges;
+  half_edges.reserve(index_count);
+  auto edgeKey = [&](uint32_t a, uint32_t b) {
+    return ((static_cast<uint64_t>(position_ids[a]) << 32) | position_ids[b]);
+  };
+  for (size_t i = 0; i < index_count; i += 3) {
+    for (int e = 0; e < 3; e++) {
+      half_edges[edgeKey(indices[i + e], indices[i + (e + 1) % 3])]++;
+    }
+  }
+  for (size_t i = 0; i < index_count; i += 3) {
+    for (int e = 0; e < 3; e++) {
+      uint32_t a = indices[i + e];
+      uint32_t b = indices[i + (e + 1) % 3];
+      if (half_edges.count(edgeKey(b, a)) == 0 ||
+          half_edges[edgeKey(a, b)] > 1) {
+        locked[a] = 1;
+        locked[b] = 1;
+      }
+    }
+  }
+  return (locked);
+}
+
+// Collapsing from into to must not fold any remaining triangle of from
+static bool flipsTriangles(const Collapse& collapse, const uint32_t* indices,
+                           const Vertex* vertices,
+                           const uint32_t* triangle_offsets,
+                           const uint32_t* triangles) {
+  glm::vec3 target = vertices[collapse.to].position;
+  for (uint32_t t = triangle_offsets[collapse.from];
+       t < triangle_offsets[collapse.from + 1]; t++) {
+    const uint32_t* triangle = indices + triangles[t] * 3;
+    if (triangle[0] == collapse.to || triangle[1] == collapse.to ||
+        triangle[2] == collapse.to) {
+      continue;
+    }
+    glm::vec3 p[3];
+    for (int c = 0; c < 3; c++) p[c] = vertices[triangle[c]].position;
+    glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+    for (int c = 0; c < 3; c++) {
+      if (triangle[c] == collapse.from) p[c] = target;
+    }
+    glm::vec3 after = triangleNormal(p[0], p[1], p[2]);
+    // Rotating a triangle by more than ~75 degrees is treated as a flip
+    if (glm::dot(before, after) <=
+        0.25f * glm::length(before) * glm::length(after)) {
+      return (true);
+    }
+  }
+  return (false);
+}
+
+std::vector<uint32_t> simplifyMesh(const uint32_t* indices, size_t index_count,
+                                   const Vertex* vertices, size_t vertex_count,
+                                   size_t target_index_count,
+                                   float target_error, float* result_error) {
+  std::vector<uint32_t> result(indices,
+                               indices + index_count - index_count % 3);
+  float max_error = 0.0f;
+  std::vector<uint8_t> locked =
+      findLockedVertices(result.data(), result.size(), vertices, vertex_count);
+
+  std::vector<Quadric> quadrics(vertex_count);
+  for (size_t i = 0; i < result.size(); i += 3) {
+    glm::vec3 p0 = vertices[result[i + 0]].position;
+    glm::vec3 normal =
+        triangleNormal(p0, vertices[result[i + 1]].position,
+                       vertices[result[i + 2]].position);
+    float length = glm::length(normal);
+    if (length == 0.0f) continue;
+    normal /= length;
+    double d = -glm::dot(normal, p0);
+    for (int c = 0; c < 3; c++) {
+      quadrics[result[i + c]].addPlane(normal.x, normal.y, normal.z, d);
+    }
+  }
+
+  double max_cost = static_cast<double>(target_error) * target_error;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> triangle_offsets(vertex_count + 1);
+  std::vector<uint32_t> triangles;
+  std::vector<uint32_t> remap(vertex_count);
+  std::vector<uint8_t> touched(vertex_count);
+  while (result.size() > target_index_count) {
+    // Every unlocked half edge is a collapse candidate, cheapest first
+    collapses.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int e = 0; e < 3; e++) {
+        Collapse collapse;
+        collapse.from = result[i + e];
+        collapse.to = result[i + (e + 1) % 3];
+        if (locked[collapse.from]) continue;
+        Quadric quadric = quadrics[collapse.from];
+        quadric.add(quadrics[collapse.to]);
+        collapse.cost = quadric.evaluate(vertices[collapse.to].position);
+        if (collapse.cost <= max_cost) collapses.push_back(collapse);
+      }
+    }
+    if (collapses.empty()) break;
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse& a, const Collapse& b) {
+                return (a.cost < b.cost);
+              });
+
+    // Triangles around each vertex, in compressed rows
+    std::fill(triangle_offsets.begin(), triangle_offsets.end(), 0);
+    for (uint32_t index : result) triangle_offsets[index + 1]++;
+    for (size_t v = 0; v < vertex_count; v++) {
+      triangle_offsets[v + 1] += triangle_offsets[v];
+    }
+    triangles.resize(result.size());
+    std::vector<uint32_t> cursors(triangle_offsets.begin(),
+                                  triangle_offsets.end() - 1);
+    for (size_t i = 0; i < result.size(); i++) {
+      triangles[cursors[result[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // Apply independent collapses, a vertex and its ring change once a pass
+    for (uint32_t v = 0; v < vertex_count; v++) remap[v] = v;
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t removable = (result.size() - target_index_count) / 3;
+    size_t removed = 0;
+    for (const auto& collapse : collapses) {
+      if (removed >= removable) break;
+      if (touched[collapse.from] || touched[collapse.to]) continue;
+      bool ring_touched = false;
+      for (uint32_t t = triangle_offsets[collapse.from];
+           t < triangle_offsets[collapse.from + 1]; t++) {
+        const uint32_t* triangle = result.data() + triangles[t] * 3;
+        for (int c = 0; c < 3; c++) ring_touched |= touched[triangle[c]] != 0;
+      }
+      if (ring_touched) continue;
+      if (flipsTriangles(collapse, result.data(), vertices,
+                         triangle_offsets.data(), triangles.data())) {
+        continue;
+      }
+      for (uint32_t t = triangle_offsets[collapse.from];
+           t < triangle_offsets[collapse.from + 1]; t++) {
+        const uint32_t* triangle = result.data() + triangles[t] * 3;
+        for (int c = 0; c < 3; c++) touched[triangle[c]] = 1;
+      }
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to].add(quadrics[collapse.from]);
+      max_error = std::max(max_error,
+                           static_cast<float>(std::sqrt(collapse.cost)));
+      removed += 2;
+    }
+    if (removed == 0) break;
+
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      uint32_t a = remap[result[i + 0]];
+      uint32_t b = remap[result[i + 1]];
+      uint32_t c = remap[result[i + 2]];
+      if (a == b || b == c || a == c) continue;
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+  }
+  if (result_error != nullptr) *result_error = max_error;
+  return (result);
+}
+
+int selectLod(const MeshLod* lods, int lod_count, float distance,
+              float proj_scale, int screen_height) {
+  if (distance <= 0.0f) return (0);
+  float pixels_per_unit = proj_scale * 0.5f * screen_height / distance;
+  for (int lod = lod_count - 1; lod > 0; lod--) {
+    if (lods[lod].error * pixels_per_unit <= MESH_LOD_PIXEL_ERROR) {
+      return (lod);
+    }
+  }
+  return (0);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include "forward.hpp"
+
+#define MESH_LOD_COUNT 4
+#define MESH_LOD_ERROR 0.01f       // Max collapse error, relative to the mesh
+#define MESH_LOD_PIXEL_ERROR 1.0f  // Max projected error of a selected LOD
+
+// Index range of a level of detail, all levels share the mesh vertices
+struct MeshLod {
+  uint32_t index_offset = 0;  // relative to the mesh first index
+  uint32_t index_count = 0;
+  uint32_t meshlet_offset = 0;  // relative to the mesh first meshlet
+  uint32_t meshlet_count = 0;
+  float error = 0.0f;  // object space deviation from the full mesh
+};
+
+// Quadric error edge collapse over the index buffer, vertices are never
+// moved so the result indexes the original vertex buffer. Border and uv or
+// normal seam vertices are locked to keep the mesh watertight.
+std::vector<uint32_t> simplifyMesh(const uint32_t* indices, size_t index_count,
+                                   const Vertex* vertices, size_t vertex_count,
+                                   size_t target_index_count,
+                                   float target_error, float* result_error);
+// Coarsest level whose error projects to less than MESH_LOD_PIXEL_ERROR
+// pixels, distance and error are in the same space
+int selectLod(const MeshLod* lods, int lod_count, float distance,
+              float proj_scale, int screen_height);
@@ -0,0 +1,122 @@
+#include "meshlet.hpp"
+
+std::vector<Meshlet> buildMeshlets(const uint32_t* indices, size_t index_count,
+                                   const Vertex* vertices,
+                                   size_t vertex_count) {
+  std::vector<Meshlet> meshlets;
+  // Last meshlet that referenced a vertex, avoids clearing a set per meshlet
+  std::vector<uint32_t> used(vertex_count,
+                             std::numeric_limits<uint32_t>::max());
+  Meshlet meshlet;
+  uint32_t meshlet_id = 0;
+  uint32_t meshlet_vertices = 0;
+  auto flush = [&](size_t end) {
+    meshlet.index_count = static_cast<uint32_t>(end) - meshlet.index_offset;
+    computeMeshletBounds(meshlet, indices, vertices);
+    meshlets.push_back(meshlet);
+    meshlet = Meshlet();
+    meshlet.index_offset = static_cast<uint32_t>(end);
+    meshlet_vertices = 0;
+    meshlet_id++;
+  };
+  for (size_t i = 0; i + 2 < index_count; i += 3) {
+    uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+    uint32_t new_vertices = (used[a] != meshlet_id ? 1 : 0) +
+                            (used[b] != meshlet_id && b != a ? 1 : 0) +
+                            (used[c] != meshlet_id && c != a && c != b ? 1 : 0);
+    uint32_t triangles = (static_cast<uint32_t>(i) - meshlet.index_offset) / 3;
+    if (meshlet_vertices + new_vertices > MESHLET_MAX_VERTICES ||
+        triangles == MESHLET_MAX_TRIANGLES) {
+      flush(i);
+    }
+    for (size_t j = 0; j < 3; j++) {
+      if (used[indices[i + j]] != meshlet_id) {
+        used[indices[i + j]] = meshlet_id;
+        meshlet_vertices++;
+      }
+    }
+  }
+  if (index_count - index_count % 3 > meshlet.index_offset) {
+    flush(index_count - index_count % 3);
+  }
+  return (meshlets);
+}
+
+void computeMeshletBounds(Meshlet& meshlet, const uint32_t* indices,
+                          const Vertex* vertices) {
+  const uint32_t* first = indices + meshlet.index_offset;
+  uint32_t count = meshlet.index_count;
+  if (count == 0) return;
+  // Ritter's bounding sphere, start from the two most distant extremes
+  glm::vec3 axis_min[3], axis_max[3];
+  for (int a = 0; a < 3; a++) {
+    axis_min[a] = axis_max[a] = vertices[first[0]].position;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 p = vertices[first[i]].position;
+    for (int a = 0; a < 3; a++) {
+      if (p[a] < axis_min[a][a]) axis_min[a] = p;
+      if (p[a] > axis_max[a][a]) axis_max[a] = p;
+    }
+  }
+  int widest = 0;
+  float widest_distance = -1.0f;
+  for (int a = 0; a < 3; a++) {
+    float distance = glm::dot(axis_max[a] - axis_min[a],
+                              axis_max[a] - axis_min[a]);
+    if (distance > widest_distance) {
+      widest_distance = distance;
+      widest = a;
+    }
+  }
+  glm::vec3 center = (axis_min[widest] + axis_max[widest]) * 0.5f;
+  float radius = std::sqrt(widest_distance) * 0.5f;
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 p = vertices[first[i]].position;
+    float distance = glm::length(p - center);
+    if (distance > radius) {
+      float new_radius = (radius + distance) * 0.5f;
+      center += (p - center) * ((new_radius - radius) / distance);
+      radius = new_radius;
+    }
+  }
+  meshlet.center = center;
+  meshlet.radius = radius;
+
+  // Normal cone from the average of the triangle normals
+  std::vector<glm::vec3> normals;
+  normals.reserve(count / 3);
+  glm::vec3 axis = glm::vec3(0.0f);
+  for (uint32_t i = 0; i + 2 < count; i += 3) {
+    glm::vec3 p0 = vertices[first[i + 0]].position;
+    glm::vec3 p1 = vertices[first[i + 1]].position;
+    glm::vec3 p2 = vertices[first[i + 2]].position;
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float length = glm::length(normal);
+    if (length > 0.0f) {
+      normals.push_back(normal / length);
+      axis += normal / length;
+    }
+  }
+  float axis_length = glm::length(axis);
+  meshlet.cone_axis = axis_length > 0.0f ? axis / axis_length : axis;
+  meshlet.cone_cutoff = 1.0f;
+  if (axis_length == 0.0f) return;
+  float min_dot = 1.0f;
+  for (const auto& normal : normals) {
+    min_dot = std::min(min_dot, glm::dot(normal, meshlet.cone_axis));
+  }
+  // Wider than a hemisphere, some triangle always faces the camera
+  if (min_dot <= 0.1f) return;
+  meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+bool isMeshletVisible(const Meshlet& meshlet, const Frustum& frustum,
+                      const glm::vec3& camera_position) {
+  if (frustum.intersectsSphere(meshlet.center, meshlet.radius) == false) {
+    return (false);
+  }
+  glm::vec3 view = meshlet.center - camera_position;
+  return (glm::dot(view, meshlet.cone_axis) <
+          meshlet.cone_cutoff * glm::length(view) + meshlet.radius);
+}
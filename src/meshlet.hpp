@@ -0,0 +1,31 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "forward.hpp"
+#include "frustum.hpp"
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Contiguous range of a mesh index buffer with its culling bounds
+struct Meshlet {
+  uint32_t index_offset = 0;  // relative to the mesh first index
+  uint32_t index_count = 0;
+  glm::vec3 center = {};
+  float radius = 0.0f;
+  glm::vec3 cone_axis = {};
+  float cone_cutoff = 1.0f;  // sine of the cone spread, 1 disables the test
+};
+
+// Splits the triangle list in order, so the cache optimised order is kept
+// and every meshlet can be drawn as a sub range of the index buffer
+std::vector<Meshlet> buildMeshlets(const uint32_t* indices, size_t index_count,
+                                   const Vertex* vertices,
+                                   size_t vertex_count);
+void computeMeshletBounds(Meshlet& meshlet, const uint32_t* indices,
+                          const Vertex* vertices);
+// Frustum and normal cone test, camera_position is in object space
+bool isMeshletVisible(const Meshlet& meshlet, const Frustum& frustum,
+                      const glm::vec3& camera_position);
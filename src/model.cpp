@@ -1,6 +1,8 @@
 #include "model.hpp"
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "obj_parser.hpp"
+#include "thread_pool.hpp"
 
 Mesh::Mesh() {}
 
@@ -13,7 +15,15 @@ Mesh::Mesh(Mesh const& src) { *this = src; }
 Mesh& Mesh::operator=(Mesh const& rhs) {
   if (this != &rhs) {
     indexCount = rhs.indexCount;
-    vertexOffset = rhs.indexCount;
+    indexOffset = rhs.indexOffset;
+    vertexCount = rhs.vertexCount;
+    vertexOffset = rhs.vertexOffset;
+    meshletCount = rhs.meshletCount;
+    meshletOffset = rhs.meshletOffset;
+    lodCount = rhs.lodCount;
+    instanceCount = rhs.instanceCount;
+    instanceOffset = rhs.instanceOffset;
+    std::copy(rhs.lods, rhs.lods + MESH_LOD_COUNT, lods);
     material = rhs.material;
     ambient_texname = rhs.ambient_texname;
     diffuse_texname = rhs.diffuse_texname;
@@ -38,27 +48,156 @@ Mesh& Mesh::operator=(Mesh const& rhs) {
   return (*this);
 }
 
+// Per corner streams of the bucketed faces, tangents are per face and summed
+// on the welded vertices
+struct FaceStreams {
+  FaceStreams(size_t face_count);
+
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> tangents;
+  std::vector<uint8_t> has_normals;
+};
+
+FaceStreams::FaceStreams(size_t face_count)
+    : positions(face_count * 3),
+      normals(face_count * 3),
+      uvs(face_count * 3),
+      tangents(face_count),
+      has_normals(face_count) {}
+
+// Batch kernels over the faces [begin, end), safe to run on disjoint ranges
+static void gatherFaces(const ObjData& obj, const uint32_t* faces,
+                        FaceStreams& streams, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    bool has_normals = false;
+    for (size_t j = 0; j < 3; j++) {
+      const ObjIndex& index = obj.indices[faces[i] * 3 + j];
+      size_t corner = i * 3 + j;
+      streams.positions[corner] = glm::vec3(0.0f);
+      streams.normals[corner] = glm::vec3(0.0f);
+      streams.uvs[corner] = glm::vec2(0.0f);
+      if (index.vertex_index != -1) {
+        const float* position = &obj.positions[3 * index.vertex_index];
+        streams.positions[corner] = {position[0], position[1], position[2]};
+      }
+      if (index.texcoord_index != -1) {
+        const float* uv = &obj.texcoords[2 * index.texcoord_index];
+        streams.uvs[corner] = {uv[0], uv[1]};
+      }
+      if (index.normal_index != -1) {
+        const float* normal = &obj.normals[3 * index.normal_index];
+        streams.normals[corner] =
+            glm::normalize(glm::vec3(normal[0], normal[1], normal[2]));
+        has_normals = true;
+      }
+    }
+    streams.has_normals[i] = has_normals ? 1 : 0;
+  }
+}
+
+static void computeFaceNormals(FaceStreams& streams, size_t begin,
+                               size_t end) {
+  const glm::vec3* p = streams.positions.data();
+  for (size_t i = begin; i < end; i++) {
+    if (streams.has_normals[i]) continue;
+    glm::vec3 normal = glm::normalize(
+        glm::cross(p[i * 3 + 2] - p[i * 3], p[i * 3 + 1] - p[i * 3]));
+    streams.normals[i * 3 + 0] = normal;
+    streams.normals[i * 3 + 1] = normal;
+    streams.normals[i * 3 + 2] = normal;
+  }
+}
+
+// Left unnormalized so that larger faces weigh more once summed, faces
+// without a uv gradient add nothing
+static void computeFaceTangents(FaceStreams& streams, size_t begin,
+                                size_t end) {
+  const glm::vec3* p = streams.positions.data();
+  const glm::vec2* uv = streams.uvs.data();
+  for (size_t i = begin; i < end; i++) {
+    glm::vec3 edge1 = p[i * 3 + 1] - p[i * 3];
+    glm::vec3 edge2 = p[i * 3 + 2] - p[i * 3];
+    glm::vec2 deltaUV1 = uv[i * 3 + 1] - uv[i * 3];
+    glm::vec2 deltaUV2 = uv[i * 3 + 2] - uv[i * 3];
+
+    float det = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+    streams.tangents[i] =
+        std::abs(det) < 1e-12f
+            ? glm::vec3(0.0f)
+            : (edge1 * deltaUV2.y - edge2 * deltaUV1.y) / det;
+  }
+}
+
+// Sum of the face tangents made orthogonal to the vertex normal
+static void finishTangents(std::vector<Vertex>& vertices) {
+  for (Vertex& vertex : vertices) {
+    glm::vec3 normal = vertex.normal;
+    glm::vec3 tangent =
+        vertex.tangent - normal * glm::dot(normal, vertex.tangent);
+    float length = glm::length(tangent);
+    vertex.tangent = length > 1e-12f ? tangent / length : perpendicular(normal);
+  }
+}
+
+Model::Model(void) {}
+
 Model::Model(const std::string filename) {
-  tinyobj::attrib_t attrib;
-  std::vector<tinyobj::shape_t> shapes;
-  std::vector<tinyobj::material_t> materials;
-  std::string err;
-  std::string basedir = getBaseDir(filename);
-  if (basedir.empty()) basedir = ".";
-  basedir += "/";
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed_ms = [](std::chrono::steady_clock::time_point since) {
+    return (std::chrono::duration<float, std::milli>(
+                std::chrono::steady_clock::now() - since)
+                .count());
+  };
+  uint64_t source_hash = hashModelSources(filename);
+  std::string cache_filename = filename + ".cache";
+  float hash_time = elapsed_ms(start);
+  if (source_hash != 0 &&
+      loadMeshCache(cache_filename, source_hash, *this)) {
+    std::cout << filename << ": cache hit in " << elapsed_ms(start)
+              << " ms (hash " << hash_time << " ms)" << std::endl;
+    return;
+  }
+  auto parse_start = std::chrono::steady_clock::now();
+  if (loadOBJ(filename) == false) return;
+  float parse_time = elapsed_ms(parse_start);
+  auto write_start = std::chrono::steady_clock::now();
+  if (source_hash != 0 &&
+      writeMeshCache(cache_filename, source_hash, *this) == false) {
+    std::cerr << "Cannot write mesh cache: " << cache_filename << std::endl;
+  }
+  std::cout << filename << ": parsed in " << parse_time << " ms (hash "
+            << hash_time << " ms, cache write " << elapsed_ms(write_start)
+            << " ms)" << std::endl;
+}
 
-  if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str(),
-                        basedir.c_str())) {
+bool Model::loadOBJ(const std::string& filename) {
+  ObjData obj;
+  if (parseOBJ(filename, obj) == false &&
+      parseOBJTinyobj(filename, obj) == false) {
     std::cerr << "Cannot load obj: " << filename.c_str() << std::endl;
-    return;
+    return (false);
+  }
+#if OBJ_PARSER_VALIDATE
+  ObjData reference;
+  if (parseOBJTinyobj(filename, reference)) {
+    std::cout << filename << ": native parser "
+              << (compareObjData(obj, reference) ? "matches" : "differs from")
+              << " tinyobjloader" << std::endl;
   }
+#endif
+  std::string basedir = getBaseDir(filename);
+  if (basedir.empty()) basedir = ".";
+  basedir += "/";
+  std::vector<ObjMaterial>& materials = obj.materials;
   if (materials.empty()) {
-    materials.push_back(tinyobj::material_t());
+    materials.push_back(ObjMaterial());
   }
   for (const auto& material : materials) {
     Mesh mesh(0, 0);
 
-    // Copy material from tinyobjloader material_t
+    // Copy material from the obj material library
     mesh.material.ambient = glm::vec4(material.ambient[0], material.ambient[1],
                                       material.ambient[2], 1.0f);
     mesh.material.diffuse = glm::vec4(material.diffuse[0], material.diffuse[1],
@@ -110,93 +249,442 @@ Model::Model(const std::string filename) {
     meshes.push_back(mesh);
   }
 
-  struct Face {
-    Vertex vertices[3] = {{}};
-    int32_t material_id = 0;
+  // Repeated groups keep the faces of their first occurrence, which go to
+  // a mesh of their own per material drawn once per instance
+  size_t material_count = materials.size();
+  auto faceMaterial = [&obj, material_count](size_t f) {
+    int material_id = obj.material_ids[f];
+    if (material_id < 0 || material_id >= static_cast<int>(material_count)) {
+      material_id = 0;
+    }
+    return (static_cast<size_t>(material_id));
   };
+  size_t face_total = obj.material_ids.size();
+  std::vector<int> face_buckets(face_total);
+  for (size_t f = 0; f < face_total; f++) {
+    face_buckets[f] = static_cast<int>(faceMaterial(f));
+  }
+  std::vector<ObjInstances> obj_instances = findObjInstances(obj);
+  size_t dropped_faces = 0;
+  for (const auto& group : obj_instances) {
+    uint32_t instance_offset = static_cast<uint32_t>(instances.size());
+    instances.insert(instances.end(), group.transforms.begin(),
+                     group.transforms.end());
+    std::map<size_t, int> material_buckets;
+    for (uint32_t f = group.prototype.first;
+         f < group.prototype.first + group.prototype.count; f++) {
+      size_t material_id = faceMaterial(f);
+      auto it = material_buckets.find(material_id);
+      if (it == material_buckets.end()) {
+        it = material_buckets
+                 .insert({material_id, static_cast<int>(meshes.size())})
+                 .first;
+        Mesh mesh = meshes[material_id];
+        mesh.instanceCount = static_cast<uint32_t>(group.transforms.size());
+        mesh.instanceOffset = instance_offset;
+        meshes.push_back(mesh);
+      }
+      face_buckets[f] = it->second;
+    }
+    for (const auto& duplicate : group.duplicates) {
+      for (uint32_t f = duplicate.first; f < duplicate.first + duplicate.count;
+           f++) {
+        face_buckets[f] = -1;
+      }
+      dropped_faces += duplicate.count;
+    }
+  }
+  if (obj_instances.empty() == false) {
+    std::cout << filename << ": " << obj_instances.size()
+              << " instanced groups, " << dropped_faces
+              << " duplicated triangles dropped" << std::endl;
+  }
 
-  std::vector<Face> faceList;
-  for (const auto& shape : shapes) {
-    for (size_t f = 0; f < shape.mesh.indices.size() / 3; f++) {
-      Face face;
-
-      int material_id;
-      material_id =
-          f < shape.mesh.material_ids.size() ? shape.mesh.material_ids[f] : 0;
-      if (material_id == -1) material_id = 0;
-      face.material_id = material_id;
-      bool normalNeeded = true;
-      for (size_t j = 0; j < 3; j++) {
-        int vertex_index = shape.mesh.indices[(f * 3) + j].vertex_index;
-        int normal_index = shape.mesh.indices[(f * 3) + j].normal_index;
-        int texcoord_index = shape.mesh.indices[(f * 3) + j].texcoord_index;
-
-        if (vertex_index != -1) {
-          face.vertices[j].position = {attrib.vertices[3 * vertex_index + 0],
-                                       attrib.vertices[3 * vertex_index + 1],
-                                       attrib.vertices[3 * vertex_index + 2]};
-        }
-        if (texcoord_index != -1) {
-          face.vertices[j].uv = {attrib.texcoords[2 * texcoord_index + 0],
-                                 attrib.texcoords[2 * texcoord_index + 1]};
+  // Bucket faces by mesh in one counting sort pass
+  size_t bucket_count = meshes.size();
+  std::vector<size_t> bucket_offsets(bucket_count + 1, 0);
+  for (size_t f = 0; f < face_total; f++) {
+    if (face_buckets[f] >= 0) bucket_offsets[face_buckets[f] + 1]++;
+  }
+  for (size_t m = 0; m < bucket_count; m++) {
+    bucket_offsets[m + 1] += bucket_offsets[m];
+  }
+  size_t face_count = bucket_offsets[bucket_count];
+  std::vector<uint32_t> faces(face_count);
+  std::vector<size_t> cursors(bucket_offsets.begin(), bucket_offsets.end() - 1);
+  for (size_t f = 0; f < face_total; f++) {
+    if (face_buckets[f] >= 0) {
+      faces[cursors[face_buckets[f]]++] = static_cast<uint32_t>(f);
+    }
+  }
+
+  // Gather the corners in bucket order as separate streams, then run the
+  // normal and tangent kernels over them
+  ThreadPool& pool = ThreadPool::shared();
+  FaceStreams streams(face_count);
+  pool.parallelFor(face_count, 4096, [&](size_t begin, size_t end) {
+    gatherFaces(obj, faces.data(), streams, begin, end);
+  });
+  pool.parallelFor(face_count, 4096, [&](size_t begin, size_t end) {
+    computeFaceNormals(streams, begin, end);
+  });
+  pool.parallelFor(face_count, 4096, [&](size_t begin, size_t end) {
+    computeFaceTangents(streams, begin, end);
+  });
+
+  // Weld every bucket into its own vertex and index buffer on position,
+  // normal and uv, tangents are then shared by the faces of each vertex
+  std::vector<std::vector<Vertex>> mesh_vertices(bucket_count);
+  std::vector<std::vector<uint32_t>> mesh_indices(bucket_count);
+  pool.parallelFor(bucket_count, 1, [&](size_t begin, size_t end) {
+    std::vector<Vertex> corners;
+    for (size_t m = begin; m < end; m++) {
+      size_t first = bucket_offsets[m] * 3;
+      size_t count = (bucket_offsets[m + 1] - bucket_offsets[m]) * 3;
+      corners.resize(count);
+      for (size_t c = 0; c < count; c++) {
+        corners[c].position = streams.positions[first + c];
+        corners[c].normal = streams.normals[first + c];
+        corners[c].uv = streams.uvs[first + c];
+        corners[c].tangent = glm::vec3(0.0f);
+      }
+      weldVertices(corners.data(), count, mesh_vertices[m], mesh_indices[m]);
+      for (size_t c = 0; c < count; c++) {
+        mesh_vertices[m][mesh_indices[m][c]].tangent +=
+            streams.tangents[(first + c) / 3];
+      }
+      finishTangents(mesh_vertices[m]);
+      computeAABB(mesh_vertices[m].data(), mesh_vertices[m].size(),
+                  meshes[m].aabb_center, meshes[m].aabb_halfsize);
+    }
+  });
+  size_t vertex_total = 0;
+  size_t index_total = 0;
+  for (size_t m = 0; m < bucket_count; m++) {
+    meshes[m].vertexOffset = static_cast<int32_t>(vertex_total);
+    meshes[m].vertexCount = static_cast<uint32_t>(mesh_vertices[m].size());
+    meshes[m].indexOffset = static_cast<uint32_t>(index_total);
+    meshes[m].indexCount = static_cast<uint32_t>(mesh_indices[m].size());
+    vertex_total += mesh_vertices[m].size();
+    index_total += mesh_indices[m].size();
+  }
+  vertices.resize(vertex_total);
+  indices.resize(index_total);
+  pool.parallelFor(bucket_count, 1, [&](size_t begin, size_t end) {
+    for (size_t m = begin; m < end; m++) {
+      std::copy(mesh_vertices[m].begin(), mesh_vertices[m].end(),
+                vertices.begin() + meshes[m].vertexOffset);
+      std::copy(mesh_indices[m].begin(), mesh_indices[m].end(),
+                indices.begin() + meshes[m].indexOffset);
+    }
+  });
+  std::cout << filename << ": welded " << indices.size() << " corners into "
+            << vertices.size() << " vertices" << std::endl;
+  splitMeshes(filename);
+  optimizeMeshes(filename);
+  generateLods(filename);
+  generateMeshlets(filename);
+
+  // Vertex fetch reordering keeps the vertex set, merge the mesh bounds
+  glm::vec3 aabb_min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 aabb_max = glm::vec3(-std::numeric_limits<float>::max());
+  for (const auto& mesh : meshes) {
+    if (mesh.vertexCount == 0) continue;
+    for (uint32_t i = 0; i < std::max(mesh.instanceCount, 1u); i++) {
+      glm::vec3 center = mesh.aabb_center;
+      glm::vec3 halfsize = mesh.aabb_halfsize;
+      if (mesh.instanceCount > 0) {
+        transformAABB(instances[mesh.instanceOffset + i], center, halfsize);
+      }
+      aabb_min = glm::min(aabb_min, center - halfsize);
+      aabb_max = glm::max(aabb_max, center + halfsize);
+    }
+  }
+  if (vertices.empty()) aabb_min = aabb_max = glm::vec3(0.0f);
+  aabb_center = (aabb_min + aabb_max) * 0.5f;
+  aabb_halfsize = (aabb_max - aabb_min) * 0.5f;
+  return (true);
+}
+
+// Median split along the longest axis of the centroid bounds until every leaf
+// holds at most max_triangles, triangles are reordered so that leaves are
+// contiguous and the returned offsets delimit them
+static std::vector<uint32_t> splitTriangles(const uint32_t* indices,
+                                            size_t triangle_count,
+                                            const Vertex* vertices,
+                                            size_t max_triangles,
+                                            std::vector<uint32_t>& triangles) {
+  std::vector<glm::vec3> centroids(triangle_count);
+  triangles.resize(triangle_count);
+  for (size_t t = 0; t < triangle_count; t++) {
+    const uint32_t* triangle = indices + t * 3;
+    centroids[t] = (vertices[triangle[0]].position +
+                    vertices[triangle[1]].position +
+                    vertices[triangle[2]].position) /
+                   3.0f;
+    triangles[t] = static_cast<uint32_t>(t);
+  }
+  std::vector<uint32_t> leaf_offsets;
+  std::vector<std::pair<size_t, size_t>> stack;
+  stack.push_back({0, triangle_count});
+  while (stack.empty() == false) {
+    size_t first = stack.back().first;
+    size_t last = stack.back().second;
+    stack.pop_back();
+    if (last - first <= max_triangles) {
+      // Left halves are popped first, leaves come out in triangle order
+      leaf_offsets.push_back(static_cast<uint32_t>(first));
+      continue;
+    }
+    glm::vec3 bounds_min = centroids[triangles[first]];
+    glm::vec3 bounds_max = bounds_min;
+    for (size_t t = first + 1; t < last; t++) {
+      bounds_min = glm::min(bounds_min, centroids[triangles[t]]);
+      bounds_max = glm::max(bounds_max, centroids[triangles[t]]);
+    }
+    glm::vec3 extent = bounds_max - bounds_min;
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+    size_t middle = first + (last - first) / 2;
+    std::nth_element(triangles.begin() + first, triangles.begin() + middle,
+                     triangles.begin() + last, [&](uint32_t a, uint32_t b) {
+                       return (centroids[a][axis] < centroids[b][axis]);
+                     });
+    stack.push_back({middle, last});
+    stack.push_back({first, middle});
+  }
+  leaf_offsets.push_back(static_cast<uint32_t>(triangle_count));
+  return (leaf_offsets);
+}
+
+void Model::splitMeshes(const std::string& filename) {
+  if (MESH_CHUNK_TRIANGLES == 0) return;
+  size_t mesh_count = meshes.size();
+  std::vector<std::vector<Mesh>> mesh_chunks(mesh_count);
+  std::vector<std::vector<Vertex>> chunk_vertices(mesh_count);
+  std::vector<std::vector<uint32_t>> chunk_indices(mesh_count);
+  ThreadPool::shared().parallelFor(mesh_count, 1, [&](size_t begin,
+                                                      size_t end) {
+    std::vector<uint32_t> triangles;
+    std::vector<uint32_t> remap;
+    for (size_t m = begin; m < end; m++) {
+      const Mesh& mesh = meshes[m];
+      const uint32_t* mesh_indices = indices.data() + mesh.indexOffset;
+      const Vertex* mesh_vertices = vertices.data() + mesh.vertexOffset;
+      std::vector<uint32_t> leaf_offsets =
+          splitTriangles(mesh_indices, mesh.indexCount / 3, mesh_vertices,
+                         MESH_CHUNK_TRIANGLES, triangles);
+      remap.assign(mesh.vertexCount, std::numeric_limits<uint32_t>::max());
+      std::vector<Vertex>& out_vertices = chunk_vertices[m];
+      std::vector<uint32_t>& out_indices = chunk_indices[m];
+      // Every chunk gets its own copy of the vertices it references
+      for (size_t leaf = 0; leaf + 1 < leaf_offsets.size(); leaf++) {
+        Mesh chunk = mesh;
+        chunk.vertexOffset = static_cast<int32_t>(out_vertices.size());
+        chunk.indexOffset = static_cast<uint32_t>(out_indices.size());
+        for (uint32_t t = leaf_offsets[leaf]; t < leaf_offsets[leaf + 1];
+             t++) {
+          for (int c = 0; c < 3; c++) {
+            uint32_t index = mesh_indices[triangles[t] * 3 + c];
+            if (remap[index] == std::numeric_limits<uint32_t>::max()) {
+              remap[index] =
+                  static_cast<uint32_t>(out_vertices.size()) -
+                  static_cast<uint32_t>(chunk.vertexOffset);
+              out_vertices.push_back(mesh_vertices[index]);
+            }
+            out_indices.push_back(remap[index]);
+          }
         }
-        if (normal_index != -1) {
-          face.vertices[j].normal = {attrib.normals[3 * normal_index + 0],
-                                     attrib.normals[3 * normal_index + 1],
-                                     attrib.normals[3 * normal_index + 2]};
-          face.vertices[j].normal = glm::normalize(face.vertices[j].normal);
-          normalNeeded = false;
+        chunk.vertexCount = static_cast<uint32_t>(out_vertices.size()) -
+                            static_cast<uint32_t>(chunk.vertexOffset);
+        chunk.indexCount =
+            static_cast<uint32_t>(out_indices.size()) - chunk.indexOffset;
+        for (uint32_t t = leaf_offsets[leaf]; t < leaf_offsets[leaf + 1];
+             t++) {
+          for (int c = 0; c < 3; c++) {
+            remap[mesh_indices[triangles[t] * 3 + c]] =
+                std::numeric_limits<uint32_t>::max();
+          }
         }
+        computeAABB(out_vertices.data() + chunk.vertexOffset,
+                    chunk.vertexCount, chunk.aabb_center, chunk.aabb_halfsize);
+        mesh_chunks[m].push_back(chunk);
       }
-      if (normalNeeded) {
-        glm::vec3 normal = glm::normalize(
-            glm::cross(face.vertices[2].position - face.vertices[0].position,
-                       face.vertices[1].position - face.vertices[0].position));
-        face.vertices[0].normal = normal;
-        face.vertices[1].normal = normal;
-        face.vertices[2].normal = normal;
+    }
+  });
+  std::vector<Mesh> chunks;
+  vertices.clear();
+  indices.clear();
+  for (size_t m = 0; m < mesh_count; m++) {
+    for (auto chunk : mesh_chunks[m]) {
+      chunk.vertexOffset += static_cast<int32_t>(vertices.size());
+      chunk.indexOffset += static_cast<uint32_t>(indices.size());
+      chunks.push_back(chunk);
+    }
+    vertices.insert(vertices.end(), chunk_vertices[m].begin(),
+                    chunk_vertices[m].end());
+    indices.insert(indices.end(), chunk_indices[m].begin(),
+                   chunk_indices[m].end());
+  }
+  std::cout << filename << ": split " << mesh_count << " meshes into "
+            << chunks.size() << " chunks, " << vertices.size()
+            << " vertices" << std::endl;
+  meshes = chunks;
+}
+
+void Model::optimizeMeshes(const std::string& filename) {
+  VertexCacheStats cache_before, cache_after;
+  OverdrawStats overdraw_before, overdraw_after;
+  auto accumulate = [](VertexCacheStats& total, const VertexCacheStats& mesh) {
+    total.vertices_transformed += mesh.vertices_transformed;
+    total.triangles += mesh.triangles;
+    total.vertices += mesh.vertices;
+  };
+  auto accumulateOverdraw = [](OverdrawStats& total,
+                               const OverdrawStats& mesh) {
+    total.pixels_covered += mesh.pixels_covered;
+    total.pixels_shaded += mesh.pixels_shaded;
+  };
+  size_t mesh_count = meshes.size();
+  std::vector<VertexCacheStats> caches_before(mesh_count),
+      caches_after(mesh_count);
+  std::vector<OverdrawStats> overdraws_before(mesh_count),
+      overdraws_after(mesh_count);
+  // Meshes own disjoint vertex and index ranges
+  ThreadPool::shared().parallelFor(mesh_count, 1, [&](size_t begin,
+                                                      size_t end) {
+    for (size_t m = begin; m < end; m++) {
+      const Mesh& mesh = meshes[m];
+      uint32_t* mesh_indices = indices.data() + mesh.indexOffset;
+      Vertex* mesh_vertices = vertices.data() + mesh.vertexOffset;
+      caches_before[m] =
+          analyzeVertexCache(mesh_indices, mesh.indexCount, mesh.vertexCount);
+      overdraws_before[m] = analyzeOverdraw(mesh_indices, mesh.indexCount,
+                                            mesh_vertices, mesh.vertexCount);
+
+      optimizeVertexCache(mesh_indices, mesh.indexCount, mesh.vertexCount);
+      optimizeOverdraw(mesh_indices, mesh.indexCount, mesh_vertices,
+                       mesh.vertexCount);
+      optimizeVertexFetch(mesh_vertices, mesh_indices, mesh.indexCount,
+                          mesh.vertexCount);
+
+      caches_after[m] =
+          analyzeVertexCache(mesh_indices, mesh.indexCount, mesh.vertexCount);
+      overdraws_after[m] = analyzeOverdraw(mesh_indices, mesh.indexCount,
+                                           mesh_vertices, mesh.vertexCount);
+    }
+  });
+  for (size_t m = 0; m < mesh_count; m++) {
+    accumulate(cache_before, caches_before[m]);
+    accumulate(cache_after, caches_after[m]);
+    accumulateOverdraw(overdraw_before, overdraws_before[m]);
+    accumulateOverdraw(overdraw_after, overdraws_after[m]);
+  }
+  auto ratio = [](float a, float b) { return (b > 0.0f ? a / b : 0.0f); };
+  std::cout << filename << ": ACMR "
+            << ratio(cache_before.vertices_transformed, cache_before.triangles)
+            << " -> "
+            << ratio(cache_after.vertices_transformed, cache_after.triangles)
+            << ", ATVR "
+            << ratio(cache_before.vertices_transformed, cache_before.vertices)
+            << " -> "
+            << ratio(cache_after.vertices_transformed, cache_after.vertices)
+            << ", overdraw "
+            << ratio(overdraw_before.pixels_shaded,
+                     overdraw_before.pixels_covered)
+            << " -> "
+            << ratio(overdraw_after.pixels_shaded,
+                     overdraw_after.pixels_covered)
+            << std::endl;
+}
+
+void Model::generateLods(const std::string& filename) {
+  std::vector<std::vector<uint32_t>> mesh_indices(meshes.size());
+  ThreadPool::shared().parallelFor(meshes.size(), 1, [&](size_t begin,
+                                                         size_t end) {
+    for (size_t m = begin; m < end; m++) {
+      Mesh& mesh = meshes[m];
+      const Vertex* mesh_vertices = vertices.data() + mesh.vertexOffset;
+      std::vector<uint32_t>& lod_indices = mesh_indices[m];
+      lod_indices.assign(indices.begin() + mesh.indexOffset,
+                         indices.begin() + mesh.indexOffset + mesh.indexCount);
+      mesh.lodCount = 1;
+      mesh.lods[0] = MeshLod();
+      mesh.lods[0].index_count = mesh.indexCount;
+      float target_error = MESH_LOD_ERROR * glm::length(mesh.aabb_halfsize);
+      for (int lod = 1; lod < MESH_LOD_COUNT; lod++) {
+        const MeshLod& previous = mesh.lods[lod - 1];
+        float error = 0.0f;
+        std::vector<uint32_t> simplified = simplifyMesh(
+            lod_indices.data() + previous.index_offset, previous.index_count,
+            mesh_vertices, mesh.vertexCount, previous.index_count / 6 * 3,
+            target_error, &error);
+        // Stop once a level saves less than a fifth of the triangles
+        if (simplified.size() * 5 > previous.index_count * 4) break;
+        optimizeVertexCache(simplified.data(), simplified.size(),
+                            mesh.vertexCount);
+        MeshLod& level = mesh.lods[lod];
+        level = MeshLod();
+        level.index_offset = static_cast<uint32_t>(lod_indices.size());
+        level.index_count = static_cast<uint32_t>(simplified.size());
+        level.error = previous.error + error;
+        lod_indices.insert(lod_indices.end(), simplified.begin(),
+                           simplified.end());
+        mesh.lodCount++;
       }
+    }
+  });
+  // Every level is appended after the full mesh in its index range
+  indices.clear();
+  size_t lod_triangles[MESH_LOD_COUNT] = {};
+  for (size_t m = 0; m < meshes.size(); m++) {
+    meshes[m].indexOffset = static_cast<uint32_t>(indices.size());
+    meshes[m].indexCount = static_cast<uint32_t>(mesh_indices[m].size());
+    indices.insert(indices.end(), mesh_indices[m].begin(),
+                   mesh_indices[m].end());
+    for (uint32_t lod = 0; lod < MESH_LOD_COUNT; lod++) {
+      uint32_t level = std::min(lod, meshes[m].lodCount - 1);
+      lod_triangles[lod] += meshes[m].lods[level].index_count / 3;
+    }
+  }
+  std::cout << filename << ": LOD triangles";
+  for (size_t lod_triangle : lod_triangles) {
+    std::cout << " " << lod_triangle;
+  }
+  std::cout << std::endl;
+}
 
-      glm::vec3 edge1 = face.vertices[1].position - face.vertices[0].position;
-      glm::vec3 edge2 = face.vertices[2].position - face.vertices[0].position;
-      glm::vec2 deltaUV1 = face.vertices[1].uv - face.vertices[0].uv;
-      glm::vec2 deltaUV2 = face.vertices[2].uv - face.vertices[0].uv;
-
-      float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-      glm::vec3 tangent;
-      tangent.x = r * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-      tangent.y = r * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-      tangent.z = r * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-      tangent = glm::normalize(tangent);
-      face.vertices[0].tangent = tangent;
-      face.vertices[1].tangent = tangent;
-      face.vertices[2].tangent = tangent;
-
-      faceList.push_back(face);
-    }
-  }
-  // Sort vertices by material
-  for (size_t material_id = 0; material_id < materials.size(); material_id++) {
-    int vertexCount = 0;
-    meshes[material_id].vertexOffset = vertices.size();
-    for (const auto& face : faceList) {
-      if (face.material_id == material_id) {
-        vertices.push_back(face.vertices[0]);
-        vertices.push_back(face.vertices[1]);
-        vertices.push_back(face.vertices[2]);
-        indices.push_back(indices.size());
-        indices.push_back(indices.size());
-        indices.push_back(indices.size());
-        vertexCount += 3;
+void Model::generateMeshlets(const std::string& filename) {
+  std::vector<std::vector<Meshlet>> mesh_meshlets(meshes.size());
+  ThreadPool::shared().parallelFor(meshes.size(), 1, [&](size_t begin,
+                                                         size_t end) {
+    for (size_t m = begin; m < end; m++) {
+      Mesh& mesh = meshes[m];
+      for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+        MeshLod& level = mesh.lods[lod];
+        std::vector<Meshlet> lod_meshlets = buildMeshlets(
+            indices.data() + mesh.indexOffset + level.index_offset,
+            level.index_count, vertices.data() + mesh.vertexOffset,
+            mesh.vertexCount);
+        level.meshlet_offset = static_cast<uint32_t>(mesh_meshlets[m].size());
+        level.meshlet_count = static_cast<uint32_t>(lod_meshlets.size());
+        for (auto& meshlet : lod_meshlets) {
+          meshlet.index_offset += level.index_offset;
+          mesh_meshlets[m].push_back(meshlet);
+        }
       }
     }
-    meshes[material_id].indexCount = vertexCount;
-    computeAABB(&vertices[meshes[material_id].vertexOffset], vertexCount,
-                meshes[material_id].aabb_center,
-                meshes[material_id].aabb_halfsize);
+  });
+  meshlets.clear();
+  for (size_t m = 0; m < meshes.size(); m++) {
+    meshes[m].meshletOffset = static_cast<uint32_t>(meshlets.size());
+    meshes[m].meshletCount = static_cast<uint32_t>(mesh_meshlets[m].size());
+    meshlets.insert(meshlets.end(), mesh_meshlets[m].begin(),
+                    mesh_meshlets[m].end());
   }
-  computeAABB(vertices.data(), vertices.size(), aabb_center, aabb_halfsize);
+  std::cout << filename << ": " << meshlets.size() << " meshlets"
+            << std::endl;
 }
 
 Model::~Model() {}
@@ -208,17 +696,35 @@ Model& Model::operator=(Model const& rhs) {
     vertices = rhs.vertices;
     indices = rhs.indices;
     meshes = rhs.meshes;
+    meshlets = rhs.meshlets;
+    instances = rhs.instances;
     aabb_center = rhs.aabb_center;
     aabb_halfsize = rhs.aabb_halfsize;
   }
   return (*this);
 }
 
+void transformAABB(const glm::mat4& transform, glm::vec3& aabb_center,
+                   glm::vec3& aabb_halfsize) {
+  glm::vec3 halfsize = aabb_halfsize;
+  aabb_center = glm::vec3(transform * glm::vec4(aabb_center, 1.0f));
+  for (int i = 0; i < 3; i++) {
+    aabb_halfsize[i] = std::fabs(transform[0][i]) * halfsize.x +
+                       std::fabs(transform[1][i]) * halfsize.y +
+                       std::fabs(transform[2][i]) * halfsize.z;
+  }
+}
+
 void computeAABB(Vertex* vertices, size_t vertices_count,
                  glm::vec3& aabb_center, glm::vec3& aabb_halfsize) {
-  glm::vec3 aabb_min = glm::vec3(0.0f);
-  glm::vec3 aabb_max = glm::vec3(0.0f);
-  for (size_t i = 0; i < vertices_count; i++) {
+  if (vertices_count == 0) {
+    aabb_center = glm::vec3(0.0f);
+    aabb_halfsize = glm::vec3(0.0f);
+    return;
+  }
+  glm::vec3 aabb_min = vertices[0].position;
+  glm::vec3 aabb_max = vertices[0].position;
+  for (size_t i = 1; i < vertices_count; i++) {
     glm::vec3 vertex_position = vertices[i].position;
     if (vertex_position.x < aabb_min.x) aabb_min.x = vertex_position.x;
     if (vertex_position.x > aabb_max.x) aabb_max.x = vertex_position.x;
@@ -231,6 +737,38 @@ void computeAABB(Vertex* vertices, size_t vertices_count,
   aabb_halfsize = (aabb_max - aabb_min) * 0.5f;
 }
 
+glm::vec3 perpendicular(const glm::vec3& normal) {
+  glm::vec3 axis = std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                             : glm::vec3(1.0f, 0.0f, 0.0f);
+  return (glm::normalize(axis - normal * glm::dot(normal, axis)));
+}
+
+void weldVertices(const Vertex* corners, size_t corners_count,
+                  std::vector<Vertex>& vertices,
+                  std::vector<uint32_t>& indices) {
+  const uint32_t empty_slot = std::numeric_limits<uint32_t>::max();
+  size_t base = vertices.size();
+  size_t table_size = 1;
+  while (table_size < corners_count * 2) table_size <<= 1;
+  // Open addressing with linear probing, slots store the welded vertex index
+  std::vector<uint32_t> table(table_size, empty_slot);
+  vertices.reserve(base + corners_count);
+  indices.reserve(indices.size() + corners_count);
+  for (size_t i = 0; i < corners_count; i++) {
+    size_t slot = io::hash(&corners[i], sizeof(Vertex)) & (table_size - 1);
+    while (table[slot] != empty_slot &&
+           std::memcmp(&vertices[base + table[slot]], &corners[i],
+                       sizeof(Vertex)) != 0) {
+      slot = (slot + 1) & (table_size - 1);
+    }
+    if (table[slot] == empty_slot) {
+      table[slot] = static_cast<uint32_t>(vertices.size() - base);
+      vertices.push_back(corners[i]);
+    }
+    indices.push_back(table[slot]);
+  }
+}
+
 std::string sanitizeFilename(std::string filename) {
   std::replace(filename.begin(), filename.end(), '\\', '/');
   return (filename);
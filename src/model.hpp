@@ -1,10 +1,18 @@
 #pragma once
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <limits>
 #include <string>
 #include <vector>
 #include "forward.hpp"
+#include "instancing.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet.hpp"
+
+// Material meshes are split in spatial chunks of at most this many triangles
+// so that whole chunks can be frustum culled, 0 keeps one mesh per material
+#define MESH_CHUNK_TRIANGLES 16384
 
 class Mesh {
  public:
@@ -13,8 +21,16 @@ class Mesh {
   Mesh(Mesh const& src);
   Mesh& operator=(Mesh const& rhs);
 
-  uint32_t indexCount = 0;   // vertices count
+  uint32_t indexCount = 0;   // indices count
+  uint32_t indexOffset = 0;  // offset in index array
+  uint32_t vertexCount = 0;  // unique vertices count
   int32_t vertexOffset = 0;  // offset in vertex array
+  uint32_t meshletCount = 0;
+  uint32_t meshletOffset = 0;  // offset in meshlet array
+  uint32_t lodCount = 0;
+  MeshLod lods[MESH_LOD_COUNT];  // lods[0] is the full mesh
+  uint32_t instanceCount = 0;    // 0 for a mesh drawn once
+  uint32_t instanceOffset = 0;   // offset in instance array
 
   std::string ambient_texname;
   std::string diffuse_texname;
@@ -43,6 +59,7 @@ class Mesh {
 
 class Model {
  public:
+  Model(void);  // Empty, filled by the caller, see readMeshCache
   Model(const std::string filename);
   ~Model();
   Model(Model const& src);
@@ -51,13 +68,32 @@ class Model {
   std::vector<Vertex> vertices;
   std::vector<uint32_t> indices;
   std::vector<Mesh> meshes;
+  std::vector<Meshlet> meshlets;
+  std::vector<glm::mat4> instances;
 
   glm::vec3 aabb_center;
   glm::vec3 aabb_halfsize;
+
+ private:
+  bool loadOBJ(const std::string& filename);
+  void splitMeshes(const std::string& filename);
+  void optimizeMeshes(const std::string& filename);
+  void generateLods(const std::string& filename);
+  void generateMeshlets(const std::string& filename);
 };
 
 void computeAABB(Vertex* vertices, size_t vertices_count,
                  glm::vec3& aabb_center, glm::vec3& aabb_halfsize);
+// Bounds of the transformed box, the center and half size are updated
+void transformAABB(const glm::mat4& transform, glm::vec3& aabb_center,
+                   glm::vec3& aabb_halfsize);
+// Unit vector orthogonal to a unit normal, tangent of faces without uv
+glm::vec3 perpendicular(const glm::vec3& normal);
+// Append the unique vertices of corners and one index per corner, indices are
+// relative to the first appended vertex
+void weldVertices(const Vertex* corners, size_t corners_count,
+                  std::vector<Vertex>& vertices,
+                  std::vector<uint32_t>& indices);
 
 std::string sanitizeFilename(std::string filename);
 std::string getBaseDir(const std::string& filepath);
@@ -0,0 +1,587 @@
+#include "obj_parser.hpp"
+#include "model.hpp"
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+// Records of a newline aligned slice of the obj file, indices that are
+// relative to the chunk start are fixed up when the chunks are merged
+struct ObjChunk {
+  const char* begin = nullptr;
+  const char* end = nullptr;
+
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<float> texcoords;
+  std::vector<ObjIndex> indices;
+  std::vector<int> material_slots;  // usemtl index, -1 before the first one
+  std::vector<uint32_t> group_slots;  // o and g statements before the face
+  uint32_t group_count = 0;
+  std::vector<std::string> usemtl;
+  std::vector<std::string> mtllibs;
+  std::vector<uint32_t> relative_slots;  // corner * 3 + component
+};
+
+static const std::pair<const char*, float(ObjMaterial::*)[3]> color_keys[] = {
+    {"Ka", &ObjMaterial::ambient},       {"Kd", &ObjMaterial::diffuse},
+    {"Ks", &ObjMaterial::specular},      {"Kt", &ObjMaterial::transmittance},
+    {"Tf", &ObjMaterial::transmittance}, {"Ke", &ObjMaterial::emission}};
+
+static const std::pair<const char*, float ObjMaterial::*> scalar_keys[] = {
+    {"Ns", &ObjMaterial::shininess},
+    {"Ni", &ObjMaterial::ior},
+    {"Pr", &ObjMaterial::roughness},
+    {"Pm", &ObjMaterial::metallic},
+    {"Ps", &ObjMaterial::sheen},
+    {"Pc", &ObjMaterial::clearcoat_thickness},
+    {"Pcr", &ObjMaterial::clearcoat_roughness},
+    {"aniso", &ObjMaterial::anisotropy},
+    {"anisor", &ObjMaterial::anisotropy_rotation}};
+
+static const std::pair<const char*, std::string ObjMaterial::*>
+    texture_keys[] = {{"map_Ka", &ObjMaterial::ambient_texname},
+                      {"map_Kd", &ObjMaterial::diffuse_texname},
+                      {"map_Ks", &ObjMaterial::specular_texname},
+                      {"map_Ns", &ObjMaterial::specular_highlight_texname},
+                      {"map_bump", &ObjMaterial::bump_texname},
+                      {"map_Bump", &ObjMaterial::bump_texname},
+                      {"bump", &ObjMaterial::bump_texname},
+                      {"disp", &ObjMaterial::displacement_texname},
+                      {"map_disp", &ObjMaterial::displacement_texname},
+                      {"map_d", &ObjMaterial::alpha_texname},
+                      {"map_Pr", &ObjMaterial::roughness_texname},
+                      {"map_Pm", &ObjMaterial::metallic_texname},
+                      {"map_Ps", &ObjMaterial::sheen_texname},
+                      {"map_Ke", &ObjMaterial::emissive_texname},
+                      {"norm", &ObjMaterial::normal_texname}};
+
+static inline bool isSpace(char c) { return (c == ' ' || c == '\t'); }
+static inline bool isDigit(char c) { return (c >= '0' && c <= '9'); }
+
+static inline const char* skipSpace(const char* p, const char* end) {
+  while (p < end && isSpace(*p)) p++;
+  return (p);
+}
+
+static inline const char* skipToken(const char* p, const char* end) {
+  while (p < end && !isSpace(*p)) p++;
+  return (p);
+}
+
+static double powerOfTen(int exponent) {
+  static const double exact[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                 1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                 1e18, 1e19, 1e20, 1e21, 1e22};
+  if (exponent >= 0 && exponent <= 22) return (exact[exponent]);
+  return (std::pow(10.0, exponent));
+}
+
+// Locale independent decimal parser, digits are accumulated in a double and
+// scaled by an exact power of ten when possible
+static const char* parseFloat(const char* p, const char* end, float& value) {
+  p = skipSpace(p, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  double mantissa = 0.0;
+  int exponent = 0;
+  while (p < end && isDigit(*p)) {
+    mantissa = mantissa * 10.0 + (*p - '0');
+    p++;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && isDigit(*p)) {
+      mantissa = mantissa * 10.0 + (*p - '0');
+      exponent--;
+      p++;
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negative_exponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative_exponent = *p == '-';
+      p++;
+    }
+    int e = 0;
+    while (p < end && isDigit(*p)) {
+      if (e < 10000) e = e * 10 + (*p - '0');
+      p++;
+    }
+    exponent += negative_exponent ? -e : e;
+  }
+  double result = exponent < 0 ? mantissa / powerOfTen(-exponent)
+                                : mantissa * powerOfTen(exponent);
+  value = static_cast<float>(negative ? -result : result);
+  return (p);
+}
+
+static const char* parseInt(const char* p, const char* end, int& value) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  value = 0;
+  while (p < end && isDigit(*p)) {
+    value = value * 10 + (*p - '0');
+    p++;
+  }
+  if (negative) value = -value;
+  return (p);
+}
+
+static std::string trim(const char* begin, const char* end) {
+  begin = skipSpace(begin, end);
+  while (end > begin && (isSpace(end[-1]) || end[-1] == '\r')) end--;
+  return (std::string(begin, end));
+}
+
+static bool matchKeyword(const char* p, const char* end, const char* keyword) {
+  size_t length = std::strlen(keyword);
+  return (static_cast<size_t>(end - p) >= length &&
+          std::strncmp(p, keyword, length) == 0 &&
+          (static_cast<size_t>(end - p) == length || isSpace(p[length])));
+}
+
+// Obj indices are 1 based, negative ones count back from the current end
+static int resolveIndex(int index, size_t count, bool& relative) {
+  relative = index < 0;
+  if (index > 0) return (index - 1);
+  if (index < 0) return (static_cast<int>(count) + index);
+  return (-1);
+}
+
+static void parseFace(const char* p, const char* end, ObjChunk& chunk,
+                      std::vector<ObjIndex>& polygon,
+                      std::vector<uint8_t>& polygon_relative) {
+  polygon.clear();
+  polygon_relative.clear();
+  p = skipSpace(p, end);
+  while (p < end) {
+    ObjIndex index;
+    uint8_t relative = 0;
+    int value = 0;
+    bool is_relative = false;
+    p = parseInt(p, end, value);
+    index.vertex_index =
+        resolveIndex(value, chunk.positions.size() / 3, is_relative);
+    relative |= is_relative ? 1 : 0;
+    if (p < end && *p == '/') {
+      p++;
+      if (p < end && *p != '/') {
+        p = parseInt(p, end, value);
+        index.texcoord_index =
+            resolveIndex(value, chunk.texcoords.size() / 2, is_relative);
+        relative |= is_relative ? 4 : 0;
+      }
+      if (p < end && *p == '/') {
+        p++;
+        p = parseInt(p, end, value);
+        index.normal_index =
+            resolveIndex(value, chunk.normals.size() / 3, is_relative);
+        relative |= is_relative ? 2 : 0;
+      }
+    }
+    polygon.push_back(index);
+    polygon_relative.push_back(relative);
+    p = skipSpace(skipToken(p, end), end);
+  }
+  // Fan triangulation, as tinyobjloader does
+  int material_slot = static_cast<int>(chunk.usemtl.size()) - 1;
+  for (size_t i = 2; i < polygon.size(); i++) {
+    const size_t corners[3] = {0, i - 1, i};
+    for (size_t corner : corners) {
+      for (int component = 0; component < 3; component++) {
+        if (polygon_relative[corner] & (1 << component)) {
+          chunk.relative_slots.push_back(
+              static_cast<uint32_t>(chunk.indices.size() * 3 + component));
+        }
+      }
+      chunk.indices.push_back(polygon[corner]);
+    }
+    chunk.material_slots.push_back(material_slot);
+    chunk.group_slots.push_back(chunk.group_count);
+  }
+}
+
+static void parseChunk(ObjChunk& chunk) {
+  std::vector<ObjIndex> polygon;
+  std::vector<uint8_t> polygon_relative;
+  const char* line = chunk.begin;
+  while (line < chunk.end) {
+    const char* eol = static_cast<const char*>(
+        std::memchr(line, '\n', chunk.end - line));
+    if (eol == nullptr) eol = chunk.end;
+    const char* next = eol + 1;
+    if (eol > line && eol[-1] == '\r') eol--;
+    const char* p = skipSpace(line, eol);
+    float value[3] = {0.0f, 0.0f, 0.0f};
+    if (matchKeyword(p, eol, "v")) {
+      p += 1;
+      for (int i = 0; i < 3; i++) p = parseFloat(p, eol, value[i]);
+      chunk.positions.insert(chunk.positions.end(), value, value + 3);
+    } else if (matchKeyword(p, eol, "vn")) {
+      p += 2;
+      for (int i = 0; i < 3; i++) p = parseFloat(p, eol, value[i]);
+      chunk.normals.insert(chunk.normals.end(), value, value + 3);
+    } else if (matchKeyword(p, eol, "vt")) {
+      p += 2;
+      for (int i = 0; i < 2; i++) p = parseFloat(p, eol, value[i]);
+      chunk.texcoords.insert(chunk.texcoords.end(), value, value + 2);
+    } else if (matchKeyword(p, eol, "f")) {
+      parseFace(p + 1, eol, chunk, polygon, polygon_relative);
+    } else if (matchKeyword(p, eol, "usemtl")) {
+      chunk.usemtl.push_back(trim(p + 6, eol));
+    } else if (matchKeyword(p, eol, "mtllib")) {
+      chunk.mtllibs.push_back(trim(p + 6, eol));
+    } else if (matchKeyword(p, eol, "o") || matchKeyword(p, eol, "g")) {
+      chunk.group_count++;
+    }
+    line = next;
+  }
+}
+
+static std::string parseTexname(const char* p, const char* end) {
+  // Skip texture options such as -bm 0.5 or -s 1 1 1, the rest is the name
+  p = skipSpace(p, end);
+  while (p < end && *p == '-') {
+    const char* option = p;
+    p = skipSpace(skipToken(p, end), end);
+    int arguments = 1;
+    if (matchKeyword(option, end, "-mm")) arguments = 2;
+    if (matchKeyword(option, end, "-o") || matchKeyword(option, end, "-s") ||
+        matchKeyword(option, end, "-t")) {
+      arguments = 3;
+    }
+    for (int i = 0; i < arguments && p < end; i++) {
+      // Optional numeric arguments of -o, -s and -t
+      if (i > 0 && !isDigit(*p) && *p != '-' && *p != '.') break;
+      p = skipSpace(skipToken(p, end), end);
+    }
+  }
+  return (trim(p, end));
+}
+
+bool parseMTL(const std::string& filename, std::vector<ObjMaterial>& materials,
+              std::map<std::string, int>& material_map) {
+  io::MappedFile file(filename);
+  if (file.data == nullptr) return (false);
+  const char* begin = reinterpret_cast<const char*>(file.data);
+  const char* end = begin + file.size;
+  ObjMaterial material;
+  bool has_material = false;
+  bool has_dissolve = false;
+  auto flush = [&]() {
+    if (has_material) {
+      material_map[material.name] = static_cast<int>(materials.size());
+      materials.push_back(material);
+    }
+  };
+  const char* line = begin;
+  while (line < end) {
+    const char* eol =
+        static_cast<const char*>(std::memchr(line, '\n', end - line));
+    if (eol == nullptr) eol = end;
+    const char* key = skipSpace(line, eol);
+    const char* p = skipToken(key, eol);
+    std::string keyword(key, p);
+    line = eol + 1;
+    if (keyword == "newmtl") {
+      flush();
+      material = ObjMaterial();
+      material.name = trim(p, eol);
+      has_material = true;
+      has_dissolve = false;
+      continue;
+    } else if (keyword == "d") {
+      parseFloat(p, eol, material.dissolve);
+      has_dissolve = true;
+      continue;
+    } else if (keyword == "Tr") {
+      float transparency = 0.0f;
+      parseFloat(p, eol, transparency);
+      if (has_dissolve == false) material.dissolve = 1.0f - transparency;
+      continue;
+    }
+    for (const auto& entry : color_keys) {
+      if (keyword == entry.first) {
+        float(&color)[3] = material.*entry.second;
+        for (int i = 0; i < 3; i++) p = parseFloat(p, eol, color[i]);
+      }
+    }
+    for (const auto& entry : scalar_keys) {
+      if (keyword == entry.first) parseFloat(p, eol, material.*entry.second);
+    }
+    for (const auto& entry : texture_keys) {
+      if (keyword == entry.first) {
+        material.*entry.second = parseTexname(p, eol);
+      }
+    }
+  }
+  flush();
+  return (true);
+}
+
+bool parseOBJ(const std::string& filename, ObjData& data) {
+  io::MappedFile file(filename);
+  if (file.data == nullptr) return (false);
+  const char* begin = reinterpret_cast<const char*>(file.data);
+  const char* end = begin + file.size;
+
+  ThreadPool& pool = ThreadPool::shared();
+  size_t chunk_count = std::max<size_t>(
+      1, std::min<size_t>(file.size / OBJ_PARSER_CHUNK_SIZE,
+                          (pool.size() + 1) * 4));
+  std::vector<ObjChunk> chunks(chunk_count);
+  const char* chunk_begin = begin;
+  for (size_t c = 0; c < chunk_count; c++) {
+    const char* chunk_end = begin + file.size * (c + 1) / chunk_count;
+    if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+    if (c + 1 < chunk_count) {
+      const char* eol = static_cast<const char*>(
+          std::memchr(chunk_end, '\n', end - chunk_end));
+      chunk_end = eol != nullptr ? eol + 1 : end;
+    }
+    chunks[c].begin = chunk_begin;
+    chunks[c].end = chunk_end;
+    chunk_begin = chunk_end;
+  }
+  pool.parallelFor(chunk_count, 1, [&](size_t first, size_t last) {
+    for (size_t c = first; c < last; c++) parseChunk(chunks[c]);
+  });
+
+  // Material libraries are loaded in the order they are referenced
+  std::string basedir = getBaseDir(filename);
+  if (basedir.empty()) basedir = ".";
+  basedir += "/";
+  std::map<std::string, int> material_map;
+  data = ObjData();
+  for (const auto& chunk : chunks) {
+    for (const auto& mtllib : chunk.mtllibs) {
+      if (parseMTL(sanitizeFilename(basedir + mtllib), data.materials,
+                   material_map) == false) {
+        std::cerr << "Cannot load mtl: " << mtllib << std::endl;
+      }
+    }
+  }
+
+  // Prefix sums of the chunk records, the material in use is carried over
+  // from the previous chunk until its first usemtl
+  struct ChunkBase {
+    size_t positions = 0;
+    size_t normals = 0;
+    size_t texcoords = 0;
+    size_t indices = 0;
+    uint32_t groups = 0;
+    int material_id = -1;
+    std::vector<int> material_ids;
+  };
+  std::vector<ChunkBase> bases(chunk_count + 1);
+  for (size_t c = 0; c < chunk_count; c++) {
+    const ObjChunk& chunk = chunks[c];
+    ChunkBase& base = bases[c];
+    ChunkBase& next = bases[c + 1];
+    for (const auto& name : chunk.usemtl) {
+      auto it = material_map.find(name);
+      base.material_ids.push_back(it != material_map.end() ? it->second : -1);
+    }
+    next.positions = base.positions + chunk.positions.size();
+    next.normals = base.normals + chunk.normals.size();
+    next.texcoords = base.texcoords + chunk.texcoords.size();
+    next.indices = base.indices + chunk.indices.size();
+    next.groups = base.groups + chunk.group_count;
+    next.material_id = base.material_ids.empty() ? base.material_id
+                                                 : base.material_ids.back();
+  }
+  const ChunkBase& total = bases[chunk_count];
+  data.positions.resize(total.positions);
+  data.normals.resize(total.normals);
+  data.texcoords.resize(total.texcoords);
+  data.indices.resize(total.indices);
+  data.material_ids.resize(total.indices / 3);
+  data.group_ids.resize(total.indices / 3);
+  int vertex_total = static_cast<int>(total.positions / 3);
+  int normal_total = static_cast<int>(total.normals / 3);
+  int texcoord_total = static_cast<int>(total.texcoords / 2);
+  pool.parallelFor(chunk_count, 1, [&](size_t first, size_t last) {
+    for (size_t c = first; c < last; c++) {
+      const ObjChunk& chunk = chunks[c];
+      const ChunkBase& base = bases[c];
+      std::copy(chunk.positions.begin(), chunk.positions.end(),
+                data.positions.begin() + base.positions);
+      std::copy(chunk.normals.begin(), chunk.normals.end(),
+                data.normals.begin() + base.normals);
+      std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+                data.texcoords.begin() + base.texcoords);
+      ObjIndex* indices = data.indices.data() + base.indices;
+      std::copy(chunk.indices.begin(), chunk.indices.end(), indices);
+      for (uint32_t slot : chunk.relative_slots) {
+        ObjIndex& index = indices[slot / 3];
+        if (slot % 3 == 0) index.vertex_index += base.positions / 3;
+        if (slot % 3 == 1) index.normal_index += base.normals / 3;
+        if (slot % 3 == 2) index.texcoord_index += base.texcoords / 2;
+      }
+      for (size_t i = 0; i < chunk.indices.size(); i++) {
+        ObjIndex& index = indices[i];
+        if (index.vertex_index >= vertex_total) index.vertex_index = -1;
+        if (index.normal_index >= normal_total) index.normal_index = -1;
+        if (index.texcoord_index >= texcoord_total) index.texcoord_index = -1;
+        index.vertex_index = std::max(index.vertex_index, -1);
+        index.normal_index = std::max(index.normal_index, -1);
+        index.texcoord_index = std::max(index.texcoord_index, -1);
+      }
+      int* material_ids = data.material_ids.data() + base.indices / 3;
+      for (size_t f = 0; f < chunk.material_slots.size(); f++) {
+        int slot = chunk.material_slots[f];
+        material_ids[f] =
+            slot < 0 ? base.material_id : base.material_ids[slot];
+      }
+      uint32_t* group_ids = data.group_ids.data() + base.indices / 3;
+      for (size_t f = 0; f < chunk.group_slots.size(); f++) {
+        group_ids[f] = base.groups + chunk.group_slots[f];
+      }
+    }
+  });
+  return (true);
+}
+
+bool parseOBJTinyobj(const std::string& filename, ObjData& data) {
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string err;
+  std::string basedir = getBaseDir(filename);
+  if (basedir.empty()) basedir = ".";
+  basedir += "/";
+  if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str(),
+                        basedir.c_str())) {
+    return (false);
+  }
+  data = ObjData();
+  data.positions.assign(attrib.vertices.begin(), attrib.vertices.end());
+  data.normals.assign(attrib.normals.begin(), attrib.normals.end());
+  data.texcoords.assign(attrib.texcoords.begin(), attrib.texcoords.end());
+  for (size_t s = 0; s < shapes.size(); s++) {
+    const tinyobj::shape_t& shape = shapes[s];
+    for (size_t f = 0; f < shape.mesh.indices.size() / 3; f++) {
+      for (size_t j = 0; j < 3; j++) {
+        const tinyobj::index_t& index = shape.mesh.indices[f * 3 + j];
+        ObjIndex corner;
+        corner.vertex_index = index.vertex_index;
+        corner.normal_index = index.normal_index;
+        corner.texcoord_index = index.texcoord_index;
+        data.indices.push_back(corner);
+      }
+      data.material_ids.push_back(
+          f < shape.mesh.material_ids.size() ? shape.mesh.material_ids[f]
+                                             : -1);
+      data.group_ids.push_back(static_cast<uint32_t>(s));
+    }
+  }
+  for (const auto& source : materials) {
+    ObjMaterial material;
+    material.name = source.name;
+    for (int i = 0; i < 3; i++) {
+      material.ambient[i] = source.ambient[i];
+      material.diffuse[i] = source.diffuse[i];
+      material.specular[i] = source.specular[i];
+      material.transmittance[i] = source.transmittance[i];
+      material.emission[i] = source.emission[i];
+    }
+    material.shininess = source.shininess;
+    material.ior = source.ior;
+    material.dissolve = source.dissolve;
+    material.roughness = source.roughness;
+    material.metallic = source.metallic;
+    material.sheen = source.sheen;
+    material.clearcoat_thickness = source.clearcoat_thickness;
+    material.clearcoat_roughness = source.clearcoat_roughness;
+    material.anisotropy = source.anisotropy;
+    material.anisotropy_rotation = source.anisotropy_rotation;
+    material.ambient_texname = source.ambient_texname;
+    material.diffuse_texname = source.diffuse_texname;
+    material.specular_texname = source.specular_texname;
+    material.specular_highlight_texname = source.specular_highlight_texname;
+    material.bump_texname = source.bump_texname;
+    material.displacement_texname = source.displacement_texname;
+    material.alpha_texname = source.alpha_texname;
+    material.roughness_texname = source.roughness_texname;
+    material.metallic_texname = source.metallic_texname;
+    material.sheen_texname = source.sheen_texname;
+    material.emissive_texname = source.emissive_texname;
+    material.normal_texname = source.normal_texname;
+    data.materials.push_back(material);
+  }
+  return (true);
+}
+
+static bool compareFloats(const char* name, const std::vector<float>& lhs,
+                          const std::vector<float>& rhs) {
+  if (lhs.size() != rhs.size()) {
+    std::cerr << name << " count differs: " << lhs.size() << " / "
+              << rhs.size() << std::endl;
+    return (false);
+  }
+  for (size_t i = 0; i < lhs.size(); i++) {
+    float tolerance = 1e-6f * std::max(1.0f, std::fabs(rhs[i]));
+    if (std::fabs(lhs[i] - rhs[i]) > tolerance) {
+      std::cerr << name << "[" << i << "] differs: " << lhs[i] << " / "
+                << rhs[i] << std::endl;
+      return (false);
+    }
+  }
+  return (true);
+}
+
+bool compareObjData(const ObjData& lhs, const ObjData& rhs) {
+  if (!compareFloats("positions", lhs.positions, rhs.positions) ||
+      !compareFloats("normals", lhs.normals, rhs.normals) ||
+      !compareFloats("texcoords", lhs.texcoords, rhs.texcoords)) {
+    return (false);
+  }
+  if (lhs.indices.size() != rhs.indices.size() ||
+      lhs.material_ids != rhs.material_ids) {
+    std::cerr << "faces differ: " << lhs.indices.size() / 3 << " / "
+              << rhs.indices.size() / 3 << std::endl;
+    return (false);
+  }
+  for (size_t i = 0; i < lhs.indices.size(); i++) {
+    if (lhs.indices[i].vertex_index != rhs.indices[i].vertex_index ||
+        lhs.indices[i].normal_index != rhs.indices[i].normal_index ||
+        lhs.indices[i].texcoord_index != rhs.indices[i].texcoord_index) {
+      std::cerr << "index " << i << " differs" << std::endl;
+      return (false);
+    }
+  }
+  if (lhs.materials.size() != rhs.materials.size()) {
+    std::cerr << "material count differs: " << lhs.materials.size() << " / "
+              << rhs.materials.size() << std::endl;
+    return (false);
+  }
+  for (size_t m = 0; m < lhs.materials.size(); m++) {
+    const ObjMaterial& a = lhs.materials[m];
+    const ObjMaterial& b = rhs.materials[m];
+    bool same = a.name == b.name && a.shininess == b.shininess &&
+                a.ior == b.ior && a.dissolve == b.dissolve;
+    for (const auto& entry : color_keys) {
+      for (int i = 0; i < 3; i++) {
+        same = same && (a.*entry.second)[i] == (b.*entry.second)[i];
+      }
+    }
+    for (const auto& entry : scalar_keys) {
+      same = same && a.*entry.second == b.*entry.second;
+    }
+    for (const auto& entry : texture_keys) {
+      same = same && a.*entry.second == b.*entry.second;
+    }
+    if (same == false) {
+      std::cerr << "material " << a.name << " differs" << std::endl;
+      return (false);
+    }
+  }
+  return (true);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "io.hpp"
+#include "thread_pool.hpp"
+
+// Parse every model with both parsers and report the first difference
+#define OBJ_PARSER_VALIDATE 0
+#define OBJ_PARSER_CHUNK_SIZE (1 << 20)
+
+struct ObjIndex {
+  int vertex_index = -1;
+  int normal_index = -1;
+  int texcoord_index = -1;
+};
+
+// Material library entry, names and defaults follow tinyobj::material_t
+struct ObjMaterial {
+  std::string name;
+
+  float ambient[3] = {0.0f, 0.0f, 0.0f};
+  float diffuse[3] = {0.0f, 0.0f, 0.0f};
+  float specular[3] = {0.0f, 0.0f, 0.0f};
+  float transmittance[3] = {0.0f, 0.0f, 0.0f};
+  float emission[3] = {0.0f, 0.0f, 0.0f};
+  float shininess = 1.0f;
+  float ior = 1.0f;
+  float dissolve = 1.0f;
+
+  float roughness = 0.0f;
+  float metallic = 0.0f;
+  float sheen = 0.0f;
+  float clearcoat_thickness = 0.0f;
+  float clearcoat_roughness = 0.0f;
+  float anisotropy = 0.0f;
+  float anisotropy_rotation = 0.0f;
+
+  std::string ambient_texname;
+  std::string diffuse_texname;
+  std::string specular_texname;
+  std::string specular_highlight_texname;
+  std::string bump_texname;
+  std::string displacement_texname;
+  std::string alpha_texname;
+  std::string roughness_texname;
+  std::string metallic_texname;
+  std::string sheen_texname;
+  std::string emissive_texname;
+  std::string normal_texname;
+};
+
+// Triangulated obj contents, faces are kept in file order
+struct ObjData {
+  std::vector<float> positions;  // xyz
+  std::vector<float> normals;    // xyz
+  std::vector<float> texcoords;  // uv
+  std::vector<ObjIndex> indices;  // 3 per triangle, 0 based
+  std::vector<int> material_ids;  // per triangle, -1 without material
+  // per triangle, o and g statements seen before it, tinyobj shape index
+  // with the reference parser
+  std::vector<uint32_t> group_ids;
+  std::vector<ObjMaterial> materials;
+};
+
+// Memory mapped parser, the file is split in newline aligned chunks parsed
+// on the shared thread pool and merged in file order
+bool parseOBJ(const std::string& filename, ObjData& data);
+bool parseMTL(const std::string& filename, std::vector<ObjMaterial>& materials,
+              std::map<std::string, int>& material_map);
+// Reference implementation through tinyobjloader
+bool parseOBJTinyobj(const std::string& filename, ObjData& data);
+bool compareObjData(const ObjData& lhs, const ObjData& rhs);
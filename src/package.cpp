@@ -0,0 +1,120 @@
+#include "package.hpp"
+
+Package::Package(const std::string& filename) : _file(filename) {
+  if (_file.data == nullptr || _file.size < sizeof(PackageHeader)) return;
+  PackageHeader header;
+  std::memcpy(&header, _file.data, sizeof(PackageHeader));
+  if (std::memcmp(header.magic, PackageHeader().magic, 4) != 0 ||
+      header.version != PACKAGE_VERSION || header.toc_offset > _file.size ||
+      header.entry_count >
+          (_file.size - header.toc_offset) / sizeof(PackageEntry)) {
+    std::cerr << "Invalid package: " << filename << std::endl;
+    return;
+  }
+  const PackageEntry* entries = reinterpret_cast<const PackageEntry*>(
+      _file.data + header.toc_offset);
+  for (uint64_t i = 0; i < header.entry_count; i++) {
+    const PackageEntry& entry = entries[i];
+    if (entry.offset > _file.size || entry.size > _file.size - entry.offset ||
+        entry.name[PACKAGE_NAME_SIZE - 1] != '\0') {
+      std::cerr << "Invalid package entry in " << filename << std::endl;
+      return;
+    }
+    _lookup.emplace(entry.name, &entry);
+  }
+  valid = true;
+}
+
+Package::~Package() {}
+
+const PackageEntry* Package::find(const std::string& name,
+                                  PackageEntryType type) const {
+  auto it = _lookup.find(name);
+  if (it == _lookup.end() || it->second->type != type) return (nullptr);
+  return (it->second);
+}
+
+const unsigned char* Package::data(const PackageEntry& entry) const {
+  return (_file.data + entry.offset);
+}
+
+const unsigned char* Package::textureLevel(const PackageEntry& entry,
+                                           uint32_t level, int& width,
+                                           int& height) const {
+  if (entry.size < sizeof(PackageTexture)) return (nullptr);
+  PackageTexture texture;
+  std::memcpy(&texture, data(entry), sizeof(PackageTexture));
+  if (level >= texture.level_count || level >= PACKAGE_MAX_LEVELS ||
+      texture.level_offsets[level] > entry.size ||
+      texture.level_sizes[level] > entry.size - texture.level_offsets[level]) {
+    return (nullptr);
+  }
+  width = std::max(static_cast<int>(texture.width >> level), 1);
+  height = std::max(static_cast<int>(texture.height >> level), 1);
+  if (texture.level_sizes[level] !=
+      uint64_t(width) * height * texture.channels) {
+    return (nullptr);
+  }
+  return (data(entry) + texture.level_offsets[level]);
+}
+
+PackageWriter::PackageWriter(const std::string& filename)
+    : _filename(filename), _tmp_filename(filename + ".tmp") {
+  _file.open(_tmp_filename, std::ios::binary | std::ios::trunc);
+  PackageHeader header;
+  _file.write(reinterpret_cast<const char*>(&header), sizeof(PackageHeader));
+}
+
+PackageWriter::~PackageWriter() {
+  if (_file.is_open()) {
+    _file.close();
+    std::remove(_tmp_filename.c_str());
+  }
+}
+
+uint64_t PackageWriter::partOffset(uint64_t offset) {
+  return ((offset + PACKAGE_PART_ALIGNMENT - 1) &
+          ~(PACKAGE_PART_ALIGNMENT - 1ULL));
+}
+
+void PackageWriter::pad(uint64_t alignment) {
+  static const char padding[PACKAGE_ALIGNMENT] = {};
+  uint64_t position = static_cast<uint64_t>(_file.tellp());
+  uint64_t aligned = (position + alignment - 1) & ~(alignment - 1);
+  _file.write(padding, aligned - position);
+}
+
+bool PackageWriter::add(const std::string& name, PackageEntryType type,
+                        const Parts& parts) {
+  if (!_file || name.size() >= PACKAGE_NAME_SIZE) return (false);
+  PackageEntry entry;
+  std::memcpy(entry.name, name.data(), name.size());
+  entry.type = type;
+  pad(PACKAGE_ALIGNMENT);
+  entry.offset = static_cast<uint64_t>(_file.tellp());
+  for (const auto& part : parts) {
+    pad(PACKAGE_PART_ALIGNMENT);
+    _file.write(static_cast<const char*>(part.first), part.second);
+  }
+  entry.size = static_cast<uint64_t>(_file.tellp()) - entry.offset;
+  _entries.push_back(entry);
+  return (_file.good());
+}
+
+bool PackageWriter::finish() {
+  PackageHeader header;
+  pad(PACKAGE_PART_ALIGNMENT);
+  header.toc_offset = static_cast<uint64_t>(_file.tellp());
+  header.entry_count = _entries.size();
+  _file.write(reinterpret_cast<const char*>(_entries.data()),
+              _entries.size() * sizeof(PackageEntry));
+  _file.seekp(0);
+  _file.write(reinterpret_cast<const char*>(&header), sizeof(PackageHeader));
+  _file.close();
+  if (!_file) {
+    std::remove(_tmp_filename.c_str());
+    return (false);
+  }
+  std::remove(_filename.c_str());
+  return (std::rename(_tmp_filename.c_str(), _filename.c_str()) == 0);
+}
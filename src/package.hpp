@@ -0,0 +1,92 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "io.hpp"
+
+// Bump whenever the layout below changes
+#define PACKAGE_VERSION 1
+#define PACKAGE_ALIGNMENT 4096  // entries start on a page
+#define PACKAGE_PART_ALIGNMENT 16  // parts of an entry, see PackageWriter
+#define PACKAGE_MAX_LEVELS 16
+#define PACKAGE_NAME_SIZE 104
+#define PACKAGE_SCENE_ENTRY "scene"  // mesh cache of the cooked model
+
+enum class PackageEntryType : uint32_t { Mesh = 1, Texture = 2 };
+
+struct PackageHeader {
+  char magic[4] = {'F', 'P', 'P', 'K'};
+  uint32_t version = PACKAGE_VERSION;
+  uint64_t entry_count = 0;
+  uint64_t toc_offset = 0;
+};
+
+// Table of contents entry, offsets are from the start of the package
+struct PackageEntry {
+  char name[PACKAGE_NAME_SIZE] = {};
+  PackageEntryType type = PackageEntryType::Mesh;
+  uint32_t reserved = 0;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+};
+
+// Texture entry payload, followed by the levels, offsets are from the start
+// of the entry
+struct PackageTexture {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t channels = 0;
+  uint32_t level_count = 0;
+  uint64_t level_offsets[PACKAGE_MAX_LEVELS] = {};
+  uint64_t level_sizes[PACKAGE_MAX_LEVELS] = {};
+};
+
+// Read-only view of a package, entry data points in the mapping
+class Package {
+ public:
+  Package(const std::string& filename);
+  Package(Package const& src) = delete;
+  Package& operator=(Package const& rhs) = delete;
+  ~Package();
+
+  const PackageEntry* find(const std::string& name,
+                           PackageEntryType type) const;
+  const unsigned char* data(const PackageEntry& entry) const;
+  // Level pixels of a texture entry, nullptr if out of range
+  const unsigned char* textureLevel(const PackageEntry& entry, uint32_t level,
+                                    int& width, int& height) const;
+
+  bool valid = false;
+
+ private:
+  io::MappedFile _file;
+  std::unordered_map<std::string, const PackageEntry*> _lookup;
+};
+
+// Entries are written as they are added, the table of contents at the end
+class PackageWriter {
+ public:
+  PackageWriter(const std::string& filename);
+  PackageWriter(PackageWriter const& src) = delete;
+  PackageWriter& operator=(PackageWriter const& rhs) = delete;
+  ~PackageWriter();
+
+  // Each part starts on PACKAGE_PART_ALIGNMENT from the entry start
+  typedef std::vector<std::pair<const void*, size_t>> Parts;
+  static uint64_t partOffset(uint64_t offset);
+  bool add(const std::string& name, PackageEntryType type, const Parts& parts);
+  // Write the table of contents and move the package in place
+  bool finish();
+
+ private:
+  std::string _filename;
+  std::string _tmp_filename;
+  std::ofstream _file;
+  std::vector<PackageEntry> _entries;
+
+  void pad(uint64_t alignment);
+};
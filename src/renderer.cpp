@@ -91,6 +91,12 @@ Renderer::Renderer(int width, int height) : _width(width), _height(height) {
                  NULL, GL_DYNAMIC_DRAW);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo_visible_lights);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Virtual texturing feedback, written with image stores
+    glGenFramebuffers(1, &feedback_fbo);
+    glGenTextures(1, &feedback_texture_id);
+    glGenBuffers(2, feedback_pbos);
+    resizeFeedback();
   } else {
     glGenBuffers(1, &ssbo_lights);
     glBindBuffer(GL_UNIFORM_BUFFER, ssbo_lights);
@@ -107,6 +113,13 @@ Renderer::Renderer(int width, int height) : _width(width), _height(height) {
   glBindBufferBase(GL_UNIFORM_BUFFER, 1, ubo_id);
   glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
+  // Static batch material table
+  glGenBuffers(1, &batch_ubo_id);
+  glBindBuffer(GL_UNIFORM_BUFFER, batch_ubo_id);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(BatchMaterial) * MAX_BATCH_MATERIALS,
+               NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
   std::vector<glm::vec4> vertices_quad = {
       {-1.0f, 1.0f, 0.0f, 0.0f}, {-1.0f, -1.0f, 0.0f, 1.0f},
       {1.0f, -1.0f, 1.0f, 1.0f}, {-1.0f, 1.0f, 0.0f, 0.0f},
@@ -118,6 +131,8 @@ Renderer::Renderer(int width, int height) : _width(width), _height(height) {
                                             1, 2, 4, 3, 2, 1, 1, 5, 3, 4, 5, 1};
   _vao_quad = std::make_shared<VAO>(vertices_quad);
   _vao_octahedron = std::make_shared<VAO>(vertices_octa, indices_octa);
+
+  glGenQueries(2 * _pass_count, &_timer_queries[0][0]);
 }
 
 Renderer::Renderer(Renderer const &src) { *this = src; }
@@ -126,6 +141,7 @@ Renderer::~Renderer(void) {
   glDeleteBuffers(1, &ssbo_lights);
   glDeleteBuffers(1, &ssbo_visible_lights);
   glDeleteBuffers(1, &ubo_id);
+  glDeleteBuffers(1, &batch_ubo_id);
 
   glDeleteTextures(1, &depthpass_texture_depth_id);
   glDeleteFramebuffers(1, &depthpass_fbo);
@@ -134,6 +150,12 @@ Renderer::~Renderer(void) {
   glDeleteTextures(1, &lightpass_texture_normal_id);
   glDeleteTextures(1, &lightpass_texture_depth_id);
   glDeleteFramebuffers(1, &lightpass_fbo);
+
+  glDeleteTextures(1, &feedback_texture_id);
+  glDeleteFramebuffers(1, &feedback_fbo);
+  glDeleteBuffers(2, feedback_pbos);
+
+  glDeleteQueries(2 * _pass_count, &_timer_queries[0][0]);
 }
 
 Renderer &Renderer::operator=(Renderer const &rhs) {
@@ -198,23 +220,61 @@ void Renderer::switchShader(GLuint shader_id, int &current_shader_id) {
     setUniform(glGetUniformLocation(shader_id, "V"), uniforms.view);
     setUniform(glGetUniformLocation(shader_id, "VP"), uniforms.view_proj);
     setUniform(glGetUniformLocation(shader_id, "view_pos"), uniforms.view_pos);
-    setUniform(glGetUniformLocation(shader_id, "num_lights"), NUM_LIGHTS);
+    setUniform(glGetUniformLocation(shader_id, "num_lights"),
+               uniforms.num_lights);
     setUniform(glGetUniformLocation(shader_id, "screen_size"),
                uniforms.screen_size);
     current_shader_id = shader_id;
   }
 }
 
+// Copies drawn by an instanced attrib, 0 for a plain draw
+static GLsizei instanceCount(const Attrib &attrib) {
+  return (attrib.instances != nullptr
+              ? static_cast<GLsizei>(attrib.instances->size())
+              : 0);
+}
+
+const glm::mat4 &Renderer::modelMatrix(const Attrib &attrib) const {
+  if (uniforms.scene_graph != nullptr && attrib.node != SCENE_NODE_NONE) {
+    return (uniforms.scene_graph->world(attrib.node));
+  }
+  return (attrib.model);
+}
+
+// Whole attrib test against the world bounds kept by the scene graph, which
+// cover every instance
+bool Renderer::isAttribVisible(const Attrib &attrib,
+                               const Frustum &frustum) const {
+  if (uniforms.cluster_culling == 0 || uniforms.scene_graph == nullptr ||
+      attrib.node == SCENE_NODE_NONE) {
+    return (true);
+  }
+  glm::vec3 aabb_center;
+  glm::vec3 aabb_halfsize;
+  uniforms.scene_graph->worldBounds(attrib.node, aabb_center, aabb_halfsize);
+  return (frustum.intersectsAABB(aabb_center, aabb_halfsize));
+}
+
 void Renderer::updateUniforms(const Attrib &attrib, const int shader_id) {
   if (shader_id > 0) {
-    glm::mat4 mvp = uniforms.view_proj * attrib.model;
+    const glm::mat4 &model = modelMatrix(attrib);
+    glm::mat4 mvp = uniforms.view_proj * model;
     setUniform(glGetUniformLocation(shader_id, "MVP"), mvp);
-    setUniform(glGetUniformLocation(shader_id, "MV"),
-               uniforms.view * attrib.model);
-    setUniform(glGetUniformLocation(shader_id, "M"), attrib.model);
+    setUniform(glGetUniformLocation(shader_id, "MV"), uniforms.view * model);
+    setUniform(glGetUniformLocation(shader_id, "M"), model);
+    setUniform(glGetUniformLocation(shader_id, "packed_vertex"),
+               attrib.packed_vertices ? 1 : 0);
+    setUniform(glGetUniformLocation(shader_id, "batched"),
+               attrib.batched ? 1 : 0);
+    setUniform(glGetUniformLocation(shader_id, "instanced"),
+               instanceCount(attrib) > 0 ? 1 : 0);
+    setUniform(glGetUniformLocation(shader_id, "position_bias"),
+               attrib.position_bias);
+    setUniform(glGetUniformLocation(shader_id, "position_scale"),
+               attrib.position_scale);
     setUniform(glGetUniformLocation(shader_id, "albedo_tex"), 0);
-    setUniform(glGetUniformLocation(shader_id, "metallic_tex"), 1);
-    setUniform(glGetUniformLocation(shader_id, "roughness_tex"), 2);
+    setUniform(glGetUniformLocation(shader_id, "material_tex"), 2);
     setUniform(glGetUniformLocation(shader_id, "normal_tex"), 3);
   }
 }
@@ -229,22 +289,32 @@ void Renderer::draw() {
   std::shared_ptr<Shader> octahedron = _shaderCache.getShader("octahedron");
   std::shared_ptr<Shader> def = _shaderCache.getShader("default");
 
+  readPassTimes();
+  readFeedback();
+  cullMeshlets();
+  touchTextures();
+  updateBatchMaterials();
+
   glViewport(0, 0, _width, _height);
   // Depth prepass
   // Bind the framebuffer and render opaque scene geometry
   {
+    beginPass(RenderPass::DepthPrepass);
     glBindFramebuffer(GL_FRAMEBUFFER, depthpass_fbo);
     glClear(GL_DEPTH_BUFFER_BIT);
     switchDepthTestState(true);
     switchDepthTestFunc(DepthTestFunc::Less);
 
     switchShader(depthprepass->id, current_shader_id);
-    for (const auto &attrib : this->_attribs) {
+    for (size_t i = 0; i < this->_attribs.size(); i++) {
+      const Attrib &attrib = this->_attribs[i];
       if (attrib.alpha_mask == false) {
         updateUniforms(attrib, depthprepass->id);
-        drawVAOs(attrib.vao, attrib.state.primitiveMode);
+        drawVAOs(attrib.vao, attrib.state.primitiveMode, true,
+                 &_draw_ranges[i], instanceCount(attrib));
       }
     }
+    endPass();
   }
 
   // Copy the depth buffer to the light pass framebuffer
@@ -270,6 +340,7 @@ void Renderer::draw() {
   if (GLVersion.major >= 4 && GLVersion.minor >= 3) {
     // Light culling
     {
+      beginPass(RenderPass::LightCulling);
       glBindFramebuffer(GL_FRAMEBUFFER, lightpass_fbo);
       switchDepthTestFunc(DepthTestFunc::Equal);
       glClear(GL_COLOR_BUFFER_BIT);
@@ -284,11 +355,23 @@ void Renderer::draw() {
 
       glDispatchCompute(workgroup_x, workgroup_y, 1);
       glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      endPass();
     }
   }
 
+  bool virtual_texturing = isVirtualTexturing();
+  if (virtual_texturing) {
+    const GLuint no_requests[4] = {VIRTUAL_NO_REQUEST, VIRTUAL_NO_REQUEST,
+                                   VIRTUAL_NO_REQUEST, VIRTUAL_NO_REQUEST};
+    glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo);
+    glClearBufferuiv(GL_COLOR, 0, no_requests);
+    glBindImageTexture(0, feedback_texture_id, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                       GL_RGBA32UI);
+  }
+
   // Light pass
   {
+    beginPass(RenderPass::Shading);
     glBindFramebuffer(GL_FRAMEBUFFER, lightpass_fbo);
     switchDepthTestFunc(DepthTestFunc::Equal);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -307,6 +390,11 @@ void Renderer::draw() {
       glBindBufferBase(GL_UNIFORM_BUFFER, 0, ssbo_lights);
       glBindBufferBase(GL_UNIFORM_BUFFER, 1, ubo_id);
     }
+    GLuint batch_block = glGetUniformBlockIndex(shading->id, "batch_materials");
+    if (batch_block != GL_INVALID_INDEX) {
+      glUniformBlockBinding(shading->id, batch_block, 3);
+      glBindBufferBase(GL_UNIFORM_BUFFER, 3, batch_ubo_id);
+    }
 
     glActiveTexture(GL_TEXTURE0 + 0);
     glBindTexture(GL_TEXTURE_2D_ARRAY, uniforms.albedo_array->id);
@@ -315,48 +403,66 @@ void Renderer::draw() {
     glBindTexture(GL_TEXTURE_2D_ARRAY, uniforms.normal_array->id);
     setUniform(glGetUniformLocation(shading->id, "normal_array"), 1);
     glActiveTexture(GL_TEXTURE0 + 2);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, uniforms.metallic_array->id);
-    setUniform(glGetUniformLocation(shading->id, "metallic_array"), 2);
-    glActiveTexture(GL_TEXTURE0 + 3);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, uniforms.roughness_array->id);
-    setUniform(glGetUniformLocation(shading->id, "roughness_array"), 3);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, uniforms.material_array->id);
+    setUniform(glGetUniformLocation(shading->id, "material_array"), 2);
+
+    // Units are set even without virtual textures, samplers of different
+    // types cannot share one
+    setUniform(glGetUniformLocation(shading->id, "virtual_texturing"),
+               virtual_texturing ? 1 : 0);
+    for (int i = 0; i < 3; i++) {
+      const VirtualTexture *texture = uniforms.virtual_textures[i].get();
+      std::string index = "[" + std::to_string(i) + "]";
+      glActiveTexture(GL_TEXTURE0 + 4 + i);
+      glBindTexture(GL_TEXTURE_2D, texture ? texture->cache_id : 0);
+      setUniform(glGetUniformLocation(shading->id,
+                                      ("page_caches" + index).c_str()),
+                 4 + i);
+      glActiveTexture(GL_TEXTURE0 + 8 + i);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture ? texture->table_id : 0);
+      setUniform(glGetUniformLocation(shading->id,
+                                      ("page_tables" + index).c_str()),
+                 8 + i);
+      glm::ivec4 size = texture ? glm::ivec4(texture->width, texture->height,
+                                             texture->level_count, 0)
+                                : glm::ivec4(0);
+      glUniform4iv(glGetUniformLocation(shading->id,
+                                        ("virtual_sizes" + index).c_str()),
+                   1, glm::value_ptr(size));
+    }
+    // A different pixel of each square writes its requests every frame
+    glUniform2i(glGetUniformLocation(shading->id, "feedback_jitter"),
+                _feedback_frame % VIRTUAL_FEEDBACK_SCALE,
+                _feedback_frame / VIRTUAL_FEEDBACK_SCALE %
+                    VIRTUAL_FEEDBACK_SCALE);
+    _feedback_frame++;
 
     switchBlendingState(false);
-    for (const auto &attrib : this->_attribs) {
+    for (size_t i = 0; i < this->_attribs.size(); i++) {
+      const Attrib &attrib = this->_attribs[i];
       if (attrib.alpha_mask == false) {
         updateUniforms(attrib, shading->id);
-        setUniform(glGetUniformLocation(shading->id, "albedo_tex"),
-                   attrib.albedo_index);
-        setUniform(glGetUniformLocation(shading->id, "metallic_tex"),
-                   attrib.metallic_index);
-        setUniform(glGetUniformLocation(shading->id, "roughness_tex"),
-                   attrib.roughness_index);
-        setUniform(glGetUniformLocation(shading->id, "normal_tex"),
-                   attrib.normal_index);
-        drawVAOs(attrib.vao, attrib.state.primitiveMode);
+        updateTextureUniforms(attrib, shading->id);
+        drawVAOs(attrib.vao, attrib.state.primitiveMode, false,
+                 &_draw_ranges[i], instanceCount(attrib));
       }
     }
     switchBlendingState(true);
     switchDepthTestFunc(DepthTestFunc::Less);
-    for (const auto &attrib : this->_attribs) {
+    for (size_t i = 0; i < this->_attribs.size(); i++) {
+      const Attrib &attrib = this->_attribs[i];
       if (attrib.alpha_mask == true) {
         glBindBufferBase(GL_UNIFORM_BUFFER, 1, ubo_id);
         updateUniforms(attrib, shading->id);
-        setUniform(glGetUniformLocation(shading->id, "albedo_tex"),
-                   attrib.albedo_index);
-        setUniform(glGetUniformLocation(shading->id, "metallic_tex"),
-                   attrib.metallic_index);
-        setUniform(glGetUniformLocation(shading->id, "roughness_tex"),
-                   attrib.roughness_index);
-        setUniform(glGetUniformLocation(shading->id, "normal_tex"),
-                   attrib.normal_index);
-        drawVAOs(attrib.vao, attrib.state.primitiveMode);
+        updateTextureUniforms(attrib, shading->id);
+        drawVAOs(attrib.vao, attrib.state.primitiveMode, false,
+                 &_draw_ranges[i], instanceCount(attrib));
       }
     }
     if (uniforms.light_debug) {
       switchDepthTestFunc(DepthTestFunc::Less);
       switchShader(octahedron->id, current_shader_id);
-      for (unsigned int i = 0; i < NUM_LIGHTS; ++i) {
+      for (int i = 0; i < uniforms.num_lights; ++i) {
         Light light = uniforms.lights.lights[i];
         setUniform(glGetUniformLocation(octahedron->id, "color"), light.color);
         glm::mat4 model =
@@ -369,10 +475,13 @@ void Renderer::draw() {
                        GL_UNSIGNED_INT, 0);
       }
     }
+    endPass();
   }
+  if (virtual_texturing) copyFeedback();
 
   // Assembly
   {
+    beginPass(RenderPass::Assembly);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     switchDepthTestState(false);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -384,21 +493,400 @@ void Renderer::draw() {
     glBindVertexArray(_vao_quad->vao);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glDrawArrays(GL_TRIANGLES, 0, 6);
+    endPass();
   }
 
   setState(backup_state);
 
   glBindVertexArray(0);
+  _timer_set = 1 - _timer_set;
+  _feedback_set = 1 - _feedback_set;
+}
+
+// Ranges contiguous with the previous one are merged into it
+static void appendRange(DrawRanges &ranges, uint32_t first, uint32_t count,
+                        size_t index_size) {
+  uintptr_t offset = static_cast<uintptr_t>(first) * index_size;
+  if (ranges.counts.empty() == false &&
+      reinterpret_cast<uintptr_t>(ranges.offsets.back()) +
+              ranges.counts.back() * index_size ==
+          offset) {
+    ranges.counts.back() += count;
+    return;
+  }
+  ranges.counts.push_back(count);
+  ranges.offsets.push_back(reinterpret_cast<const GLvoid *>(offset));
+}
+
+// Full detail triangles of every copy, as counted when parts are culled
+static uint64_t fullTriangles(const Attrib &attrib) {
+  auto triangles = [&attrib](uint32_t index_count, uint32_t lod_offset,
+                             uint32_t lod_count) {
+    return (lod_count > 0 ? (*attrib.lods)[lod_offset].index_count / 3
+                          : index_count / 3);
+  };
+  uint64_t count = 0;
+  if (attrib.parts != nullptr) {
+    for (const auto &part : *attrib.parts) {
+      count += triangles(part.index_count, part.lod_offset, part.lod_count);
+    }
+  } else {
+    count = triangles(static_cast<uint32_t>(attrib.vao->indices_size), 0,
+                      attrib.lods != nullptr
+                          ? static_cast<uint32_t>(attrib.lods->size())
+                          : 0);
+  }
+  return (count * std::max<GLsizei>(instanceCount(attrib), 1));
+}
+
+void Renderer::cullMeshlets() {
+  stats = RenderStats();
+  Frustum world_frustum(uniforms.view_proj);
+  _draw_ranges.resize(_attribs.size());
+  for (size_t i = 0; i < _attribs.size(); i++) {
+    const Attrib &attrib = _attribs[i];
+    DrawRanges &ranges = _draw_ranges[i];
+    ranges.counts.clear();
+    ranges.offsets.clear();
+    if (attrib.vao == nullptr || attrib.vao->indices_size == 0) continue;
+    if (isAttribVisible(attrib, world_frustum) == false) {
+      uint64_t full_triangles = fullTriangles(attrib);
+      stats.chunks_total += attrib.parts != nullptr
+                                ? static_cast<uint32_t>(attrib.parts->size())
+                                : 1;
+      stats.triangles_total += full_triangles;
+      stats.triangles_chunk_culled += full_triangles;
+      continue;
+    }
+    // Planes of the MVP are in object space, as are the meshlet bounds, an
+    // instanced attrib gets one frustum and camera position per instance
+    _frustums.clear();
+    _camera_positions.clear();
+    size_t instance_count =
+        attrib.instances != nullptr ? attrib.instances->size() : 0;
+    for (size_t n = 0; n < std::max<size_t>(instance_count, 1); n++) {
+      glm::mat4 model = modelMatrix(attrib);
+      if (instance_count > 0) model = model * (*attrib.instances)[n];
+      _frustums.push_back(Frustum(uniforms.view_proj * model));
+      _camera_positions.push_back(glm::vec3(
+          glm::inverse(model) * glm::vec4(uniforms.view_pos, 1.0f)));
+    }
+    if (attrib.parts != nullptr) {
+      for (const auto &part : *attrib.parts) cullPart(attrib, part, ranges);
+      continue;
+    }
+    // A lone mesh is a single part spanning the whole attrib
+    DrawPart part;
+    part.index_count = attrib.vao->indices_size;
+    if (attrib.meshlets != nullptr) {
+      part.meshlet_count = static_cast<uint32_t>(attrib.meshlets->size());
+    }
+    if (attrib.lods != nullptr) {
+      part.lod_count = static_cast<uint32_t>(attrib.lods->size());
+    }
+    part.aabb_center = attrib.aabb_center;
+    part.aabb_halfsize = attrib.aabb_halfsize;
+    cullPart(attrib, part, ranges);
+  }
+}
+
+// Instances share the draw ranges, a part or meshlet is kept while any
+// instance sees it and the level is picked for the closest instance
+void Renderer::cullPart(const Attrib &attrib, const DrawPart &part,
+                        DrawRanges &ranges) {
+  size_t index_size = attrib.vao->index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+  uint32_t copies = static_cast<uint32_t>(_frustums.size());
+  const MeshLod *lods =
+      part.lod_count > 0 ? attrib.lods->data() + part.lod_offset : nullptr;
+
+  // Chunks are split along material meshes with tight bounds, reject them
+  // whole before selecting a level and looking at their meshlets
+  uint64_t full_triangles =
+      (lods != nullptr ? lods[0].index_count : part.index_count) / 3 * copies;
+  stats.triangles_total += full_triangles;
+  stats.chunks_total++;
+  _visible_copies.clear();
+  for (size_t n = 0; n < copies && uniforms.cluster_culling != 0; n++) {
+    if (_frustums[n].intersectsAABB(part.aabb_center, part.aabb_halfsize)) {
+      _visible_copies.push_back(n);
+    }
+  }
+  if (uniforms.cluster_culling != 0 && _visible_copies.empty()) {
+    stats.triangles_chunk_culled += full_triangles;
+    return;
+  }
+  stats.chunks_visible++;
+
+  MeshLod level;
+  level.index_count = part.index_count;
+  level.meshlet_count = part.meshlet_count;
+  if (lods != nullptr) {
+    int lod = 0;
+    if (uniforms.lod_selection) {
+      float distance = std::numeric_limits<float>::max();
+      for (const auto &camera_position : _camera_positions) {
+        glm::vec3 outside = glm::max(
+            glm::abs(camera_position - part.aabb_center) - part.aabb_halfsize,
+            glm::vec3(0.0f));
+        distance = std::min(distance, glm::length(outside));
+      }
+      lod = selectLod(lods, static_cast<int>(part.lod_count), distance,
+                      uniforms.proj[1][1], _height);
+    }
+    level = lods[lod];
+    stats.lod_draws[lod]++;
+  }
+  if (attrib.meshlets == nullptr) level.meshlet_count = 0;
+
+  // Meshlets are only tested against the instances seeing the part
+  if (level.meshlet_count == 0 || uniforms.cluster_culling == 0 ||
+      _visible_copies.size() > MESHLET_CULL_MAX_INSTANCES) {
+    appendRange(ranges, part.index_offset + level.index_offset,
+                level.index_count, index_size);
+    stats.triangles_submitted += level.index_count / 3 * copies;
+    return;
+  }
+  const Meshlet *meshlets = attrib.meshlets->data() + part.meshlet_offset;
+  for (uint32_t m = level.meshlet_offset;
+       m < level.meshlet_offset + level.meshlet_count; m++) {
+    const Meshlet &meshlet = meshlets[m];
+    stats.meshlets_total++;
+    bool meshlet_visible = false;
+    for (size_t n : _visible_copies) {
+      meshlet_visible =
+          isMeshletVisible(meshlet, _frustums[n], _camera_positions[n]);
+      if (meshlet_visible) break;
+    }
+    if (meshlet_visible == false) continue;
+    stats.meshlets_visible++;
+    stats.triangles_submitted += meshlet.index_count / 3 * copies;
+    // Adjacent visible meshlets are merged in a single range
+    appendRange(ranges, part.index_offset + meshlet.index_offset,
+                meshlet.index_count, index_size);
+  }
+}
+
+// Arrays in the order of BatchMaterial::textures
+static std::array<TextureArray *, 3> textureArrays(const Uniforms &uniforms) {
+  return {{uniforms.albedo_array.get(), uniforms.normal_array.get(),
+           uniforms.material_array.get()}};
+}
+
+// Layer with the first level left to sample above the low 16 bits
+static int textureIndex(const TextureArray *array, int index) {
+  if (array == nullptr || index < 0) return (index);
+  return (index | (array->firstLevel(index) << 16));
+}
+
+// Drawn layers are the last ones the budget drops levels of, the residency
+// evicts and restores before the indices given to the shader are encoded
+void Renderer::touchTextures() {
+  std::array<TextureArray *, 3> arrays = textureArrays(uniforms);
+  bool batch_drawn = false;
+  for (size_t i = 0; i < _attribs.size(); i++) {
+    const Attrib &attrib = _attribs[i];
+    if (attrib.vao == nullptr ||
+        (attrib.vao->indices_size > 0 && _draw_ranges[i].counts.empty())) {
+      continue;
+    }
+    if (attrib.batched) {
+      batch_drawn = true;
+      continue;
+    }
+    glm::ivec3 indices(attrib.albedo_index, attrib.normal_index,
+                       attrib.material_index);
+    for (int n = 0; n < 3; n++) {
+      if (arrays[n] != nullptr) arrays[n]->touchLayer(indices[n]);
+    }
+  }
+  // Parts do not know their materials, a drawn batch touches all of them
+  if (batch_drawn && uniforms.batch_materials != nullptr) {
+    for (const auto &batch_material : *uniforms.batch_materials) {
+      for (int n = 0; n < 3; n++) {
+        if (arrays[n] != nullptr) {
+          arrays[n]->touchLayer(batch_material.textures[n]);
+        }
+      }
+    }
+  }
+  TextureResidency::shared().update();
+}
+
+void Renderer::updateTextureUniforms(const Attrib &attrib,
+                                     const int shader_id) {
+  std::array<TextureArray *, 3> arrays = textureArrays(uniforms);
+  setUniform(glGetUniformLocation(shader_id, "albedo_tex"),
+             textureIndex(arrays[0], attrib.albedo_index));
+  setUniform(glGetUniformLocation(shader_id, "normal_tex"),
+             textureIndex(arrays[1], attrib.normal_index));
+  setUniform(glGetUniformLocation(shader_id, "material_tex"),
+             textureIndex(arrays[2], attrib.material_index));
+}
+
+// Uploaded again when the table or the first level of a layer changes
+void Renderer::updateBatchMaterials() {
+  uint64_t generation = TextureResidency::shared().generation();
+  if (uniforms.batch_materials == _batch_materials &&
+      generation == _batch_generation) {
+    return;
+  }
+  _batch_materials = uniforms.batch_materials;
+  _batch_generation = generation;
+  if (_batch_materials == nullptr) return;
+  size_t count = std::min<size_t>(_batch_materials->size(),
+                                  MAX_BATCH_MATERIALS);
+  std::array<TextureArray *, 3> arrays = textureArrays(uniforms);
+  _batch_upload.assign(_batch_materials->begin(),
+                       _batch_materials->begin() + count);
+  for (auto &batch_material : _batch_upload) {
+    for (int n = 0; n < 3; n++) {
+      batch_material.textures[n] =
+          textureIndex(arrays[n], batch_material.textures[n]);
+    }
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, batch_ubo_id);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(BatchMaterial),
+                  _batch_upload.data());
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void Renderer::beginPass(RenderPass pass) {
+  int index = static_cast<int>(pass);
+  glBeginQuery(GL_TIME_ELAPSED, _timer_queries[_timer_set][index]);
+  _timer_pending[_timer_set][index] = true;
+}
+
+void Renderer::endPass() { glEndQuery(GL_TIME_ELAPSED); }
+
+void Renderer::readPassTimes() {
+  // The set about to be reused was issued a frame ago, only read results
+  // that are already available so the CPU never waits on the GPU
+  for (int i = 0; i < _pass_count; i++) {
+    if (_timer_pending[_timer_set][i] == false) continue;
+    GLuint available = 0;
+    glGetQueryObjectuiv(_timer_queries[_timer_set][i],
+                        GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(_timer_queries[_timer_set][i], GL_QUERY_RESULT,
+                            &elapsed);
+      _pass_times[i] = static_cast<float>(elapsed) / 1000000.0f;
+    }
+    _timer_pending[_timer_set][i] = false;
+  }
+}
+
+bool Renderer::isVirtualTexturing() const {
+  if (feedback_texture_id == 0) return (false);
+  for (const auto &texture : uniforms.virtual_textures) {
+    if (texture != nullptr) return (true);
+  }
+  return (false);
+}
+
+// One texel for VIRTUAL_FEEDBACK_SCALE squared pixels, a request per texture
+void Renderer::resizeFeedback() {
+  if (feedback_texture_id == 0) return;
+  _feedback_width = (_width + VIRTUAL_FEEDBACK_SCALE - 1) /
+                    VIRTUAL_FEEDBACK_SCALE;
+  _feedback_height = (_height + VIRTUAL_FEEDBACK_SCALE - 1) /
+                     VIRTUAL_FEEDBACK_SCALE;
+  glBindTexture(GL_TEXTURE_2D, feedback_texture_id);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, _feedback_width,
+               _feedback_height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         feedback_texture_id, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  for (int i = 0; i < 2; i++) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbos[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER,
+                 sizeof(GLuint) * 4 * _feedback_width * _feedback_height,
+                 NULL, GL_STREAM_READ);
+    _feedback_pending[i] = false;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// The buffer about to be reused was filled two frames ago, the copy is done
+// and mapping it does not wait on the GPU. Virtual textures are updated
+// every frame, pages keep landing without new requests
+void Renderer::readFeedback() {
+  for (auto &requests : _page_requests) requests.clear();
+  if (_feedback_pending[_feedback_set] && isVirtualTexturing()) {
+    size_t count = size_t(_feedback_width) * _feedback_height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbos[_feedback_set]);
+    const GLuint *texels = static_cast<const GLuint *>(glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, count * sizeof(GLuint), GL_MAP_READ_BIT));
+    if (texels != nullptr) {
+      // A request per virtual texture, the fourth channel never holds one
+      for (size_t i = 0; i < count; i++) {
+        if (i % 4 < _page_requests.size() && texels[i] != VIRTUAL_NO_REQUEST) {
+          _page_requests[i % 4].push_back(texels[i]);
+        }
+      }
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+  _feedback_pending[_feedback_set] = false;
+  for (size_t i = 0; i < _page_requests.size(); i++) {
+    if (uniforms.virtual_textures[i] != nullptr) {
+      uniforms.virtual_textures[i]->update(_page_requests[i]);
+    }
+  }
+}
+
+void Renderer::copyFeedback() {
+  glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbos[_feedback_set]);
+  glBindTexture(GL_TEXTURE_2D, feedback_texture_id);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  _feedback_pending[_feedback_set] = true;
+}
+
+float Renderer::getPassTime(RenderPass pass) {
+  return (_pass_times[static_cast<int>(pass)]);
 }
 
 void Renderer::drawVAOs(std::shared_ptr<VAO> vao,
-                        render::PrimitiveMode primitive_mode) {
+                        render::PrimitiveMode primitive_mode, bool depth_only,
+                        const DrawRanges *ranges,
+                        GLsizei instance_count) {
   GLenum mode = getGLRenderMode(primitive_mode);
   if (vao != nullptr) {
     if (vao->indices_size != 0) {
-      glBindVertexArray(vao->vao);
-      glDrawElements(mode, vao->indices_size, GL_UNSIGNED_INT, 0);
+      if (ranges != nullptr && ranges->counts.empty()) return;
+      // Position only stream when available, a third of the fetch bandwidth
+      glBindVertexArray(depth_only && vao->depth_vao != 0 ? vao->depth_vao
+                                                          : vao->vao);
+      if (ranges != nullptr && instance_count > 0) {
+        // No multi draw flavour of instancing, one call per range
+        for (size_t r = 0; r < ranges->counts.size(); r++) {
+          glDrawElementsInstanced(mode, ranges->counts[r], vao->index_type,
+                                  ranges->offsets[r], instance_count);
+        }
+        stats.draw_calls += static_cast<uint32_t>(ranges->counts.size());
+        return;
+      }
+      stats.draw_calls++;
+      if (ranges != nullptr) {
+        glMultiDrawElements(mode, ranges->counts.data(), vao->index_type,
+                            ranges->offsets.data(),
+                            static_cast<GLsizei>(ranges->counts.size()));
+      } else if (instance_count > 0) {
+        glDrawElementsInstanced(mode, vao->indices_size, vao->index_type, 0,
+                                instance_count);
+      } else {
+        glDrawElements(mode, vao->indices_size, vao->index_type, 0);
+      }
     } else if (vao->vertices_size != 0) {
+      stats.draw_calls++;
       glBindVertexArray(vao->vao);
       glDrawArrays(mode, 0, vao->vertices_size);
     }
@@ -447,6 +935,8 @@ void Renderer::updateRessources() {
   glBindTexture(GL_TEXTURE_2D, lightpass_texture_depth_id);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, _width, _height, 0,
                GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+  resizeFeedback();
 }
 
 void Renderer::flushAttribs() { this->_attribs.clear(); }
@@ -1,18 +1,28 @@
 #pragma once
 #include <algorithm>
+#include <array>
 #include <map>
 #include <memory>
 #include <unordered_map>
 #include <vector>
 #include "env.hpp"
 #include "forward.hpp"
+#include "frustum.hpp"
 #include "io.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet.hpp"
+#include "scene_graph.hpp"
 #include "shader.hpp"
 #include "shader_cache.hpp"
 #include "text_renderer.hpp"
 #include "texture.hpp"
 #include "ui_renderer.hpp"
 #include "vao.hpp"
+#include "virtual_texture.hpp"
+
+// Past it the instances seeing a part draw it whole, meshlets are tested
+// against each of them
+#define MESHLET_CULL_MAX_INSTANCES 8
 
 class Shader;
 
@@ -63,6 +73,9 @@ enum class BlendFunc {
 
 enum class PolygonMode { Point, Line, Fill };
 
+// GPU timed passes, see Renderer::getPassTime
+enum class RenderPass { DepthPrepass, LightCulling, Shading, Assembly, Count };
+
 struct RenderState {
   PrimitiveMode primitiveMode = PrimitiveMode::Triangles;
   PolygonMode polygonMode = PolygonMode::Fill;
@@ -78,10 +91,16 @@ struct UBO {
 
 struct Uniforms {
   Lights lights;
+  int num_lights = NUM_LIGHTS;  // up to MAX_LIGHTS_PER_TILE
   std::shared_ptr<TextureArray> albedo_array;
   std::shared_ptr<TextureArray> normal_array;
-  std::shared_ptr<TextureArray> metallic_array;
-  std::shared_ptr<TextureArray> roughness_array;
+  std::shared_ptr<TextureArray> material_array;  // metallic and roughness
+  // Albedo, normal and material, sampled instead of the arrays when set and
+  // paged in from the feedback of the shading pass
+  std::array<std::shared_ptr<VirtualTexture>, 3> virtual_textures;
+  std::shared_ptr<const std::vector<BatchMaterial>> batch_materials;
+  // World matrices and bounds of the attribs that have a node
+  const SceneGraph* scene_graph = nullptr;
   glm::mat4 view;
   glm::mat4 proj;
   glm::mat4 inv_proj;
@@ -93,25 +112,78 @@ struct Uniforms {
   int debug = 0;
   int light_debug = 0;
   int visibilty_debug = 0;
+  int cluster_culling = 1;
+  int lod_selection = 1;
+};
+
+// Independently culled piece of a batched attrib, offsets index the attrib
+// index buffer, meshlets and lods
+struct DrawPart {
+  uint32_t index_offset = 0;
+  uint32_t index_count = 0;
+  uint32_t meshlet_offset = 0;
+  uint32_t meshlet_count = 0;
+  uint32_t lod_offset = 0;
+  uint32_t lod_count = 0;
+  glm::vec3 aabb_center = glm::vec3(0.0f);
+  glm::vec3 aabb_halfsize = glm::vec3(0.0f);
 };
 
 struct Attrib {
   glm::mat4 model = glm::mat4(1.0f);
+  // Node of the scene graph, its world matrix replaces model when set
+  uint32_t node = SCENE_NODE_NONE;
   std::shared_ptr<VAO> vao;
   Material material;
 
   int albedo_index = -1;
   int normal_index = -1;
-  int metallic_index = -1;
-  int roughness_index = -1;
+  int material_index = -1;
   int opacity_index = -1;
 
   bool alpha_mask = false;
   RenderState state;
 
+  // Decode parameters of PackedVertex positions
+  bool packed_vertices = false;
+  glm::vec3 position_bias = glm::vec3(0.0f);
+  glm::vec3 position_scale = glm::vec3(1.0f);
+
+  // Optional clusters of the index buffer, culled before each frame
+  std::shared_ptr<const std::vector<Meshlet>> meshlets;
+  // Optional levels of detail, picked from the projected error of the AABB
+  std::shared_ptr<const std::vector<MeshLod>> lods;
+  glm::vec3 aabb_center = glm::vec3(0.0f);
+  glm::vec3 aabb_halfsize = glm::vec3(0.0f);
+
+  // Static batch of several meshes, textures come from the batch material
+  // table through the vertex material ids and every part is culled alone
+  bool batched = false;
+  std::shared_ptr<const std::vector<DrawPart>> parts;
+  // Transforms applied after model, one copy of the mesh is drawn for each
+  std::shared_ptr<const std::vector<glm::mat4>> instances;
+
   bool operator<(const struct Attrib& rhs) const;
 };
 
+// Index ranges of an attrib left after culling
+struct DrawRanges {
+  std::vector<GLsizei> counts;
+  std::vector<const GLvoid*> offsets;
+};
+
+struct RenderStats {
+  uint32_t chunks_total = 0;
+  uint32_t chunks_visible = 0;
+  uint64_t triangles_chunk_culled = 0;  // full detail, in culled chunks
+  uint32_t meshlets_total = 0;
+  uint32_t meshlets_visible = 0;
+  uint64_t triangles_total = 0;
+  uint64_t triangles_submitted = 0;
+  uint32_t draw_calls = 0;
+  uint32_t lod_draws[MESH_LOD_COUNT] = {};
+};
+
 class Renderer {
  public:
   Renderer(int width, int height);
@@ -130,6 +202,8 @@ class Renderer {
   int getScreenWidth();
   int getScreenHeight();
   void clearScreen();
+  // GPU time in milliseconds, lags a frame behind to avoid stalling
+  float getPassTime(RenderPass pass);
 
   void setState(const RenderState& new_state);
   void switchPolygonMode(PolygonMode mode);
@@ -140,8 +214,10 @@ class Renderer {
   void switchBlendingState(bool state);
 
   Uniforms uniforms = {};
+  RenderStats stats = {};
   UBO ubo = {};
   GLuint ubo_id = 0;
+  GLuint batch_ubo_id = 0;
 
   GLuint depthpass_fbo = 0;
   GLuint depthpass_texture_depth_id = 0;
@@ -154,9 +230,21 @@ class Renderer {
   GLuint ssbo_lights = 0;
   GLuint ssbo_visible_lights = 0;
 
+  // Page requests of the shading pass, read back through the buffers
+  GLuint feedback_fbo = 0;
+  GLuint feedback_texture_id = 0;
+  GLuint feedback_pbos[2] = {};
+
  private:
   Renderer(void) = default;
   std::vector<Attrib> _attribs;
+  std::vector<DrawRanges> _draw_ranges;
+  std::vector<Frustum> _frustums;  // per instance of the attrib being culled
+  std::vector<glm::vec3> _camera_positions;
+  std::vector<size_t> _visible_copies;  // instances seeing the part culled
+  std::shared_ptr<const std::vector<BatchMaterial>> _batch_materials;
+  std::vector<BatchMaterial> _batch_upload;  // indices encoded for the shader
+  uint64_t _batch_generation = 0;
   int _width = 0;
   int _height = 0;
   ShaderCache _shaderCache;
@@ -165,13 +253,46 @@ class Renderer {
 
   RenderState _state;
 
+  // Double buffered GL_TIME_ELAPSED queries, one set per frame in flight
+  static const int _pass_count = static_cast<int>(RenderPass::Count);
+  GLuint _timer_queries[2][_pass_count] = {};
+  bool _timer_pending[2][_pass_count] = {};
+  float _pass_times[_pass_count] = {};
+  int _timer_set = 0;
+
+  // Double buffered as the queries, read two frames after the shading pass
+  int _feedback_width = 0;
+  int _feedback_height = 0;
+  bool _feedback_pending[2] = {};
+  int _feedback_set = 0;
+  uint32_t _feedback_frame = 0;
+  std::array<std::vector<uint32_t>, 3> _page_requests;
+
   TextRenderer _textRenderer;
   UiRenderer _uiRenderer;
 
   void updateRessources();
-  void drawVAOs(std::shared_ptr<VAO> vao, PrimitiveMode primitive_mode);
+  void drawVAOs(std::shared_ptr<VAO> vao, PrimitiveMode primitive_mode,
+                bool depth_only = false,
+                const DrawRanges* ranges = nullptr,
+                GLsizei instance_count = 0);
+  void cullMeshlets();
+  void cullPart(const Attrib& attrib, const DrawPart& part,
+                DrawRanges& ranges);
+  void touchTextures();
+  void updateTextureUniforms(const Attrib& attrib, const int shader_id);
+  void updateBatchMaterials();
+  void beginPass(RenderPass pass);
+  void endPass();
+  void readPassTimes();
+  bool isVirtualTexturing() const;
+  void resizeFeedback();
+  void readFeedback();
+  void copyFeedback();
   void switchShader(GLuint shader_id, int& current_shader_id);
   void updateUniforms(const Attrib& attrib, const int shader_id);
+  const glm::mat4& modelMatrix(const Attrib& attrib) const;
+  bool isAttribVisible(const Attrib& attrib, const Frustum& frustum) const;
   GLenum getGLRenderMode(PrimitiveMode mode);
 };
 
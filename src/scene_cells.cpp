@@ -0,0 +1,113 @@
+#include "scene_cells.hpp"
+
+CellGrid::CellGrid() {}
+
+CellGrid::CellGrid(const glm::vec3& aabb_center,
+                   const glm::vec3& aabb_halfsize)
+    : min(aabb_center - aabb_halfsize), size(aabb_halfsize * 2.0f) {}
+
+size_t CellGrid::cellCount() const {
+  return (CELL_GRID_SIZE * CELL_GRID_SIZE);
+}
+
+size_t CellGrid::cellOf(const glm::vec3& position) const {
+  glm::vec3 cell = glm::floor((position - min) / glm::max(size, 1e-6f) *
+                              static_cast<float>(CELL_GRID_SIZE));
+  cell = glm::clamp(cell, 0.0f, CELL_GRID_SIZE - 1.0f);
+  return (static_cast<size_t>(cell.z) * CELL_GRID_SIZE +
+          static_cast<size_t>(cell.x));
+}
+
+void CellGrid::cellBounds(size_t cell, glm::vec3& aabb_center,
+                          glm::vec3& aabb_halfsize) const {
+  glm::vec3 cell_size = size / glm::vec3(CELL_GRID_SIZE, 1, CELL_GRID_SIZE);
+  glm::vec3 cell_min =
+      min + cell_size * glm::vec3(cell % CELL_GRID_SIZE, 0,
+                                  cell / CELL_GRID_SIZE);
+  aabb_halfsize = cell_size * 0.5f;
+  aabb_center = cell_min + aabb_halfsize;
+}
+
+SceneCells::SceneCells() {}
+
+SceneCells::SceneCells(const CellGrid& grid, size_t budget_bytes)
+    : _cells(grid.cellCount()) {
+  for (size_t i = 0; i < _cells.size(); i++) {
+    grid.cellBounds(i, _cells[i].aabb_center, _cells[i].aabb_halfsize);
+  }
+  _stats.cells_total = _cells.size();
+  _stats.budget_bytes = budget_bytes;
+}
+
+void SceneCells::addItem(size_t cell, size_t item, size_t bytes) {
+  _cells[cell].items.push_back(item);
+  _cells[cell].bytes += bytes;
+  if (_cells[cell].resident) _stats.resident_bytes += bytes;
+}
+
+const std::vector<size_t>& SceneCells::items(size_t cell) const {
+  return (_cells[cell].items);
+}
+
+bool SceneCells::resident(size_t cell) const {
+  return (_cells[cell].resident);
+}
+
+void SceneCells::update(const glm::vec3& view_pos, const glm::vec3& view_dir,
+                        std::vector<size_t>& evictions,
+                        std::vector<size_t>& loads) {
+  evictions.clear();
+  loads.clear();
+  std::vector<size_t> order;
+  for (size_t i = 0; i < _cells.size(); i++) {
+    Cell& cell = _cells[i];
+    glm::vec3 closest =
+        glm::clamp(view_pos, cell.aabb_center - cell.aabb_halfsize,
+                   cell.aabb_center + cell.aabb_halfsize);
+    glm::vec3 to_cell = cell.aabb_center - view_pos;
+    float facing = glm::length(to_cell) > 1e-6f
+                       ? glm::dot(glm::normalize(to_cell), view_dir)
+                       : 1.0f;
+    // Cells behind the camera count up to three times as far
+    cell.score = glm::distance(view_pos, closest) * (2.0f - facing);
+    if (cell.bytes > 0) order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return (_cells[a].score < _cells[b].score);
+  });
+
+  // Victims are taken from the back of the order, least important first
+  size_t resident_bytes = _stats.resident_bytes;
+  size_t victim = order.size();
+  for (size_t i = 0; i < order.size(); i++) {
+    const Cell& cell = _cells[order[i]];
+    if (cell.resident || cell.bytes > _stats.budget_bytes) continue;
+    while (resident_bytes + cell.bytes > _stats.budget_bytes &&
+           victim > i + 1) {
+      victim--;
+      if (_cells[order[victim]].resident) {
+        evictions.push_back(order[victim]);
+        resident_bytes -= _cells[order[victim]].bytes;
+      }
+    }
+    if (resident_bytes + cell.bytes > _stats.budget_bytes) break;
+    loads.push_back(order[i]);
+    resident_bytes += cell.bytes;
+  }
+}
+
+void SceneCells::setResident(size_t cell, bool resident) {
+  if (_cells[cell].resident == resident) return;
+  _cells[cell].resident = resident;
+  if (resident) {
+    _stats.cells_resident++;
+    _stats.resident_bytes += _cells[cell].bytes;
+    _stats.loads++;
+  } else {
+    _stats.cells_resident--;
+    _stats.resident_bytes -= _cells[cell].bytes;
+    _stats.evictions++;
+  }
+}
+
+const CellStats& SceneCells::stats() const { return (_stats); }
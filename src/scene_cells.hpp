@@ -0,0 +1,61 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "forward.hpp"
+
+#define CELL_GRID_SIZE 4  // cells along x and z, cells span the scene height
+#define CELL_GPU_BUDGET_MB 512  // default geometry kept resident
+
+// Horizontal grid over the scene bounds
+struct CellGrid {
+  glm::vec3 min = glm::vec3(0.0f);
+  glm::vec3 size = glm::vec3(0.0f);
+
+  CellGrid();
+  CellGrid(const glm::vec3& aabb_center, const glm::vec3& aabb_halfsize);
+  size_t cellCount() const;
+  size_t cellOf(const glm::vec3& position) const;
+  void cellBounds(size_t cell, glm::vec3& aabb_center,
+                  glm::vec3& aabb_halfsize) const;
+};
+
+struct CellStats {
+  size_t cells_total = 0;
+  size_t cells_resident = 0;
+  size_t resident_bytes = 0;
+  size_t budget_bytes = 0;
+  size_t loads = 0;
+  size_t evictions = 0;
+};
+
+// Residency of the grid cells. Cells are loaded nearest first, favouring the
+// view direction, and the least important resident cells are evicted when
+// a more important one does not fit in the budget
+class SceneCells {
+ public:
+  SceneCells();
+  SceneCells(const CellGrid& grid, size_t budget_bytes);
+
+  // Item of a cell, bytes is its share of the budget
+  void addItem(size_t cell, size_t item, size_t bytes);
+  const std::vector<size_t>& items(size_t cell) const;
+  bool resident(size_t cell) const;
+  // Loads are in priority order, the caller frees the evictions and uploads
+  // what it can of the loads, then reports each one with setResident
+  void update(const glm::vec3& view_pos, const glm::vec3& view_dir,
+              std::vector<size_t>& evictions, std::vector<size_t>& loads);
+  void setResident(size_t cell, bool resident);
+  const CellStats& stats() const;
+
+ private:
+  struct Cell {
+    glm::vec3 aabb_center = glm::vec3(0.0f);
+    glm::vec3 aabb_halfsize = glm::vec3(0.0f);
+    std::vector<size_t> items;
+    size_t bytes = 0;
+    bool resident = false;
+    float score = 0.0f;  // lower is more important
+  };
+  std::vector<Cell> _cells;
+  CellStats _stats;
+};
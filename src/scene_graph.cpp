@@ -0,0 +1,205 @@
+#include "scene_graph.hpp"
+#include "model.hpp"
+
+SceneGraph::SceneGraph() {}
+
+SceneGraph::NodeId SceneGraph::addNode(NodeId parent,
+                                       const glm::vec3& translation,
+                                       const glm::quat& rotation,
+                                       const glm::vec3& scale) {
+  uint32_t slot = static_cast<uint32_t>(size());
+  NodeId id = static_cast<NodeId>(_slots.size());
+  uint32_t parent_slot = parent == SCENE_NODE_NONE ? SCENE_NODE_NONE
+                                                   : _slots[parent];
+  _translations.push_back(translation);
+  _rotations.push_back(rotation);
+  _scales.push_back(scale);
+  _parents.push_back(parent_slot);
+  _subtree_sizes.push_back(1);
+  _dirty.push_back(1);
+  _worlds.push_back(glm::mat4(1.0f));
+  _bounds_centers.push_back(glm::vec3(0.0f));
+  _bounds_halfsizes.push_back(glm::vec3(0.0f));
+  _world_centers.push_back(glm::vec3(0.0f));
+  _world_halfsizes.push_back(glm::vec3(0.0f));
+  _ids.push_back(id);
+  _slots.push_back(slot);
+  // Still depth first when every ancestor subtree ends right before the new
+  // slot, which is the case when nodes are added depth first
+  for (uint32_t ancestor = parent_slot;
+       ancestor != SCENE_NODE_NONE && _sorted;
+       ancestor = _parents[ancestor]) {
+    if (ancestor + _subtree_sizes[ancestor] == slot) {
+      _subtree_sizes[ancestor]++;
+    } else {
+      _sorted = false;
+    }
+  }
+  return (id);
+}
+
+SceneGraph::NodeId SceneGraph::addNode(NodeId parent, const glm::mat4& local) {
+  glm::vec3 columns[3] = {glm::vec3(local[0]), glm::vec3(local[1]),
+                          glm::vec3(local[2])};
+  glm::vec3 scale = glm::vec3(glm::length(columns[0]),
+                              glm::length(columns[1]),
+                              glm::length(columns[2]));
+  if (glm::determinant(glm::mat3(local)) < 0.0f) scale.x = -scale.x;
+  for (int i = 0; i < 3; i++) {
+    if (scale[i] != 0.0f) columns[i] /= scale[i];
+  }
+  glm::quat rotation = glm::quat_cast(glm::mat3(columns[0], columns[1],
+                                                columns[2]));
+  return (addNode(parent, glm::vec3(local[3]), rotation, scale));
+}
+
+void SceneGraph::setTranslation(NodeId node, const glm::vec3& translation) {
+  _translations[_slots[node]] = translation;
+  _dirty[_slots[node]] = 1;
+}
+
+void SceneGraph::setRotation(NodeId node, const glm::quat& rotation) {
+  _rotations[_slots[node]] = rotation;
+  _dirty[_slots[node]] = 1;
+}
+
+void SceneGraph::setScale(NodeId node, const glm::vec3& scale) {
+  _scales[_slots[node]] = scale;
+  _dirty[_slots[node]] = 1;
+}
+
+void SceneGraph::setBounds(NodeId node, const glm::vec3& aabb_center,
+                           const glm::vec3& aabb_halfsize) {
+  _bounds_centers[_slots[node]] = aabb_center;
+  _bounds_halfsizes[_slots[node]] = aabb_halfsize;
+  _dirty[_slots[node]] = 1;
+}
+
+size_t SceneGraph::update() {
+  if (_sorted == false) sort();
+  uint32_t count = static_cast<uint32_t>(size());
+  if (std::find(_dirty.begin(), _dirty.end(), 1) == _dirty.end()) return (0);
+  // Roots first, then the subtrees of their children as separate tasks
+  size_t updated = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  for (uint32_t root = 0; root < count; root += _subtree_sizes[root]) {
+    if (_dirty[root]) {
+      updateSlot(root);
+      updated++;
+    }
+    uint32_t end = root + _subtree_sizes[root];
+    for (uint32_t child = root + 1; child < end;
+         child += _subtree_sizes[child]) {
+      ranges.emplace_back(child, child + _subtree_sizes[child]);
+    }
+  }
+  std::vector<size_t> range_updates(ranges.size(), 0);
+  ThreadPool::shared().parallelFor(
+      ranges.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          range_updates[i] = updateRange(ranges[i].first, ranges[i].second);
+        }
+      });
+  for (size_t range_updated : range_updates) updated += range_updated;
+  std::fill(_dirty.begin(), _dirty.end(), 0);
+  return (updated);
+}
+
+// The parent of the first slot is a root that is already up to date
+size_t SceneGraph::updateRange(uint32_t begin, uint32_t end) {
+  size_t updated = 0;
+  for (uint32_t slot = begin; slot < end; slot++) {
+    if (_dirty[slot] == 0 && _dirty[_parents[slot]] == 0) continue;
+    _dirty[slot] = 1;  // so that the children follow
+    updateSlot(slot);
+    updated++;
+  }
+  return (updated);
+}
+
+void SceneGraph::updateSlot(uint32_t slot) {
+  glm::mat4 local = glm::translate(_translations[slot]) *
+                    glm::mat4_cast(_rotations[slot]) *
+                    glm::scale(_scales[slot]);
+  uint32_t parent = _parents[slot];
+  _worlds[slot] = parent == SCENE_NODE_NONE ? local : _worlds[parent] * local;
+  _world_centers[slot] = _bounds_centers[slot];
+  _world_halfsizes[slot] = _bounds_halfsizes[slot];
+  transformAABB(_worlds[slot], _world_centers[slot], _world_halfsizes[slot]);
+}
+
+template <typename T>
+static void permute(std::vector<T>& values,
+                    const std::vector<uint32_t>& order) {
+  std::vector<T> sorted;
+  sorted.reserve(values.size());
+  for (uint32_t slot : order) sorted.push_back(values[slot]);
+  values.swap(sorted);
+}
+
+// Depth first, siblings keep their relative order
+void SceneGraph::sort() {
+  uint32_t count = static_cast<uint32_t>(size());
+  std::vector<std::vector<uint32_t>> children(count + 1);
+  for (uint32_t slot = 0; slot < count; slot++) {
+    uint32_t parent = _parents[slot];
+    children[parent == SCENE_NODE_NONE ? count : parent].push_back(slot);
+  }
+  std::vector<uint32_t> order;
+  order.reserve(count);
+  std::vector<uint32_t> stack(children[count].rbegin(),
+                              children[count].rend());
+  while (stack.empty() == false) {
+    uint32_t slot = stack.back();
+    stack.pop_back();
+    order.push_back(slot);
+    stack.insert(stack.end(), children[slot].rbegin(), children[slot].rend());
+  }
+
+  std::vector<uint32_t> new_slots(count);
+  for (uint32_t slot = 0; slot < count; slot++) new_slots[order[slot]] = slot;
+  for (auto& parent : _parents) {
+    if (parent != SCENE_NODE_NONE) parent = new_slots[parent];
+  }
+  permute(_translations, order);
+  permute(_rotations, order);
+  permute(_scales, order);
+  permute(_parents, order);
+  permute(_dirty, order);
+  permute(_worlds, order);
+  permute(_bounds_centers, order);
+  permute(_bounds_halfsizes, order);
+  permute(_world_centers, order);
+  permute(_world_halfsizes, order);
+  permute(_ids, order);
+  for (uint32_t slot = 0; slot < count; slot++) _slots[_ids[slot]] = slot;
+
+  // Children come after their parent, sizes add up from the back
+  std::fill(_subtree_sizes.begin(), _subtree_sizes.end(), 1);
+  for (uint32_t slot = count; slot-- > 0;) {
+    if (_parents[slot] != SCENE_NODE_NONE) {
+      _subtree_sizes[_parents[slot]] += _subtree_sizes[slot];
+    }
+  }
+  _sorted = true;
+}
+
+const glm::mat4& SceneGraph::world(NodeId node) const {
+  return (_worlds[_slots[node]]);
+}
+
+void SceneGraph::worldBounds(NodeId node, glm::vec3& aabb_center,
+                             glm::vec3& aabb_halfsize) const {
+  aabb_center = _world_centers[_slots[node]];
+  aabb_halfsize = _world_halfsizes[_slots[node]];
+}
+
+const glm::vec3& SceneGraph::translation(NodeId node) const {
+  return (_translations[_slots[node]]);
+}
+
+const glm::quat& SceneGraph::rotation(NodeId node) const {
+  return (_rotations[_slots[node]]);
+}
+
+size_t SceneGraph::size() const { return (_ids.size()); }
@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "forward.hpp"
+#include "thread_pool.hpp"
+
+#define SCENE_NODE_NONE 0xffffffffu  // parent of the roots
+
+// Transform hierarchy stored as arrays of local TRS, parent and cached world
+// matrix. Slots are kept in depth first order so that every subtree is a
+// contiguous range after its root: one linear pass updates the world
+// matrices, and the subtrees below the roots are updated in parallel. Node
+// ids stay valid when slots are reordered.
+class SceneGraph {
+ public:
+  typedef uint32_t NodeId;
+
+  SceneGraph();
+
+  NodeId addNode(NodeId parent, const glm::vec3& translation,
+                 const glm::quat& rotation, const glm::vec3& scale);
+  // Shear is dropped, the matrix is split in translation, rotation and scale
+  NodeId addNode(NodeId parent, const glm::mat4& local);
+
+  void setTranslation(NodeId node, const glm::vec3& translation);
+  void setRotation(NodeId node, const glm::quat& rotation);
+  void setScale(NodeId node, const glm::vec3& scale);
+  // Bounds in the node space, the world bounds follow the world matrix
+  void setBounds(NodeId node, const glm::vec3& aabb_center,
+                 const glm::vec3& aabb_halfsize);
+
+  // Recomputes the nodes that changed since the last update and everything
+  // below them, returns how many were recomputed
+  size_t update();
+
+  const glm::mat4& world(NodeId node) const;
+  void worldBounds(NodeId node, glm::vec3& aabb_center,
+                   glm::vec3& aabb_halfsize) const;
+  const glm::vec3& translation(NodeId node) const;
+  const glm::quat& rotation(NodeId node) const;
+  size_t size() const;
+
+ private:
+  // Per slot
+  std::vector<glm::vec3> _translations;
+  std::vector<glm::quat> _rotations;
+  std::vector<glm::vec3> _scales;
+  std::vector<uint32_t> _parents;  // slot of the parent
+  std::vector<uint32_t> _subtree_sizes;  // the node included
+  std::vector<uint8_t> _dirty;
+  std::vector<glm::mat4> _worlds;
+  std::vector<glm::vec3> _bounds_centers;
+  std::vector<glm::vec3> _bounds_halfsizes;
+  std::vector<glm::vec3> _world_centers;
+  std::vector<glm::vec3> _world_halfsizes;
+  std::vector<NodeId> _ids;
+  // Per node id
+  std::vector<uint32_t> _slots;
+  bool _sorted = true;
+
+  void sort();
+  size_t updateRange(uint32_t begin, uint32_t end);
+  void updateSlot(uint32_t slot);
+};
@@ -0,0 +1,192 @@
+#include "stress_scene.hpp"
+
+static unsigned int gridColumns(unsigned int instances) {
+  return (static_cast<unsigned int>(
+      std::ceil(std::sqrt(static_cast<float>(std::max(instances, 1u))))));
+}
+
+std::vector<glm::vec3> StressScene::tileOffsets(
+    const glm::vec3& aabb_halfsize) const {
+  unsigned int count = std::max(instances, 1u);
+  unsigned int columns = gridColumns(count);
+  unsigned int rows = (count + columns - 1) / columns;
+  glm::vec2 pitch = glm::vec2(aabb_halfsize.x, aabb_halfsize.z) * 2.0f *
+                    spacing;
+  glm::vec2 origin = -pitch * glm::vec2(columns - 1, rows - 1) * 0.5f;
+  std::vector<glm::vec3> offsets;
+  for (unsigned int i = 0; i < count; i++) {
+    glm::vec2 tile = origin + pitch * glm::vec2(i % columns, i / columns);
+    offsets.push_back(glm::vec3(tile.x, 0.0f, tile.y));
+  }
+  return (offsets);
+}
+
+glm::vec3 StressScene::tiledHalfsize(const glm::vec3& aabb_halfsize) const {
+  unsigned int count = std::max(instances, 1u);
+  unsigned int columns = gridColumns(count);
+  unsigned int rows = (count + columns - 1) / columns;
+  glm::vec3 pitch = aabb_halfsize * 2.0f * spacing;
+  return (aabb_halfsize +
+          glm::vec3(pitch.x * (columns - 1), 0.0f, pitch.z * (rows - 1)) *
+              0.5f);
+}
+
+static bool parseRange(const std::string& value, float& min, float& max) {
+  size_t colon = value.find(':');
+  try {
+    min = std::stof(value.substr(0, colon));
+    max = colon == std::string::npos ? min : std::stof(value.substr(colon + 1));
+  } catch (const std::exception&) {
+    return (false);
+  }
+  return (min <= max);
+}
+
+static bool parseOption(std::string key, const std::string& value,
+                        StressScene& stress);
+
+static bool parseConfig(const std::string& filename, StressScene& stress) {
+  std::ifstream file(filename);
+  if (file.is_open() == false) {
+    std::cerr << "Cannot open config: " << filename << std::endl;
+    return (false);
+  }
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    line = line.substr(0, line.find('#'));
+    size_t equal = line.find('=');
+    auto trim = [](std::string text) {
+      text.erase(0, text.find_first_not_of(" \t\r"));
+      text.erase(text.find_last_not_of(" \t\r") + 1);
+      return (text);
+    };
+    if (trim(line).empty()) continue;
+    if (equal == std::string::npos ||
+        parseOption(trim(line.substr(0, equal)), trim(line.substr(equal + 1)),
+                    stress) == false) {
+      std::cerr << filename << ":" << line_number << ": invalid line"
+                << std::endl;
+      return (false);
+    }
+  }
+  return (true);
+}
+
+static bool parseOption(std::string key, const std::string& value,
+                        StressScene& stress) {
+  std::replace(key.begin(), key.end(), '-', '_');
+  try {
+    if (key == "config") return (parseConfig(value, stress));
+    if (key == "scene") {
+      stress.scene = value;
+    } else if (key == "instances") {
+      stress.instances = static_cast<unsigned int>(std::stoul(value));
+    } else if (key == "spacing") {
+      stress.spacing = std::stof(value);
+    } else if (key == "instancing") {
+      stress.instancing = std::stoi(value) != 0;
+    } else if (key == "lights") {
+      stress.lights = static_cast<unsigned int>(std::stoul(value));
+    } else if (key == "light_spread") {
+      stress.light_spread = std::stof(value);
+    } else if (key == "light_radius") {
+      return (parseRange(value, stress.light_radius_min,
+                         stress.light_radius_max));
+    } else if (key == "light_speed") {
+      return (parseRange(value, stress.light_speed_min,
+                         stress.light_speed_max));
+    } else if (key == "seed") {
+      stress.seed = static_cast<unsigned int>(std::stoul(value));
+    } else if (key == "tile_spin") {
+      stress.tile_spin = std::stof(value);
+    } else if (key == "cluster_culling") {
+      stress.cluster_culling = std::stoi(value) != 0;
+    } else if (key == "lod") {
+      stress.lod = std::stoi(value) != 0;
+    } else if (key == "static_lights") {
+      stress.static_lights = std::stoi(value) != 0;
+    } else if (key == "texture_compression") {
+      stress.texture_compression = std::stoi(value) != 0;
+    } else if (key == "virtual_texturing") {
+      stress.virtual_texturing = std::stoi(value) != 0;
+    } else if (key == "upload_budget") {
+      stress.upload_budget = std::stof(value);
+    } else if (key == "texture_budget") {
+      stress.texture_budget = static_cast<unsigned int>(std::stoul(value));
+    } else if (key == "cell_budget") {
+      stress.cell_budget = static_cast<unsigned int>(std::stoul(value));
+    } else {
+      return (false);
+    }
+  } catch (const std::exception&) {
+    return (false);
+  }
+  return (true);
+}
+
+bool parseStressScene(int argc, char** argv, StressScene& stress) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") return (false);
+    if (arg.compare(0, 2, "--") != 0) {
+      stress.scene = arg;
+      continue;
+    }
+    std::string key = arg.substr(2);
+    std::string value;
+    size_t equal = key.find('=');
+    if (equal != std::string::npos) {
+      value = key.substr(equal + 1);
+      key = key.substr(0, equal);
+    } else if (i + 1 < argc) {
+      value = argv[++i];
+    }
+    if (parseOption(key, value, stress) == false) {
+      std::cerr << "Invalid option: " << arg << " " << value << std::endl;
+      return (false);
+    }
+  }
+  if (stress.lights > MAX_LIGHTS_PER_TILE) {
+    std::cerr << "lights capped to " << MAX_LIGHTS_PER_TILE << std::endl;
+    stress.lights = MAX_LIGHTS_PER_TILE;
+  }
+  stress.spacing = std::max(stress.spacing, 0.0f);
+  stress.light_spread = glm::clamp(stress.light_spread, 0.0f, 1.0f);
+  return (true);
+}
+
+void printStressSceneUsage(const char* program) {
+  std::cerr
+      << "usage: " << program << " [scene] [--option value]..." << std::endl
+      << "  --config file        key = value lines of the options below"
+      << std::endl
+      << "  --instances n        copies of the scene in a square grid (1)"
+      << std::endl
+      << "  --spacing f          tile pitch in scene footprints (1.1)"
+      << std::endl
+      << "  --instancing 0|1     draw the tiles of a mesh instanced (1)"
+      << std::endl
+      << "  --lights n           up to " << MAX_LIGHTS_PER_TILE << " ("
+      << NUM_LIGHTS << ")" << std::endl
+      << "  --light-spread f     footprint fraction lights spawn in (1)"
+      << std::endl
+      << "  --light-radius a:b   uniform radius range (4)" << std::endl
+      << "  --light-speed a:b    rising speed range, 0 is static (0.5:5)"
+      << std::endl
+      << "  --seed n             random seed (0)" << std::endl
+      << "  --tile-spin f        degrees per second the tiles turn (0)"
+      << std::endl
+      << "  --texture-compression 0|1  block compressed textures (1)"
+      << std::endl
+      << "  --virtual-texturing 0|1    page obj textures on demand (0)"
+      << std::endl
+      << "  --texture-budget mib       drop levels past it, 0 is none (0)"
+      << std::endl
+      << "  --upload-budget ms         streaming uploads per frame ("
+      << STREAMING_UPLOAD_BUDGET_MS << ")" << std::endl
+      << "  --cell-budget mib          cell geometry kept resident ("
+      << CELL_GPU_BUDGET_MB << ")" << std::endl
+      << "  --cluster-culling, --lod, --static-lights 0|1" << std::endl;
+}
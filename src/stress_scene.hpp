@@ -0,0 +1,46 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "asset_streamer.hpp"
+#include "forward.hpp"
+#include "scene_cells.hpp"
+
+// Scene and light setup given on the command line or in a config file, the
+// defaults are a single sponza with NUM_LIGHTS lights
+struct StressScene {
+  std::string scene = "data/sponza/sponza.obj";
+  unsigned int instances = 1;  // copies of the scene tiled in a square grid
+  float spacing = 1.1f;        // tile pitch, in scene footprints
+  bool instancing = true;      // tiles of a mesh share instanced draws
+  unsigned int lights = NUM_LIGHTS;
+  float light_spread = 1.0f;  // fraction of the footprint lights spawn in
+  float light_radius_min = 4.0f;
+  float light_radius_max = 4.0f;
+  float light_speed_min = 0.5f;
+  float light_speed_max = 5.0f;
+  unsigned int seed = 0;
+  float tile_spin = 0.0f;  // degrees per second, tiles turn about their center
+  // Initial pipeline modes, toggled at runtime as usual
+  bool cluster_culling = true;
+  bool lod = true;
+  bool static_lights = false;
+  bool texture_compression = true;  // BC1 to BC5 arrays through the cache
+  bool virtual_texturing = false;    // obj textures paged in on demand
+  unsigned int texture_budget = 0;   // MiB, 0 keeps every level resident
+  float upload_budget = STREAMING_UPLOAD_BUDGET_MS;  // per frame
+  unsigned int cell_budget = CELL_GPU_BUDGET_MB;     // MiB of cell geometry
+
+  // Translations of the tiles in scene space, centered on the origin
+  std::vector<glm::vec3> tileOffsets(const glm::vec3& aabb_halfsize) const;
+  // Bounds of the whole grid
+  glm::vec3 tiledHalfsize(const glm::vec3& aabb_halfsize) const;
+};
+
+// Arguments are the scene then --key value or --key=value options,
+// --config reads key = value lines, '#' starts a comment
+bool parseStressScene(int argc, char** argv, StressScene& stress);
+void printStressSceneUsage(const char* program);
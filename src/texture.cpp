@@ -1,10 +1,8 @@
 #include "texture.hpp"
-#define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 Texture::Texture(std::string filename) : id(0), filename(filename) {
   int texChannels;
-  stbi_set_flip_vertically_on_load(true);
   stbi_uc* pixels = stbi_load(filename.c_str(), &this->width, &this->height,
                               &texChannels, STBI_rgb_alpha);
   if (pixels != nullptr) {
@@ -23,6 +21,9 @@ Texture::Texture(std::string filename) : id(0), filename(filename) {
 
     stbi_image_free(pixels);
     glBindTexture(GL_TEXTURE_2D, 0);
+    // RGBA8 and a third more for the mipmaps
+    TextureResidency::shared().track(
+        this, static_cast<size_t>(width) * height * 4 * 4 / 3);
   }
 }
 
@@ -72,6 +73,8 @@ Texture::Texture(std::string filename, int offset_x, int offset_y) {
 
     stbi_image_free(pixels);
     glBindTexture(GL_TEXTURE_2D, 0);
+    TextureResidency::shared().track(
+        this, static_cast<size_t>(width) * height * 4 * 4 / 3);
   } else {
     throw std::runtime_error("Cannot load texture (" + filename + ")");
   }
@@ -81,12 +84,14 @@ Texture::Texture(const std::vector<std::string>& textures) : id(0) {
   glGenTextures(1, &this->id);
   glBindTexture(GL_TEXTURE_CUBE_MAP, this->id);
   int width, height, nrChannels;
+  size_t bytes = 0;
   for (unsigned int i = 0; i < textures.size(); i++) {
     unsigned char* data =
         stbi_load(textures[i].c_str(), &width, &height, &nrChannels, 0);
     if (data) {
       glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height,
                    0, GL_RGB, GL_UNSIGNED_BYTE, data);
+      bytes += static_cast<size_t>(width) * height * 3;
       stbi_image_free(data);
     } else {
       stbi_image_free(data);
@@ -100,65 +105,363 @@ Texture::Texture(const std::vector<std::string>& textures) : id(0) {
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
   glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  TextureResidency::shared().track(this, bytes);
 }
 
 Texture::~Texture() {
+  TextureResidency::shared().untrack(this);
   if (this->id != 0) {
     glDeleteTextures(1, &this->id);
   }
 }
 
-TextureArray::TextureArray(const std::vector<std::string>& textures) {
-  std::set<std::string> texture_set;
+GLenum internalFormat(BlockFormat format, int channels, bool srgb) {
+  switch (format) {
+    case BlockFormat::BC1:
+      return (srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+                   : GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+    case BlockFormat::BC3:
+      return (srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+                   : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+    case BlockFormat::BC4:
+      return (GL_COMPRESSED_RED_RGTC1);
+    case BlockFormat::BC5:
+      return (GL_COMPRESSED_RG_RGTC2);
+    default:
+      if (channels == 1) return (GL_R8);
+      if (channels == 2) return (GL_RG8);
+      return (srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+  }
+}
 
-  for (const auto& texture : textures) {
-    texture_set.insert(texture);
+GLenum pixelFormat(int channels) {
+  if (channels == 1) return (GL_RED);
+  return (channels == 2 ? GL_RG : GL_RGBA);
+}
+
+static int fullLevelCount(int width, int height) {
+  int level_count = 1;
+  while ((width >> level_count) > 0 || (height >> level_count) > 0) {
+    level_count++;
   }
-  GLint internal_format = 0;
-  GLenum format = 0;
-  stbi_set_flip_vertically_on_load(true);
+  return (level_count);
+}
+
+struct DecodedLayer {
+  Image image;
+  bool loaded = false;
+  float decode_ms = 0.0f;
+};
+
+// Files are decoded on the shared pool a few layers ahead of the GL thread,
+// which uploads them in order as soon as each one is ready
+TextureArray::TextureArray(const std::vector<std::string>& textures,
+                           BlockFormat block_format, bool srgb)
+    : _source_format(block_format), _srgb(srgb) {
+  std::set<std::string> texture_set(textures.begin(), textures.end());
+  std::vector<std::string> names(texture_set.begin(), texture_set.end());
+  if (names.empty()) return;
+  _layer_names.resize(names.size());
+  auto start = std::chrono::steady_clock::now();
+  ThreadPool& pool = ThreadPool::shared();
+  size_t decode_ahead = pool.size() * 2;
+  std::vector<DecodedLayer> layers(names.size());
+  std::vector<std::future<void>> decodes;
+  auto submitDecode = [&pool, &names, &layers, &decodes, block_format,
+                       srgb]() {
+    size_t i = decodes.size();
+    decodes.push_back(pool.submit([&names, &layers, i, block_format, srgb]() {
+      auto decode_start = std::chrono::steady_clock::now();
+      layers[i].loaded =
+          loadCachedImage(names[i], block_format, srgb, layers[i].image);
+      layers[i].decode_ms = std::chrono::duration<float, std::milli>(
+                                std::chrono::steady_clock::now() -
+                                decode_start)
+                                .count();
+    }));
+  };
+
+  float serial_ms = 0.0f;
   int zoffset = 0;
-  for (auto it : texture_set) {
-    int tex_channels;
-    stbi_uc* pixels =
-        stbi_load(it.c_str(), &width, &height, &tex_channels, STBI_default);
-
-    if (pixels != nullptr) {
-      if (id == 0) {
-        if (tex_channels == 1) {
-          internal_format = GL_R8;
-          format = GL_RED;
-        } else if (tex_channels == 4) {
-          internal_format = GL_RGBA8;
-          format = GL_RGBA;
-        } else {
-          assert(0);
-        }
-        glGenTextures(1, &id);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, id);
-        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format, width, height,
-                     static_cast<GLuint>(texture_set.size()), 0, format,
-                     GL_UNSIGNED_BYTE, NULL);
-      }
-      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, zoffset, width, height, 1,
-                      format, GL_UNSIGNED_BYTE, pixels);
-      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
-                      GL_NEAREST_MIPMAP_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
-
-      stbi_image_free(pixels);
-      _lookup_table.emplace(it, zoffset);
-      zoffset++;
+  for (size_t i = 0; i < names.size(); i++) {
+    while (decodes.size() < std::min(names.size(), i + decode_ahead)) {
+      submitDecode();
+    }
+    decodes[i].wait();
+    DecodedLayer& layer = layers[i];
+    if (layer.loaded == false) continue;
+    serial_ms += layer.decode_ms;
+    std::cout << names[i] << ": decoded in " << layer.decode_ms << " ms"
+              << std::endl;
+    const ImageLevel& pixels = layer.image.levels[0];
+    if (id == 0) {
+      width = pixels.width;
+      height = pixels.height;
+      format = layer.image.format;
+      _channels = layer.image.channels;
+      allocate(fullLevelCount(width, height),
+               static_cast<GLsizei>(names.size()));
+    } else if (pixels.width != width || pixels.height != height ||
+               layer.image.channels != _channels ||
+               layer.image.format != format) {
+      std::cout << "skipping " << names[i] << ": " << pixels.width << "x"
+                << pixels.height << "x" << layer.image.channels << " "
+                << blockFormatName(layer.image.format) << " in a " << width
+                << "x" << height << "x" << _channels << " "
+                << blockFormatName(format) << " array" << std::endl;
+      layer.image = Image();
+      continue;
+    }
+    uploadLevels(zoffset, layer.image);
+    layer.image = Image();
+    _lookup_table.emplace(names[i], zoffset);
+    _layer_names[zoffset] = names[i];
+    zoffset++;
+  }
+  if (id == 0) return;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  std::cout << zoffset << " textures loaded in "
+            << std::chrono::duration<float, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << " ms, " << serial_ms << " ms of decoding on "
+            << pool.size() << " threads" << std::endl;
+}
+
+TextureArray::TextureArray(const std::vector<std::string>& textures,
+                           const Package& package, bool srgb)
+    : _srgb(srgb) {
+  std::set<std::string> texture_set(textures.begin(), textures.end());
+  // Layers have to share the size and level count of the first one
+  PackageTexture first;
+  std::vector<std::pair<std::string, const PackageEntry*>> layers;
+  for (const auto& name : texture_set) {
+    const PackageEntry* entry = package.find(name, PackageEntryType::Texture);
+    if (entry == nullptr || entry->size < sizeof(PackageTexture)) continue;
+    PackageTexture texture;
+    std::memcpy(&texture, package.data(*entry), sizeof(PackageTexture));
+    if (layers.empty()) {
+      first = texture;
+    } else if (texture.width != first.width ||
+               texture.height != first.height ||
+               texture.channels != first.channels ||
+               texture.level_count != first.level_count) {
+      std::cout << "skipping " << name << ": " << texture.width << "x"
+                << texture.height << " in a " << first.width << "x"
+                << first.height << " array" << std::endl;
+      continue;
+    }
+    layers.emplace_back(name, entry);
+  }
+  if (layers.empty() || (first.channels != 1 && first.channels != 2 &&
+                         first.channels != 4)) {
+    return;
+  }
+  GLenum pixel_format = pixelFormat(static_cast<int>(first.channels));
+  width = static_cast<int>(first.width);
+  height = static_cast<int>(first.height);
+  _channels = static_cast<int>(first.channels);
+  allocate(static_cast<int>(first.level_count),
+           static_cast<GLsizei>(layers.size()));
+  // Single channel rows are not 4 bytes aligned past the first levels
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  int zoffset = 0;
+  for (const auto& layer : layers) {
+    for (uint32_t level = 0; level < first.level_count; level++) {
+      int level_width, level_height;
+      const unsigned char* pixels =
+          package.textureLevel(*layer.second, level, level_width, level_height);
+      if (pixels == nullptr) break;
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, zoffset, level_width,
+                      level_height, 1, pixel_format, GL_UNSIGNED_BYTE, pixels);
+    }
+    _lookup_table.emplace(layer.first, zoffset);
+    zoffset++;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+TextureArray::TextureArray(const std::vector<std::string>& textures, int width,
+                           int height, int channels, BlockFormat block_format,
+                           bool srgb)
+    : height(height),
+      width(width),
+      _channels(channels),
+      _source_format(block_format),
+      _srgb(srgb) {
+  if (textures.empty() || (channels != 1 && channels != 2 && channels != 4)) {
+    return;
+  }
+  // Levels of a compressed array start as whole blocks
+  if (width % 4 == 0 && height % 4 == 0) format = block_format;
+  _layer_names.resize(textures.size());
+  allocate(fullLevelCount(width, height),
+           static_cast<GLsizei>(textures.size()));
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  int zoffset = 0;
+  for (const auto& texture : textures) {
+    _pending_layers.emplace(texture, zoffset);
+    zoffset++;
+  }
+}
+
+// Every level of every layer, left bound. Arrays read from files are sparse
+// under a texture budget if their size is made of whole pages, nothing is
+// committed until a layer is uploaded
+void TextureArray::allocate(int level_count, GLsizei layer_count) {
+  _level_count = level_count;
+  _layer_frames.assign(layer_count, 0);
+  _first_levels.assign(layer_count, level_count);
+  GLenum internal_format = internalFormat(format, _channels, _srgb);
+  glGenTextures(1, &id);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+  TextureResidency& residency = TextureResidency::shared();
+  if (_layer_names.empty() == false && residency.sparse()) {
+    GLint page_x = 0, page_y = 0;
+    glGetInternalformativ(GL_TEXTURE_2D_ARRAY, internal_format,
+                          GL_VIRTUAL_PAGE_SIZE_X_ARB, 1, &page_x);
+    glGetInternalformativ(GL_TEXTURE_2D_ARRAY, internal_format,
+                          GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1, &page_y);
+    sparse = page_x > 0 && page_y > 0 && width % page_x == 0 &&
+             height % page_y == 0;
+  }
+  if (sparse) {
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, level_count, internal_format, width,
+                   height, layer_count);
+    glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_NUM_SPARSE_LEVELS_ARB,
+                        &_sparse_levels);
+    residency.addArray(this);
+  }
+  for (int level = 0; level < level_count; level++) {
+    int level_width = std::max(width >> level, 1);
+    int level_height = std::max(height >> level, 1);
+    size_t level_size = levelBytes(level) * layer_count;
+    uncompressed_bytes += imageLevelSize(BlockFormat::None, _channels,
+                                         level_width, level_height) *
+                          layer_count;
+    if (sparse) continue;
+    if (format == BlockFormat::None) {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format, level_width,
+                   level_height, layer_count, 0, pixelFormat(_channels),
+                   GL_UNSIGNED_BYTE, NULL);
+    } else {
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format,
+                             level_width, level_height, layer_count, 0,
+                             static_cast<GLsizei>(level_size), NULL);
     }
+    gpu_bytes += level_size;
+  }
+  residency.track(this, gpu_bytes);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+// One level of a layer, pixels are an offset when an unpack buffer is bound.
+// The array has to be bound
+void TextureArray::uploadLevel(int zoffset, int level, int level_width,
+                               int level_height, const void* pixels,
+                               size_t size) {
+  if (format == BlockFormat::None) {
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, zoffset, level_width,
+                    level_height, 1, pixelFormat(_channels), GL_UNSIGNED_BYTE,
+                    pixels);
+  } else {
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, zoffset,
+                              level_width, level_height, 1,
+                              internalFormat(format, _channels, _srgb),
+                              static_cast<GLsizei>(size), pixels);
   }
-  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Layers of a sparse array are committed before their first upload
+void TextureArray::commitLayer(int zoffset) {
+  if (sparse && _first_levels[zoffset] == _level_count) {
+    commitLevels(zoffset, 0, _level_count, true);
+  }
+  _first_levels[zoffset] = 0;
+}
+
+// Levels the image has, the array has to be bound
+void TextureArray::uploadLevels(int zoffset, const Image& image) {
+  commitLayer(zoffset);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  int level_count =
+      std::min(static_cast<int>(image.levels.size()), _level_count);
+  for (int level = 0; level < level_count; level++) {
+    const ImageLevel& pixels = image.levels[level];
+    uploadLevel(zoffset, level, pixels.width, pixels.height,
+                pixels.pixels.data(), pixels.pixels.size());
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// Layer of a pending texture, -1 if there is none or if the image does not
+// match the array, the texture is no longer pending either way
+int TextureArray::claimPendingLayer(const std::string& texture_name,
+                                    int channels, BlockFormat image_format,
+                                    int image_width, int image_height) {
+  auto layer = _pending_layers.find(texture_name);
+  if (layer == _pending_layers.end()) return (-1);
+  int zoffset = layer->second;
+  _pending_layers.erase(layer);
+  if (channels != _channels || image_format != format ||
+      image_width != width || image_height != height) {
+    std::cout << "skipping " << texture_name << ": does not match its "
+              << width << "x" << height << " " << blockFormatName(format)
+              << " array" << std::endl;
+    return (-1);
+  }
+  _lookup_table.emplace(texture_name, zoffset);
+  _layer_names[zoffset] = texture_name;
+  return (zoffset);
+}
+
+bool TextureArray::uploadLayer(const std::string& texture_name,
+                               const Image& image) {
+  int zoffset = claimPendingLayer(
+      texture_name, image.channels, image.format,
+      image.levels.empty() ? 0 : image.levels[0].width,
+      image.levels.empty() ? 0 : image.levels[0].height);
+  if (zoffset < 0) return (false);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+  uploadLevels(zoffset, image);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  return (true);
+}
+
+// Copies are only queued, the GPU reads the ring after the call returns
+bool TextureArray::uploadLayer(const std::string& texture_name,
+                               const StagedImage& image) {
+  int zoffset = claimPendingLayer(
+      texture_name, image.channels, image.format,
+      image.levels.empty() ? 0 : image.levels[0].width,
+      image.levels.empty() ? 0 : image.levels[0].height);
+  if (zoffset < 0) return (false);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image.buffer);
+  commitLayer(zoffset);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  int level_count =
+      std::min(static_cast<int>(image.levels.size()), _level_count);
+  for (int level = 0; level < level_count; level++) {
+    const CachedLevel& pixels = image.levels[level];
+    uploadLevel(zoffset, level, pixels.width, pixels.height,
+                reinterpret_cast<const void*>(image.levelOffset(level)),
+                pixels.size);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  return (true);
+}
+
+int TextureArray::findTextureIndex(const std::string& texture_name) const {
+  auto res = _lookup_table.find(texture_name);
+  return (res != _lookup_table.end() ? res->second : -1);
 }
 
 int TextureArray::getTextureIndex(std::string texture_name) {
@@ -170,7 +473,119 @@ int TextureArray::getTextureIndex(std::string texture_name) {
   return (-1);
 }
 
+size_t TextureArray::levelBytes(int level) const {
+  return (imageLevelSize(format, _channels, std::max(width >> level, 1),
+                         std::max(height >> level, 1)));
+}
+
+// Pages of levels [first, last) of a layer, the array has to be bound. The
+// mip tail is committed with the first level in it
+void TextureArray::commitLevels(int layer, int first, int last, bool commit) {
+  for (int level = first; level < last; level++) {
+    glTexPageCommitmentARB(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                           std::max(width >> level, 1),
+                           std::max(height >> level, 1), 1,
+                           commit ? GL_TRUE : GL_FALSE);
+    if (commit) {
+      gpu_bytes += levelBytes(level);
+    } else {
+      gpu_bytes -= levelBytes(level);
+    }
+  }
+  TextureResidency::shared().track(this, gpu_bytes);
+}
+
+void TextureArray::touchLayer(int layer) {
+  if (layer >= 0 && layer < static_cast<int>(_layer_frames.size())) {
+    _layer_frames[layer] = TextureResidency::shared().frame();
+  }
+}
+
+int TextureArray::firstLevel(int layer) const {
+  if (sparse == false || layer < 0 ||
+      layer >= static_cast<int>(_first_levels.size()) ||
+      _first_levels[layer] == _level_count) {
+    return (0);
+  }
+  return (_first_levels[layer]);
+}
+
+// Levels in the mip tail stay, as does the last one
+static int droppableLevels(int sparse_levels, int level_count) {
+  return (std::min(sparse_levels, level_count - 1));
+}
+
+bool TextureArray::oldestDroppable(int& layer, uint64_t& last_use) const {
+  if (sparse == false) return (false);
+  int droppable = droppableLevels(_sparse_levels, _level_count);
+  bool found = false;
+  for (size_t i = 0; i < _first_levels.size(); i++) {
+    if (_first_levels[i] < droppable &&
+        (found == false || _layer_frames[i] < last_use)) {
+      layer = static_cast<int>(i);
+      last_use = _layer_frames[i];
+      found = true;
+    }
+  }
+  return (found);
+}
+
+bool TextureArray::restoreCandidate(uint64_t frame, int& layer,
+                                    size_t& bytes) const {
+  if (sparse == false) return (false);
+  int missing = 0;
+  for (size_t i = 0; i < _first_levels.size(); i++) {
+    if (_layer_frames[i] == frame && _first_levels[i] > missing &&
+        _first_levels[i] < _level_count && _layer_names[i].empty() == false) {
+      layer = static_cast<int>(i);
+      missing = _first_levels[i];
+    }
+  }
+  if (missing == 0) return (false);
+  bytes = levelBytes(missing - 1);
+  return (true);
+}
+
+bool TextureArray::dropLevel(int layer) {
+  int level = _first_levels[layer];
+  if (sparse == false ||
+      level >= droppableLevels(_sparse_levels, _level_count)) {
+    return (false);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+  commitLevels(layer, level, level + 1, false);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  _first_levels[layer] = level + 1;
+  return (true);
+}
+
+bool TextureArray::restoreLevel(int layer) {
+  int level = _first_levels[layer] - 1;
+  MappedImage image;
+  if (mapCachedImage(_layer_names[layer], _source_format, _srgb, image) ==
+          false ||
+      image.format != format || image.channels != _channels ||
+      static_cast<int>(image.levels.size()) <= level ||
+      image.levels[0].width != width || image.levels[0].height != height) {
+    std::cerr << "cannot restore " << _layer_names[layer] << std::endl;
+    _layer_names[layer].clear();
+    return (false);
+  }
+  const CachedLevel& pixels = image.levels[level];
+  glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+  commitLevels(layer, level, level + 1, true);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  uploadLevel(layer, level, pixels.width, pixels.height, pixels.data,
+              pixels.size);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  _first_levels[layer] = level;
+  return (true);
+}
+
 TextureArray::~TextureArray() {
+  TextureResidency::shared().untrack(this);
+  TextureResidency::shared().removeArray(this);
   if (this->id != 0) {
     glDeleteTextures(1, &this->id);
   }
@@ -1,12 +1,41 @@
 #pragma once
 #include <cassert>
+#include <chrono>
 #include <cstring>
+#include <future>
 #include <map>
 #include <queue>
 #include <set>
 #include <tuple>
 #include <vector>
+#include "block_compression.hpp"
 #include "env.hpp"
+#include "image.hpp"
+#include "package.hpp"
+#include "texture_residency.hpp"
+#include "thread_pool.hpp"
+#include "upload_ring.hpp"
+
+// EXT_texture_compression_s3tc, everywhere on desktop but not in the loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+// EXT_texture_sRGB, its S3TC formats are only in the extension
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// GL format of the levels of an image, R8, RG8 or RGBA8 when uncompressed.
+// Color formats of sRGB images are decoded to linear by the sampler
+GLenum internalFormat(BlockFormat format, int channels, bool srgb = false);
+// Client format of uncompressed levels
+GLenum pixelFormat(int channels);
 
 struct Texture {
   Texture(std::string filename);                              // Basic texture
@@ -21,14 +50,72 @@ struct Texture {
 };
 
 struct TextureArray {
-  TextureArray(const std::vector<std::string>& textures);
+  // Decoded in parallel, uploaded level by level in order on the calling GL
+  // thread. Mip chains are built on the CPU, in linear space for sRGB
+  // layers, and compressed to block_format, both through the texture cache
+  TextureArray(const std::vector<std::string>& textures,
+               BlockFormat block_format = BlockFormat::None,
+               bool srgb = false);
+  // Cooked textures, levels are uploaded from the package mapping
+  TextureArray(const std::vector<std::string>& textures,
+               const Package& package, bool srgb = false);
+  // Streamed textures, every level is allocated and layers are filled one by
+  // one with uploadLayer, in block_format if the size is made of whole blocks
+  TextureArray(const std::vector<std::string>& textures, int width,
+               int height, int channels,
+               BlockFormat block_format = BlockFormat::None,
+               bool srgb = false);
   ~TextureArray();
   int getTextureIndex(std::string texture_name);
+  // -1 until the layer is uploaded, silent unlike getTextureIndex
+  int findTextureIndex(const std::string& texture_name) const;
+  // Image levels and format have to match the array, false if it is not one
+  // of its textures
+  bool uploadLayer(const std::string& texture_name, const Image& image);
+  // Same from a block of the upload ring, which is released by the caller
+  bool uploadLayer(const std::string& texture_name, const StagedImage& image);
+
+  // Residency, layers are touched as they are drawn. Sparse arrays commit
+  // the levels of a layer when it is uploaded and can drop its top ones
+  void touchLayer(int layer);
+  int firstLevel(int layer) const;  // 0 unless levels were dropped
+  // Least recently drawn layer that can drop a level
+  bool oldestDroppable(int& layer, uint64_t& last_use) const;
+  // Layer drawn in the frame missing the most levels, bytes of the next one
+  bool restoreCandidate(uint64_t frame, int& layer, size_t& bytes) const;
+  bool dropLevel(int layer);
+  // Read back from the texture cache, false if it cannot be
+  bool restoreLevel(int layer);
 
   GLuint id = 0;
   int height = 0;
   int width = 0;
+  BlockFormat format = BlockFormat::None;
+  size_t gpu_bytes = 0;           // committed levels of every layer
+  size_t uncompressed_bytes = 0;  // every level as R8, RG8 or RGBA8
+  bool sparse = false;
 
  private:
   std::map<std::string, int> _lookup_table;
+  std::map<std::string, int> _pending_layers;
+  int _channels = 0;
+  int _level_count = 0;
+  // Files and cache settings of the layers, restorable arrays only
+  std::vector<std::string> _layer_names;
+  BlockFormat _source_format = BlockFormat::None;
+  bool _srgb = false;  // sampled through an sRGB format as well
+  std::vector<uint64_t> _layer_frames;
+  std::vector<int> _first_levels;  // _level_count until uploaded
+  int _sparse_levels = 0;          // levels above the mip tail
+
+  void allocate(int level_count, GLsizei layer_count);
+  void uploadLevel(int zoffset, int level, int level_width, int level_height,
+                   const void* pixels, size_t size);
+  void commitLayer(int zoffset);
+  void uploadLevels(int zoffset, const Image& image);
+  int claimPendingLayer(const std::string& texture_name, int channels,
+                        BlockFormat image_format, int image_width,
+                        int image_height);
+  size_t levelBytes(int level) const;
+  void commitLevels(int layer, int first, int last, bool commit);
 };
@@ -0,0 +1,93 @@
+#include "texture_residency.hpp"
+#include "texture.hpp"
+
+void TextureResidency::track(const void* owner, size_t bytes) {
+  size_t& tracked = _owners[owner];
+  _stats.used_bytes = _stats.used_bytes - tracked + bytes;
+  tracked = bytes;
+}
+
+void TextureResidency::untrack(const void* owner) {
+  auto it = _owners.find(owner);
+  if (it == _owners.end()) return;
+  _stats.used_bytes -= it->second;
+  _owners.erase(it);
+}
+
+void TextureResidency::addArray(TextureArray* array) {
+  _arrays.push_back(array);
+}
+
+void TextureResidency::removeArray(TextureArray* array) {
+  _arrays.erase(std::remove(_arrays.begin(), _arrays.end(), array),
+                _arrays.end());
+}
+
+void TextureResidency::setBudget(size_t bytes) { _stats.budget_bytes = bytes; }
+
+bool TextureResidency::sparse() const {
+  return (_stats.budget_bytes > 0 && GLAD_GL_VERSION_4_2 &&
+          GLAD_GL_ARB_sparse_texture);
+}
+
+void TextureResidency::update() {
+  if (_stats.budget_bytes > 0) {
+    // Least recently drawn layers first, a level at a time
+    while (_stats.used_bytes > _stats.budget_bytes) {
+      TextureArray* oldest = nullptr;
+      int oldest_layer = 0;
+      uint64_t oldest_use = UINT64_MAX;
+      for (TextureArray* array : _arrays) {
+        int layer;
+        uint64_t last_use;
+        if (array->oldestDroppable(layer, last_use) &&
+            last_use < oldest_use) {
+          oldest = array;
+          oldest_layer = layer;
+          oldest_use = last_use;
+        }
+      }
+      if (oldest == nullptr || oldest->dropLevel(oldest_layer) == false) {
+        break;
+      }
+      _stats.evictions++;
+      _stats.dropped_levels++;
+      _generation++;
+    }
+    // Layers drawn this frame get their levels back as long as they fit
+    for (int i = 0; i < TEXTURE_RESTORES_PER_FRAME; i++) {
+      TextureArray* restore = nullptr;
+      int restore_layer = 0;
+      for (TextureArray* array : _arrays) {
+        int layer;
+        size_t bytes;
+        if (array->restoreCandidate(_frame, layer, bytes) &&
+            _stats.used_bytes + bytes <= _stats.budget_bytes) {
+          restore = array;
+          restore_layer = layer;
+          break;
+        }
+      }
+      if (restore == nullptr) break;
+      if (restore->restoreLevel(restore_layer)) {
+        _stats.restores++;
+        _stats.dropped_levels--;
+        _generation++;
+      }
+    }
+  }
+  _frame++;
+}
+
+uint64_t TextureResidency::frame() const { return (_frame); }
+
+uint64_t TextureResidency::generation() const { return (_generation); }
+
+const TextureResidencyStats& TextureResidency::stats() const {
+  return (_stats);
+}
+
+TextureResidency& TextureResidency::shared() {
+  static TextureResidency residency;
+  return (residency);
+}
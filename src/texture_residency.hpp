@@ -0,0 +1,59 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <vector>
+#include "env.hpp"
+
+// Layers given a level back per frame, each one is read from its cache on
+// the render thread
+#define TEXTURE_RESTORES_PER_FRAME 2
+
+struct TextureArray;
+
+struct TextureResidencyStats {
+  size_t used_bytes = 0;    // every tracked texture
+  size_t budget_bytes = 0;  // 0 when there is no budget
+  size_t evictions = 0;     // levels dropped since the start
+  size_t restores = 0;      // and given back
+  size_t dropped_levels = 0;
+};
+
+// GPU memory of every Texture, TextureArray and VirtualTexture. Past the
+// budget, sparse arrays drop the top level of their least recently drawn
+// layers and get it back once drawn again and under budget. Render thread
+// only
+class TextureResidency {
+ public:
+  TextureResidency() = default;
+  TextureResidency(TextureResidency const& src) = delete;
+  TextureResidency& operator=(TextureResidency const& rhs) = delete;
+
+  // Bytes of an owner replace its previous count
+  void track(const void* owner, size_t bytes);
+  void untrack(const void* owner);
+  // Arrays whose layers can drop levels
+  void addArray(TextureArray* array);
+  void removeArray(TextureArray* array);
+
+  // Arrays allocated afterwards are sparse when the driver allows it
+  void setBudget(size_t bytes);
+  bool sparse() const;
+  // Once per frame after the drawn layers are touched, evicts and restores
+  void update();
+  uint64_t frame() const;
+  // Bumps whenever a first level changes, indices given to the shader
+  // carry them
+  uint64_t generation() const;
+  const TextureResidencyStats& stats() const;
+
+  static TextureResidency& shared();
+
+ private:
+  std::map<const void*, size_t> _owners;
+  std::vector<TextureArray*> _arrays;
+  TextureResidencyStats _stats;
+  uint64_t _frame = 1;
+  uint64_t _generation = 0;
+};
@@ -0,0 +1,86 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(unsigned int thread_count) {
+  thread_count = std::max(thread_count, 1u);
+  for (unsigned int i = 0; i < thread_count; i++) {
+    _workers.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _condition.notify_all();
+  for (auto& worker : _workers) {
+    worker.join();
+  }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task) {
+  std::packaged_task<void()> packaged(std::move(task));
+  std::future<void> future = packaged.get_future();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tasks.push_back(std::move(packaged));
+  }
+  _condition.notify_one();
+  return (future);
+}
+
+void ThreadPool::parallelFor(
+    size_t count, size_t grain,
+    const std::function<void(size_t begin, size_t end)>& fn) {
+  if (count == 0) return;
+  grain = std::max<size_t>(grain, 1);
+  size_t ranges = std::min<size_t>((count + grain - 1) / grain, size() + 1);
+  size_t range_size = (count + ranges - 1) / ranges;
+  ranges = (count + range_size - 1) / range_size;
+  // Ranges are claimed by whoever gets to them first. Helpers that run once
+  // every range is claimed return without touching fn, the state outlives
+  // the call for them
+  struct State {
+    std::atomic<size_t> next{0};
+    size_t done = 0;
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  auto state = std::make_shared<State>();
+  auto run = [state, &fn, ranges, range_size, count]() {
+    for (size_t i = state->next++; i < ranges; i = state->next++) {
+      fn(i * range_size, std::min((i + 1) * range_size, count));
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (++state->done == ranges) state->finished.notify_all();
+    }
+  };
+  for (size_t i = 1; i < ranges; i++) submit(run);
+  run();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&state, ranges]() {
+    return (state->done == ranges);
+  });
+}
+
+unsigned int ThreadPool::size() const {
+  return (static_cast<unsigned int>(_workers.size()));
+}
+
+ThreadPool& ThreadPool::shared() {
+  static ThreadPool pool;
+  return (pool);
+}
+
+void ThreadPool::work() {
+  while (true) {
+    std::packaged_task<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _condition.wait(lock, [this]() { return (_stop || !_tasks.empty()); });
+      if (_stop && _tasks.empty()) return;
+      task = std::move(_tasks.front());
+      _tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+ public:
+  ThreadPool(unsigned int thread_count = std::thread::hardware_concurrency());
+  ThreadPool(ThreadPool const& src) = delete;
+  ThreadPool& operator=(ThreadPool const& rhs) = delete;
+  ~ThreadPool();
+
+  std::future<void> submit(std::function<void()> task);
+  // Splits [0, count) into contiguous ranges of at least grain elements and
+  // blocks until every range is processed. The caller takes ranges too and
+  // never runs other queued tasks, it only waits for the ranges a worker
+  // already started, so nested calls and calls from threads other tasks
+  // wait on cannot stall
+  void parallelFor(size_t count, size_t grain,
+                   const std::function<void(size_t begin, size_t end)>& fn);
+  unsigned int size() const;
+
+  // Process wide pool sized to the hardware
+  static ThreadPool& shared();
+
+ private:
+  std::vector<std::thread> _workers;
+  std::deque<std::packaged_task<void()>> _tasks;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  bool _stop = false;
+
+  void work();
+};
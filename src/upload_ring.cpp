@@ -0,0 +1,126 @@
+#include "upload_ring.hpp"
+
+static size_t alignUp(size_t size) {
+  return ((size + UPLOAD_RING_ALIGNMENT - 1) / UPLOAD_RING_ALIGNMENT *
+          UPLOAD_RING_ALIGNMENT);
+}
+
+// Every level starts aligned
+static size_t stagedSize(const MappedImage& image) {
+  size_t size = 0;
+  for (const auto& level : image.levels) size += alignUp(level.size);
+  return (size);
+}
+
+size_t StagedImage::levelOffset(size_t level) const {
+  return (block.offset + static_cast<size_t>(levels[level].data - block.data));
+}
+
+bool UploadRing::supported() {
+  return (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage);
+}
+
+UploadRing::UploadRing(size_t capacity) : _capacity(capacity) {
+  GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &id);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, id);
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(capacity),
+                  NULL, flags);
+  _data = static_cast<unsigned char*>(glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(capacity), flags));
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (_data == nullptr) {
+    std::cerr << "Cannot map the upload ring" << std::endl;
+    _capacity = 0;
+  }
+  _stats.capacity_bytes = _capacity;
+}
+
+// Blocks still in flight are read before the buffer is really deleted
+UploadRing::~UploadRing() {
+  for (const auto& span : _spans) {
+    if (span.fence != nullptr) glDeleteSync(span.fence);
+  }
+  if (id != 0) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, id);
+    if (_data != nullptr) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &id);
+  }
+}
+
+bool UploadRing::fits(const MappedImage& image) const {
+  return (stagedSize(image) <= _capacity);
+}
+
+// The block is reserved under the lock and written outside of it, a block
+// that does not fit before the end of the buffer starts over at its
+// beginning and the end is reserved with it
+bool UploadRing::stage(const MappedImage& image, StagedImage& staged) {
+  size_t size = stagedSize(image);
+  if (size == 0 || size > _capacity) return (false);
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t padding = _head + size > _capacity ? _capacity - _head : 0;
+    if (_stats.used_bytes + padding + size > _capacity) {
+      _stats.stalls++;
+      return (false);
+    }
+    Span span;
+    span.reserved = padding + size;
+    staged.block.sequence = _first_sequence + _spans.size();
+    staged.block.offset = padding > 0 ? 0 : _head;
+    staged.block.size = size;
+    staged.block.data = _data + staged.block.offset;
+    _spans.push_back(span);
+    _head = (staged.block.offset + size) % _capacity;
+    _stats.used_bytes += span.reserved;
+    _stats.staged_bytes += size;
+    _stats.staged_images++;
+  }
+  staged.buffer = id;
+  staged.channels = image.channels;
+  staged.format = image.format;
+  staged.levels.clear();
+  unsigned char* data = staged.block.data;
+  for (const auto& level : image.levels) {
+    std::memcpy(data, level.data, level.size);
+    CachedLevel staged_level = level;
+    staged_level.data = data;
+    staged.levels.push_back(staged_level);
+    data += alignUp(level.size);
+  }
+  return (true);
+}
+
+void UploadRing::release(const StagingBlock& block) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (block.sequence < _first_sequence) return;
+  Span& span = _spans[block.sequence - _first_sequence];
+  span.released = true;
+  span.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void UploadRing::reclaim() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  while (_spans.empty() == false && _spans.front().released) {
+    Span& span = _spans.front();
+    if (span.fence != nullptr) {
+      GLenum status = glClientWaitSync(span.fence, 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        break;
+      }
+      glDeleteSync(span.fence);
+    }
+    _stats.used_bytes -= span.reserved;
+    _spans.pop_front();
+    _first_sequence++;
+  }
+  if (_spans.empty()) _head = 0;
+}
+
+UploadRingStats UploadRing::stats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return (_stats);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "block_compression.hpp"
+#include "env.hpp"
+
+// Staging memory shared by the texture decoders, images larger than the
+// ring are uploaded from client memory
+#define UPLOAD_RING_MB 64
+// Start of every block, enough for any copy source
+#define UPLOAD_RING_ALIGNMENT 64
+
+// Span of the ring a decoder writes into, released once its copies are issued
+struct StagingBlock {
+  uint64_t sequence = 0;
+  size_t offset = 0;  // in the buffer, what the copies are given
+  size_t size = 0;
+  unsigned char* data = nullptr;
+};
+
+// Levels point into the block, offsets in the unpack buffer are taken from
+// them
+struct StagedImage {
+  StagingBlock block;
+  GLuint buffer = 0;
+  int channels = 0;
+  BlockFormat format = BlockFormat::None;
+  std::vector<CachedLevel> levels;
+
+  size_t levelOffset(size_t level) const;
+};
+
+struct UploadRingStats {
+  size_t capacity_bytes = 0;
+  size_t used_bytes = 0;    // written, queued or in flight on the GPU
+  size_t staged_bytes = 0;  // since the start
+  size_t staged_images = 0;
+  size_t stalls = 0;  // stage calls that found no room
+};
+
+// Persistently mapped pixel unpack buffer. Decoders copy the levels of their
+// cache straight into it from any thread, the render thread issues the
+// texture copies from the buffer and fences each block, blocks come back in
+// allocation order once the GPU is done reading them
+class UploadRing {
+ public:
+  // Needs ARB_buffer_storage for the persistent mapping
+  static bool supported();
+
+  UploadRing(size_t capacity = size_t(UPLOAD_RING_MB) * 1024 * 1024);
+  UploadRing(UploadRing const& src) = delete;
+  UploadRing& operator=(UploadRing const& rhs) = delete;
+  ~UploadRing();
+
+  // Any thread: false if the image could never fit
+  bool fits(const MappedImage& image) const;
+  // Any thread: copies the levels in, false while there is no room
+  bool stage(const MappedImage& image, StagedImage& staged);
+
+  // Render thread: fences the block after the copies reading it
+  void release(const StagingBlock& block);
+  // Render thread, once per frame: frees the blocks the GPU is done with
+  void reclaim();
+  UploadRingStats stats() const;
+
+  GLuint id = 0;
+
+ private:
+  struct Span {
+    size_t reserved = 0;  // block and the padding before it
+    bool released = false;
+    GLsync fence = nullptr;
+  };
+
+  mutable std::mutex _mutex;
+  unsigned char* _data = nullptr;
+  size_t _capacity = 0;
+  size_t _head = 0;
+  uint64_t _first_sequence = 0;  // of the oldest span
+  std::deque<Span> _spans;
+  UploadRingStats _stats;
+};
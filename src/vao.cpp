@@ -44,6 +44,130 @@ VAO::VAO(const std::vector<Vertex> &vertices,
   glEnableVertexAttribArray(2);
   glEnableVertexAttribArray(3);
   glBindVertexArray(0);
+
+  std::vector<glm::vec3> positions(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    positions[i] = vertices[i].position;
+  }
+  genDepthVAO(positions, 3, GL_FLOAT, GL_FALSE);
+}
+
+VAO::VAO(const std::vector<PackedVertex> &vertices,
+         const std::vector<unsigned int> &indices) {
+  genBuffers(vertices, indices);
+  setupPackedAttributes();
+  genPackedDepthVAO(vertices);
+}
+
+VAO::VAO(const std::vector<PackedVertex> &vertices,
+         const std::vector<uint16_t> &indices) {
+  genBuffers(vertices, indices);
+  setupPackedAttributes();
+  genPackedDepthVAO(vertices);
+}
+
+void VAO::setupPackedAttributes() {
+  glGenVertexArrays(1, &this->vao);
+  glBindVertexArray(this->vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, this->_vbo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->_ebo);
+  glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex),
+                        (GLvoid *)offsetof(PackedVertex, position));
+  glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                        (GLvoid *)offsetof(PackedVertex, normal));
+  glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+                        (GLvoid *)offsetof(PackedVertex, uv));
+  glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                        (GLvoid *)offsetof(PackedVertex, tangent));
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glEnableVertexAttribArray(3);
+  glBindVertexArray(0);
+}
+
+void VAO::genPackedDepthVAO(const std::vector<PackedVertex> &vertices) {
+  std::vector<uint16_t> positions(vertices.size() * 4);
+  for (size_t i = 0; i < vertices.size(); i++) {
+    std::memcpy(&positions[i * 4], vertices[i].position,
+                sizeof(vertices[i].position));
+  }
+  genDepthVAO(positions, 4, GL_UNSIGNED_SHORT, GL_TRUE);
+}
+
+void VAO::addMaterialIds(const std::vector<uint16_t> &material_ids) {
+  _material_vbo = genBuffer(GL_ARRAY_BUFFER, material_ids);
+  glBindVertexArray(this->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, _material_vbo);
+  glVertexAttribIPointer(4, 1, GL_UNSIGNED_SHORT, sizeof(uint16_t),
+                         (GLvoid *)0);
+  glEnableVertexAttribArray(4);
+  glBindVertexArray(0);
+}
+
+void VAO::addInstanceTransforms(const std::vector<glm::mat4> &transforms) {
+  _instance_vbo = genBuffer(GL_ARRAY_BUFFER, transforms);
+  for (GLuint vertex_array : {this->vao, this->depth_vao}) {
+    if (vertex_array == 0) continue;
+    glBindVertexArray(vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, _instance_vbo);
+    for (GLuint column = 0; column < 4; column++) {
+      glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE,
+                            sizeof(glm::mat4),
+                            (GLvoid *)(sizeof(glm::vec4) * column));
+      glVertexAttribDivisor(5 + column, 1);
+      glEnableVertexAttribArray(5 + column);
+    }
+  }
+  glBindVertexArray(0);
+}
+
+VAO::VAO(const std::vector<VertexStream> &streams, GLsizei vertex_count,
+         const void *indices, GLsizei index_count, GLenum index_type) {
+  vertices_size = vertex_count;
+  indices_size = index_count;
+  this->index_type = index_type;
+  if (index_count > 0) {
+    GLsizei index_size = index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+    glGenBuffers(1, &this->_ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->_ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * index_size, indices,
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+  std::vector<GLuint> buffers(streams.size(), 0);
+  for (size_t i = 0; i < streams.size(); i++) {
+    for (size_t j = 0; j < i && buffers[i] == 0; j++) {
+      if (streams[j].data == streams[i].data &&
+          streams[j].size == streams[i].size) {
+        buffers[i] = buffers[j];
+      }
+    }
+    if (buffers[i] != 0) continue;
+    glGenBuffers(1, &buffers[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+    glBufferData(GL_ARRAY_BUFFER, streams[i].size, streams[i].data,
+                 GL_STATIC_DRAW);
+    _stream_vbos.push_back(buffers[i]);
+  }
+
+  glGenVertexArrays(1, &this->vao);
+  glGenVertexArrays(1, &this->depth_vao);
+  for (size_t i = 0; i < streams.size(); i++) {
+    const VertexStream &stream = streams[i];
+    for (GLuint vertex_array : {this->vao, this->depth_vao}) {
+      if (vertex_array == this->depth_vao && stream.location != 0) continue;
+      glBindVertexArray(vertex_array);
+      glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->_ebo);
+      glVertexAttribPointer(stream.location, stream.components, stream.type,
+                            stream.normalized, stream.stride,
+                            (GLvoid *)stream.offset);
+      glEnableVertexAttribArray(stream.location);
+    }
+  }
+  glBindVertexArray(0);
 }
 
 VAO::VAO(const std::vector<glm::vec2> &positions) {
@@ -133,5 +257,13 @@ VAO::VAO(const std::vector<glm::vec4> &positions,
 VAO::~VAO() {
   if (this->_vbo != 0) glDeleteBuffers(1, &this->_vbo);
   if (this->_ebo != 0) glDeleteBuffers(1, &this->_ebo);
+  if (this->_position_vbo != 0) glDeleteBuffers(1, &this->_position_vbo);
+  if (this->_material_vbo != 0) glDeleteBuffers(1, &this->_material_vbo);
+  if (this->_instance_vbo != 0) glDeleteBuffers(1, &this->_instance_vbo);
+  if (this->_stream_vbos.empty() == false) {
+    glDeleteBuffers(static_cast<GLsizei>(this->_stream_vbos.size()),
+                    this->_stream_vbos.data());
+  }
   if (this->vao != 0) glDeleteVertexArrays(1, &this->vao);
+  if (this->depth_vao != 0) glDeleteVertexArrays(1, &this->depth_vao);
 }
@@ -4,12 +4,34 @@
 #include "env.hpp"
 #include "forward.hpp"
 
+// Vertex attribute uploaded as is from client memory, streams with the same
+// data and size share a buffer and differ by their offset in it
+struct VertexStream {
+  GLuint location = 0;
+  GLint components = 0;
+  GLenum type = GL_FLOAT;
+  GLboolean normalized = GL_FALSE;
+  GLsizei stride = 0;
+  size_t offset = 0;
+  const void* data = nullptr;
+  size_t size = 0;
+};
+
 class VAO {
  public:
   VAO(const std::vector<Vertex>& vertices);
   VAO(const std::vector<Vertex>& vertices,
       const std::vector<unsigned int>& indices);
 
+  VAO(const std::vector<PackedVertex>& vertices,
+      const std::vector<unsigned int>& indices);
+  VAO(const std::vector<PackedVertex>& vertices,
+      const std::vector<uint16_t>& indices);
+
+  // Attribute 0 is the position stream, also used by the depth vertex array
+  VAO(const std::vector<VertexStream>& streams, GLsizei vertex_count,
+      const void* indices, GLsizei index_count, GLenum index_type);
+
   VAO(const std::vector<glm::vec2>& positions);
   VAO(const std::vector<glm::vec2>& positions,
       const std::vector<unsigned int>& indices);
@@ -30,6 +52,11 @@ class VAO {
 
   ~VAO();
 
+  // Per vertex integer material index at attribute 4, see BatchMaterial
+  void addMaterialIds(const std::vector<uint16_t>& material_ids);
+  // Per instance matrix at attributes 5 to 8, in both vertex arrays
+  void addInstanceTransforms(const std::vector<glm::mat4>& transforms);
+
   template <typename T>
   void update(
       const std::vector<T>& vertices,
@@ -50,12 +77,18 @@ class VAO {
   }
 
   GLuint vao = 0;
+  GLuint depth_vao = 0;  // Tightly packed positions only, shares the EBO
   GLsizei vertices_size = 0;
   GLsizei indices_size = 0;
+  GLenum index_type = GL_UNSIGNED_INT;
 
  private:
   GLuint _vbo = 0;
   GLuint _ebo = 0;
+  GLuint _position_vbo = 0;
+  GLuint _material_vbo = 0;
+  GLuint _instance_vbo = 0;
+  std::vector<GLuint> _stream_vbos;
 
   template <typename T>
   GLuint genBuffer(GLenum type, const std::vector<T>& buffer) {
@@ -70,13 +103,30 @@ class VAO {
     return (bo);
   }
 
-  template <typename T>
-  void genBuffers(
-      const std::vector<T>& vertices,
-      const std::vector<unsigned int>& indices = std::vector<unsigned int>()) {
+  template <typename T, typename I = unsigned int>
+  void genBuffers(const std::vector<T>& vertices,
+                  const std::vector<I>& indices = std::vector<I>()) {
     vertices_size = vertices.size();
     indices_size = indices.size();
+    index_type = sizeof(I) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
     _vbo = genBuffer(GL_ARRAY_BUFFER, vertices);
     _ebo = genBuffer(GL_ELEMENT_ARRAY_BUFFER, indices);
   }
+
+  void setupPackedAttributes();
+  void genPackedDepthVAO(const std::vector<PackedVertex>& vertices);
+
+  // Positions are tightly packed, whether T is a component or a whole vector
+  template <typename T>
+  void genDepthVAO(const std::vector<T>& positions, GLint components,
+                   GLenum type, GLboolean normalized) {
+    _position_vbo = genBuffer(GL_ARRAY_BUFFER, positions);
+    glGenVertexArrays(1, &this->depth_vao);
+    glBindVertexArray(this->depth_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, _position_vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->_ebo);
+    glVertexAttribPointer(0, components, type, normalized, 0, (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+  }
 };
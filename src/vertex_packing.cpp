@@ -0,0 +1,58 @@
+#include "vertex_packing.hpp"
+
+glm::vec2 octEncode(glm::vec3 direction) {
+  float sum =
+      std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+  // Degenerate normals and tangents (zero or NaN) fall back to +Z
+  if (!(sum > 0.0f)) return (glm::vec2(0.0f));
+  direction /= sum;
+  glm::vec2 encoded(direction.x, direction.y);
+  if (direction.z < 0.0f) {
+    encoded = glm::vec2(
+        (1.0f - std::abs(direction.y)) * (direction.x >= 0.0f ? 1.0f : -1.0f),
+        (1.0f - std::abs(direction.x)) * (direction.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return (encoded);
+}
+
+glm::vec3 octDecode(glm::vec2 encoded) {
+  glm::vec3 direction(encoded.x, encoded.y,
+                      1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+  float t = std::max(-direction.z, 0.0f);
+  direction.x += direction.x >= 0.0f ? -t : t;
+  direction.y += direction.y >= 0.0f ? -t : t;
+  return (glm::normalize(direction));
+}
+
+std::vector<PackedVertex> packVertices(const Vertex* vertices, size_t count,
+                                       const glm::vec3& aabb_center,
+                                       const glm::vec3& aabb_halfsize,
+                                       glm::vec3& position_bias,
+                                       glm::vec3& position_scale) {
+  position_bias = aabb_center - aabb_halfsize;
+  position_scale = aabb_halfsize * 2.0f;
+  glm::vec3 inv_scale;
+  for (int i = 0; i < 3; i++) {
+    inv_scale[i] = position_scale[i] > 0.0f ? 1.0f / position_scale[i] : 0.0f;
+  }
+  std::vector<PackedVertex> packed(count);
+  for (size_t i = 0; i < count; i++) {
+    const Vertex& vertex = vertices[i];
+    PackedVertex& out = packed[i];
+    glm::vec3 position = (vertex.position - position_bias) * inv_scale;
+    out.position[0] = glm::packUnorm1x16(position.x);
+    out.position[1] = glm::packUnorm1x16(position.y);
+    out.position[2] = glm::packUnorm1x16(position.z);
+    // Bitangents are rebuilt as cross(N, T), the loader has no mirrored uv
+    out.position[3] = glm::packUnorm1x16(1.0f);
+    glm::vec2 normal = octEncode(vertex.normal);
+    out.normal[0] = static_cast<int16_t>(glm::packSnorm1x16(normal.x));
+    out.normal[1] = static_cast<int16_t>(glm::packSnorm1x16(normal.y));
+    glm::vec2 tangent = octEncode(vertex.tangent);
+    out.tangent[0] = static_cast<int16_t>(glm::packSnorm1x16(tangent.x));
+    out.tangent[1] = static_cast<int16_t>(glm::packSnorm1x16(tangent.y));
+    out.uv[0] = glm::packHalf1x16(vertex.uv.x);
+    out.uv[1] = glm::packHalf1x16(vertex.uv.y);
+  }
+  return (packed);
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <vector>
+#include "forward.hpp"
+
+glm::vec2 octEncode(glm::vec3 direction);
+glm::vec3 octDecode(glm::vec2 encoded);
+
+// Quantize vertices in the given AABB, position_bias and position_scale
+// are the shader decode parameters: position = bias + unorm * scale
+std::vector<PackedVertex> packVertices(const Vertex* vertices, size_t count,
+                                       const glm::vec3& aabb_center,
+                                       const glm::vec3& aabb_halfsize,
+                                       glm::vec3& position_bias,
+                                       glm::vec3& position_scale);
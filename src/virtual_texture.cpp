@@ -0,0 +1,470 @@
+#include "virtual_texture.hpp"
+
+// Page slot states besides a slot index
+static const int PAGE_ABSENT = -1;
+static const int PAGE_LOADING = -2;
+static const int PAGE_MISSING = -3;  // its texture cannot be read
+
+// Layers fit in the 12 bits of a request, the last value is no request
+static const size_t MAX_VIRTUAL_LAYERS = 4095;
+
+static int requestLayer(uint32_t request) {
+  return (static_cast<int>(request >> 20));
+}
+
+static int requestLevel(uint32_t request) {
+  return (static_cast<int>((request >> 16) & 0xf));
+}
+
+static int requestX(uint32_t request) {
+  return (static_cast<int>(request & 0xff));
+}
+
+static int requestY(uint32_t request) {
+  return (static_cast<int>((request >> 8) & 0xff));
+}
+
+struct LoadedPage {
+  uint32_t request = VIRTUAL_NO_REQUEST;
+  int width = 0;  // texels uploaded, whole blocks when compressed
+  int height = 0;
+  std::vector<unsigned char> data;  // empty when the page cannot be read
+};
+
+// Mapped by the first page load of the layer, which may have to build the
+// texture cache. Loads arriving meanwhile are parked and read by the thread
+// that maps it, no load ever waits on another one
+struct PageSource {
+  enum class State { Unmapped, Building, Mapped, Missing };
+  std::mutex mutex;
+  State state = State::Unmapped;
+  std::vector<uint32_t> parked;
+  MappedImage image;  // read without the lock once Mapped
+};
+
+struct VirtualTexture::Shared {
+  std::vector<std::string> textures;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  int level_count = 0;
+  BlockFormat format = BlockFormat::None;
+  bool srgb = false;
+  std::vector<std::unique_ptr<PageSource>> sources;
+  MPSCQueue<LoadedPage> loaded;
+  std::atomic<bool> cancelled{false};
+
+  bool map(int layer, MappedImage& image) const;
+  // Any thread, the page is pushed to loaded even when it cannot be read
+  void load(uint32_t request);
+  void push(uint32_t request, const PageSource& source, bool valid);
+};
+
+bool VirtualTexture::Shared::map(int layer, MappedImage& image) const {
+  const std::string& texture = textures[layer];
+  if (mapCachedImage(texture, format, srgb, image) == false) {
+    std::cerr << "Cannot map texture cache: " << texture << std::endl;
+    return (false);
+  }
+  if (image.channels != channels || image.format != format ||
+      static_cast<int>(image.levels.size()) < level_count ||
+      image.levels[0].width != width || image.levels[0].height != height) {
+    std::cout << "skipping " << texture << ": does not match its " << width
+              << "x" << height << " " << blockFormatName(format)
+              << " virtual texture" << std::endl;
+    return (false);
+  }
+  return (true);
+}
+
+// Rows of texels, or of blocks, of the page copied out of its level
+static void readPage(const MappedImage& image, int level, int page_x,
+                     int page_y, LoadedPage& page) {
+  const CachedLevel& source = image.levels[level];
+  int x = page_x * VIRTUAL_PAGE_SIZE;
+  int y = page_y * VIRTUAL_PAGE_SIZE;
+  page.width = std::min(VIRTUAL_PAGE_SIZE, source.width - x);
+  page.height = std::min(VIRTUAL_PAGE_SIZE, source.height - y);
+  size_t texel_size = static_cast<size_t>(image.channels);
+  int row_width = source.width;
+  if (image.format != BlockFormat::None) {
+    texel_size = imageLevelSize(image.format, image.channels, 4, 4);
+    row_width = (source.width + 3) / 4;
+    x /= 4;
+    y /= 4;
+    page.width = (page.width + 3) / 4 * 4;
+    page.height = (page.height + 3) / 4 * 4;
+  }
+  int block = image.format == BlockFormat::None ? 1 : 4;
+  size_t row_size = page.width / block * texel_size;
+  int rows = page.height / block;
+  page.data.resize(row_size * rows);
+  for (int row = 0; row < rows; row++) {
+    std::memcpy(&page.data[row * row_size],
+                source.data + (size_t(y + row) * row_width + x) * texel_size,
+                row_size);
+  }
+}
+
+// Building the cache runs parallelFor, this thread may take its ranges but
+// nothing here blocks on a load that is queued behind it
+void VirtualTexture::Shared::load(uint32_t request) {
+  if (cancelled) return;
+  PageSource& source = *sources[requestLayer(request)];
+  PageSource::State state;
+  {
+    std::lock_guard<std::mutex> lock(source.mutex);
+    if (source.state == PageSource::State::Building) {
+      source.parked.push_back(request);
+      return;
+    }
+    if (source.state == PageSource::State::Unmapped) {
+      source.state = PageSource::State::Building;
+    }
+    state = source.state;
+  }
+  if (state != PageSource::State::Building) {
+    push(request, source, state == PageSource::State::Mapped);
+    return;
+  }
+  MappedImage image;
+  bool valid = map(requestLayer(request), image);
+  std::vector<uint32_t> parked;
+  {
+    std::lock_guard<std::mutex> lock(source.mutex);
+    source.image = std::move(image);
+    source.state =
+        valid ? PageSource::State::Mapped : PageSource::State::Missing;
+    parked.swap(source.parked);
+  }
+  push(request, source, valid);
+  for (uint32_t parked_request : parked) {
+    if (cancelled) return;
+    push(parked_request, source, valid);
+  }
+}
+
+void VirtualTexture::Shared::push(uint32_t request, const PageSource& source,
+                                  bool valid) {
+  LoadedPage page;
+  page.request = request;
+  if (valid) {
+    readPage(source.image, requestLevel(request), requestX(request),
+             requestY(request), page);
+  }
+  loaded.push(std::move(page));
+}
+
+VirtualTexture::VirtualTexture(const std::vector<std::string>& textures,
+                               int width, int height, int channels,
+                               BlockFormat block_format, bool srgb)
+    : width(width), height(height), _channels(channels) {
+  if (textures.empty() || (channels != 1 && channels != 2 && channels != 4)) {
+    return;
+  }
+  if (width % 4 == 0 && height % 4 == 0) format = block_format;
+  level_count = 1;
+  while (std::max(width >> (level_count - 1), height >> (level_count - 1)) >
+         VIRTUAL_PAGE_SIZE) {
+    level_count++;
+  }
+  // Page coordinates are 8 bits in a request
+  if (pagesX(0) > 256 || pagesY(0) > 256) {
+    std::cerr << "Virtual texture too large: " << width << "x" << height
+              << std::endl;
+    level_count = 0;
+    return;
+  }
+  _layer_count = static_cast<int>(std::min(textures.size(),
+                                           MAX_VIRTUAL_LAYERS));
+  if (textures.size() > MAX_VIRTUAL_LAYERS) {
+    std::cout << "Virtual texture keeps " << MAX_VIRTUAL_LAYERS << " of "
+              << textures.size() << " textures" << std::endl;
+  }
+
+  _shared = std::make_shared<Shared>();
+  _shared->textures.assign(textures.begin(), textures.begin() + _layer_count);
+  _shared->width = width;
+  _shared->height = height;
+  _shared->channels = channels;
+  _shared->level_count = level_count;
+  _shared->format = format;
+  _shared->srgb = srgb;
+  for (int layer = 0; layer < _layer_count; layer++) {
+    _shared->sources.push_back(std::make_unique<PageSource>());
+    _lookup_table.emplace(textures[layer], layer);
+  }
+
+  size_t page_count = 0;
+  for (int level = 0; level < level_count; level++) {
+    size_t level_pages = size_t(pagesX(level)) * pagesY(level) * _layer_count;
+    _level_offsets.push_back(page_count);
+    page_count += level_pages;
+    _tables.emplace_back(level_pages * 4, 0);
+    virtual_bytes +=
+        imageLevelSize(format, channels, std::max(width >> level, 1),
+                       std::max(height >> level, 1)) *
+        _layer_count;
+  }
+  _page_slots.assign(page_count, PAGE_ABSENT);
+  _dirty_layers.assign(_layer_count, false);
+  slot_count = VIRTUAL_CACHE_PAGES * VIRTUAL_CACHE_PAGES;
+  _slot_pages.assign(slot_count, VIRTUAL_NO_REQUEST);
+  _slot_frames.assign(slot_count, 0);
+  _slot_pinned.assign(slot_count, false);
+  for (int slot = static_cast<int>(slot_count) - 1; slot >= 0; slot--) {
+    _free_slots.push_back(slot);
+  }
+
+  // Physical cache, sampled with texelFetch
+  int cache_size = VIRTUAL_CACHE_PAGES * VIRTUAL_PAGE_SIZE;
+  size_t cache_bytes = imageLevelSize(format, channels, cache_size, cache_size);
+  // texelFetch decodes sRGB pages as the arrays do
+  GLenum internal_format = internalFormat(format, channels, srgb);
+  glGenTextures(1, &cache_id);
+  glBindTexture(GL_TEXTURE_2D, cache_id);
+  if (format == BlockFormat::None) {
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, cache_size, cache_size, 0,
+                 pixelFormat(channels), GL_UNSIGNED_BYTE, NULL);
+  } else {
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, internal_format, cache_size,
+                           cache_size, 0, static_cast<GLsizei>(cache_bytes),
+                           NULL);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  gpu_bytes += cache_bytes;
+
+  // Table levels cover the pages of their level, which round up on odd sizes
+  int table_width = 1;
+  int table_height = 1;
+  for (int level = 0; level < level_count; level++) {
+    table_width = std::max(table_width, pagesX(level) << level);
+    table_height = std::max(table_height, pagesY(level) << level);
+  }
+  std::vector<uint8_t> no_pages(size_t(table_width) * table_height * 4 *
+                                _layer_count);
+  glGenTextures(1, &table_id);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, table_id);
+  for (int level = 0; level < level_count; level++) {
+    int level_width = std::max(table_width >> level, 1);
+    int level_height = std::max(table_height >> level, 1);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8UI, level_width,
+                 level_height, _layer_count, 0, GL_RGBA_INTEGER,
+                 GL_UNSIGNED_BYTE, no_pages.data());
+    gpu_bytes += size_t(level_width) * level_height * 4 * _layer_count;
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  TextureResidency::shared().track(this, gpu_bytes);
+
+  // The last level is the fallback of every page, it stays resident as long
+  // as it leaves most of the cache to streaming
+  int last = level_count - 1;
+  size_t tail_pages = size_t(pagesX(last)) * pagesY(last) * _layer_count;
+  _pin_tail = tail_pages <= slot_count / 2;
+  if (_pin_tail == false) {
+    std::cout << "Virtual texture cache too small to keep " << tail_pages
+              << " fallback pages resident" << std::endl;
+  }
+  for (int layer = 0; layer < _layer_count; layer++) {
+    for (int y = 0; y < pagesY(last); y++) {
+      for (int x = 0; x < pagesX(last); x++) {
+        queuePage(packPageRequest(layer, last, x, y));
+      }
+    }
+  }
+}
+
+VirtualTexture::~VirtualTexture() {
+  TextureResidency::shared().untrack(this);
+  if (_shared != nullptr) _shared->cancelled = true;
+  if (cache_id != 0) glDeleteTextures(1, &cache_id);
+  if (table_id != 0) glDeleteTextures(1, &table_id);
+}
+
+int VirtualTexture::findTextureIndex(const std::string& texture_name) const {
+  auto it = _lookup_table.find(texture_name);
+  return (it == _lookup_table.end() ? -1 : it->second);
+}
+
+int VirtualTexture::pagesX(int level) const {
+  return ((std::max(width >> level, 1) + VIRTUAL_PAGE_SIZE - 1) /
+          VIRTUAL_PAGE_SIZE);
+}
+
+int VirtualTexture::pagesY(int level) const {
+  return ((std::max(height >> level, 1) + VIRTUAL_PAGE_SIZE - 1) /
+          VIRTUAL_PAGE_SIZE);
+}
+
+size_t VirtualTexture::pageIndex(uint32_t request) const {
+  int level = requestLevel(request);
+  return (_level_offsets[level] +
+          (size_t(requestLayer(request)) * pagesY(level) + requestY(request)) *
+              pagesX(level) +
+          requestX(request));
+}
+
+bool VirtualTexture::validRequest(uint32_t request) const {
+  int level = requestLevel(request);
+  return (requestLayer(request) < _layer_count && level < level_count &&
+          requestX(request) < pagesX(level) &&
+          requestY(request) < pagesY(level));
+}
+
+void VirtualTexture::queuePage(uint32_t request) {
+  _page_slots[pageIndex(request)] = PAGE_LOADING;
+  _pending++;
+  std::shared_ptr<Shared> shared = _shared;
+  ThreadPool::shared().submit([shared, request]() { shared->load(request); });
+}
+
+void VirtualTexture::update(std::vector<uint32_t>& requests) {
+  if (cache_id == 0) return;
+  _frame++;
+  // Coarse levels first, they are the fallback of everything finer
+  std::sort(requests.begin(), requests.end(), [](uint32_t a, uint32_t b) {
+    return (requestLevel(a) != requestLevel(b)
+                ? requestLevel(a) > requestLevel(b)
+                : a < b);
+  });
+  requests.erase(std::unique(requests.begin(), requests.end()),
+                 requests.end());
+  for (uint32_t request : requests) {
+    if (validRequest(request) == false) continue;
+    int slot = _page_slots[pageIndex(request)];
+    if (slot == PAGE_ABSENT && _pending < VIRTUAL_MAX_PENDING_PAGES) {
+      queuePage(request);
+    }
+    // The page drawn meanwhile is its closest resident ancestor
+    int layer = requestLayer(request);
+    int x = requestX(request);
+    int y = requestY(request);
+    for (int level = requestLevel(request); level < level_count; level++) {
+      slot = _page_slots[pageIndex(packPageRequest(layer, level, x, y))];
+      if (slot >= 0) {
+        _slot_frames[slot] = _frame;
+        break;
+      }
+      x = std::min(x / 2, pagesX(level + 1) - 1);
+      y = std::min(y / 2, pagesY(level + 1) - 1);
+    }
+  }
+  uploadPages();
+  for (int layer = 0; layer < _layer_count; layer++) {
+    if (_dirty_layers[layer]) {
+      updatePageTable(layer);
+      _dirty_layers[layer] = false;
+    }
+  }
+}
+
+// A free slot or the least recently used one, never one drawn this frame
+int VirtualTexture::allocateSlot() {
+  if (_free_slots.empty() == false) {
+    int slot = _free_slots.back();
+    _free_slots.pop_back();
+    return (slot);
+  }
+  int oldest = -1;
+  for (int slot = 0; slot < static_cast<int>(slot_count); slot++) {
+    if (_slot_pinned[slot] || _slot_frames[slot] == _frame) continue;
+    if (oldest < 0 || _slot_frames[slot] < _slot_frames[oldest]) {
+      oldest = slot;
+    }
+  }
+  if (oldest < 0) return (-1);
+  _page_slots[pageIndex(_slot_pages[oldest])] = PAGE_ABSENT;
+  _dirty_layers[requestLayer(_slot_pages[oldest])] = true;
+  resident_pages--;
+  pages_evicted++;
+  return (oldest);
+}
+
+void VirtualTexture::uploadPages() {
+  GLenum internal_format = internalFormat(format, _channels, _shared->srgb);
+  glBindTexture(GL_TEXTURE_2D, cache_id);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  LoadedPage page;
+  int uploads = 0;
+  while (uploads < VIRTUAL_UPLOADS_PER_FRAME && _shared->loaded.pop(page)) {
+    _pending--;
+    size_t index = pageIndex(page.request);
+    if (page.data.empty()) {
+      _page_slots[index] = PAGE_MISSING;
+      continue;
+    }
+    int slot = allocateSlot();
+    if (slot < 0) {
+      // Asked for again once a slot is no longer drawn
+      _page_slots[index] = PAGE_ABSENT;
+      continue;
+    }
+    int x = (slot % VIRTUAL_CACHE_PAGES) * VIRTUAL_PAGE_SIZE;
+    int y = (slot / VIRTUAL_CACHE_PAGES) * VIRTUAL_PAGE_SIZE;
+    if (format == BlockFormat::None) {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, page.width, page.height,
+                      pixelFormat(_channels), GL_UNSIGNED_BYTE,
+                      page.data.data());
+    } else {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, page.width,
+                                page.height, internal_format,
+                                static_cast<GLsizei>(page.data.size()),
+                                page.data.data());
+    }
+    _page_slots[index] = slot;
+    _slot_pages[slot] = page.request;
+    _slot_frames[slot] = _frame;
+    _slot_pinned[slot] =
+        _pin_tail && requestLevel(page.request) == level_count - 1;
+    _dirty_layers[requestLayer(page.request)] = true;
+    resident_pages++;
+    pages_loaded++;
+    uploads++;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Coarse to fine, pages that are not resident take the entry of their parent
+void VirtualTexture::updatePageTable(int layer) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, table_id);
+  for (int level = level_count - 1; level >= 0; level--) {
+    int pages_x = pagesX(level);
+    int pages_y = pagesY(level);
+    uint8_t* entries = &_tables[level][size_t(layer) * pages_x * pages_y * 4];
+    for (int y = 0; y < pages_y; y++) {
+      for (int x = 0; x < pages_x; x++) {
+        uint8_t* entry = &entries[(size_t(y) * pages_x + x) * 4];
+        int slot = _page_slots[pageIndex(packPageRequest(layer, level, x, y))];
+        if (slot >= 0) {
+          entry[0] = static_cast<uint8_t>(slot % VIRTUAL_CACHE_PAGES);
+          entry[1] = static_cast<uint8_t>(slot / VIRTUAL_CACHE_PAGES);
+          entry[2] = static_cast<uint8_t>(level);
+          entry[3] = 255;
+        } else if (level + 1 < level_count) {
+          int parent_x = std::min(x / 2, pagesX(level + 1) - 1);
+          int parent_y = std::min(y / 2, pagesY(level + 1) - 1);
+          const std::vector<uint8_t>& parents = _tables[level + 1];
+          std::memcpy(entry,
+                      &parents[((size_t(layer) * pagesY(level + 1) + parent_y) *
+                                    pagesX(level + 1) +
+                                parent_x) *
+                               4],
+                      4);
+        } else {
+          std::memset(entry, 0, 4);
+        }
+      }
+    }
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, pages_x, pages_y,
+                    1, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entries);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "asset_streamer.hpp"
+#include "block_compression.hpp"
+#include "texture.hpp"
+#include "thread_pool.hpp"
+
+// Texels per side of a page, whole 4x4 blocks. Same value in shading.frag
+#define VIRTUAL_PAGE_SIZE 128
+// Pages per side of the physical cache, at most 256 for the page table
+#define VIRTUAL_CACHE_PAGES 16
+// Feedback is written for one pixel in VIRTUAL_FEEDBACK_SCALE squared
+#define VIRTUAL_FEEDBACK_SCALE 8
+// Pages read from disk at a time, and uploaded per frame
+#define VIRTUAL_MAX_PENDING_PAGES 64
+#define VIRTUAL_UPLOADS_PER_FRAME 16
+// Feedback value of pixels that asked for nothing
+#define VIRTUAL_NO_REQUEST 0xffffffffu
+
+// Page request as the shading pass packs it: layer, level, page y and page x
+inline uint32_t packPageRequest(int layer, int level, int x, int y) {
+  return ((static_cast<uint32_t>(layer) << 20) |
+          (static_cast<uint32_t>(level) << 16) |
+          (static_cast<uint32_t>(y) << 8) | static_cast<uint32_t>(x));
+}
+
+// Texture array whose pages stream in on demand. The physical cache is a
+// fixed grid of pages shared by every layer and level, the page table has a
+// layer per texture and a level per virtual level, each entry maps a page to
+// its cache slot or to the slot of its closest resident ancestor. Pages are
+// read on the shared pool from the mapped mip chain caches
+class VirtualTexture {
+ public:
+  // Levels of a compressed texture start as whole blocks, as TextureArray
+  VirtualTexture(const std::vector<std::string>& textures, int width,
+                 int height, int channels,
+                 BlockFormat block_format = BlockFormat::None,
+                 bool srgb = false);
+  VirtualTexture(VirtualTexture const& src) = delete;
+  VirtualTexture& operator=(VirtualTexture const& rhs) = delete;
+  // Loads in flight finish on the pool and are dropped
+  ~VirtualTexture();
+
+  int findTextureIndex(const std::string& texture_name) const;
+  // Render thread, once per frame with the requests of the last feedback:
+  // queues the pages that are not resident, uploads the pages loaded since
+  // the last call, evicting the least recently used, and updates the table
+  void update(std::vector<uint32_t>& requests);
+
+  GLuint cache_id = 0;  // physical pages
+  GLuint table_id = 0;  // RGBA8UI: slot x, slot y, mapped level, resident
+  int width = 0;
+  int height = 0;
+  int level_count = 0;  // virtual levels, the last one fits in a page
+  BlockFormat format = BlockFormat::None;
+  size_t gpu_bytes = 0;      // cache and table, whatever the content
+  size_t virtual_bytes = 0;  // virtual levels of every layer
+  size_t resident_pages = 0;
+  size_t slot_count = 0;
+  size_t pages_loaded = 0;  // since the start
+  size_t pages_evicted = 0;
+
+ private:
+  struct Shared;
+  std::shared_ptr<Shared> _shared;
+  std::map<std::string, int> _lookup_table;
+  int _channels = 0;
+  int _layer_count = 0;
+  uint64_t _frame = 0;
+  size_t _pending = 0;
+  bool _pin_tail = true;  // the last level of every layer never leaves
+  // Pages of every level of every layer, slot or one of the states
+  std::vector<size_t> _level_offsets;
+  std::vector<int> _page_slots;
+  // Request of the page in each slot, frame it was last asked for
+  std::vector<uint32_t> _slot_pages;
+  std::vector<uint64_t> _slot_frames;
+  std::vector<bool> _slot_pinned;
+  std::vector<int> _free_slots;
+  // CPU copy of the table, a vector per level
+  std::vector<std::vector<uint8_t>> _tables;
+  std::vector<bool> _dirty_layers;
+
+  int pagesX(int level) const;
+  int pagesY(int level) const;
+  size_t pageIndex(uint32_t request) const;
+  bool validRequest(uint32_t request) const;
+  void queuePage(uint32_t request);
+  int allocateSlot();
+  void uploadPages();
+  void updatePageTable(int layer);
+};